@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "boot_info.h"
+#include "cpu.h"
+#include "fb.h"
+#include "gfx.h"
+#include "kmalloc.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "../helpers/crc32c.h"
+
+// Host microbenchmarks for kernel code. `make bench` stages the kernel
+// sources next to the shims in bench/host and builds them for Linux user
+// space with the kernel's own code generation flags, so what runs here is
+// the kernel's code, not a copy of it. Results go out as JSON for
+// tools/benchcmp.py to compare across commits.
+//
+// Each benchmark is calibrated to take at least the sample time per
+// repetition, warmed up, then timed over a number of repetitions; the
+// report is per operation.
+
+// helpers/mem.c, renamed at build time so it does not replace libc's
+void *xo_memcpy(void *dst, const void *src, size_t size);
+void *xo_memmove(void *dst, const void *src, size_t size);
+void *xo_memset(void *dst, int value, size_t size);
+
+#define BENCH_ARENA_SIZE   (128ULL << 20)
+#define BENCH_BUFFER_SIZE  (2ULL << 20)
+#define BENCH_BATCH        256
+#define BENCH_FB_WIDTH     1920
+#define BENCH_FB_HEIGHT    1080
+#define BENCH_MAX_SAMPLES  1000
+
+typedef struct {
+  const char *name;
+  void (*run)(uint64_t size, uint64_t operations);
+  uint64_t size;  // Benchmark-specific parameter
+  uint64_t bytes; // Bytes processed per operation, 0 if not meaningful
+} xo_bench_t;
+
+typedef struct {
+  double median;
+  double mean;
+  double stddev;
+  double min;
+  double max;
+} xo_bench_stats_t;
+
+static uint8_t *source;
+static uint8_t *destination;
+static xo_pixel_format_t rgb_format; // Red in the low byte: packing must swizzle
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void run_memcpy(uint64_t size, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    xo_memcpy(destination, source, size);
+  }
+}
+
+static void run_memmove(uint64_t size, uint64_t operations) {
+  // Overlapping, destination above the source: the backward copy
+  for (uint64_t i = 0; i < operations; i++) {
+    xo_memmove(destination + 64, destination, size);
+  }
+}
+
+static void run_memset(uint64_t size, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    xo_memset(destination, (int)i, size);
+  }
+}
+
+static void run_crc32c(uint64_t size, uint64_t operations) {
+  uint32_t crc = 0;
+  for (uint64_t i = 0; i < operations; i++) {
+    crc = crc32c(crc, source, size);
+  }
+  sink = crc;
+}
+
+static void run_pmm(uint64_t order, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    uint64_t page = pmm_alloc_pages((uint32_t)order);
+    if (!page) {
+      abort();
+    }
+    pmm_free_pages(page, (uint32_t)order);
+  }
+}
+
+// Allocate a batch, then free it, so blocks split and merge
+static void run_pmm_batch(uint64_t order, uint64_t operations) {
+  uint64_t pages[BENCH_BATCH];
+  while (operations) {
+    uint64_t count = operations < BENCH_BATCH ? operations : BENCH_BATCH;
+    for (uint64_t i = 0; i < count; i++) {
+      if (!(pages[i] = pmm_alloc_pages((uint32_t)order))) {
+        abort();
+      }
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      pmm_free_pages(pages[i], (uint32_t)order);
+    }
+    operations -= count;
+  }
+}
+
+static void run_kmalloc(uint64_t size, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    void *object = kmalloc(size);
+    if (!object) {
+      abort();
+    }
+    kfree(object);
+  }
+}
+
+// A batch larger than a magazine goes through the shared depot
+static void run_kmalloc_batch(uint64_t size, uint64_t operations) {
+  void *objects[BENCH_BATCH];
+  while (operations) {
+    uint64_t count = operations < BENCH_BATCH ? operations : BENCH_BATCH;
+    for (uint64_t i = 0; i < count; i++) {
+      if (!(objects[i] = kmalloc(size))) {
+        abort();
+      }
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      kfree(objects[i]);
+    }
+    operations -= count;
+  }
+}
+
+static void run_fill_span(uint64_t pixels, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    gfx_fill_span((uint32_t*)destination, (uint32_t)i, pixels);
+  }
+}
+
+static void run_copy_span(uint64_t pixels, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    gfx_copy_span((uint32_t*)destination, (const uint32_t*)source, pixels);
+  }
+}
+
+static void run_pack_span(uint64_t pixels, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    gfx_pack_span((uint32_t*)destination, (const uint32_t*)source, pixels, &rgb_format);
+  }
+}
+
+static void run_fb_clear(uint64_t size, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    fb_clear((uint32_t)i);
+  }
+}
+
+static void run_fb_plot(uint64_t size, uint64_t operations) {
+  // Scattered points, so the damage list fills and merges
+  uint32_t state = 1;
+  for (uint64_t i = 0; i < operations; i++) {
+    state = state * 1664525 + 1013904223;
+    fb_plot((state >> 8) % BENCH_FB_WIDTH, (state >> 20) % BENCH_FB_HEIGHT, (uint32_t)i);
+  }
+}
+
+static void run_fb_fill_rect(uint64_t side, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    uint32_t x = (uint32_t)(i * side) % (BENCH_FB_WIDTH - (uint32_t)side);
+    fb_fill_rect(x, (uint32_t)side, (uint32_t)side, (uint32_t)side, (uint32_t)i);
+  }
+}
+
+static void run_fb_flush(uint64_t rows, uint64_t operations) {
+  for (uint64_t i = 0; i < operations; i++) {
+    fb_damage(0, 0, BENCH_FB_WIDTH, (uint32_t)rows);
+    fb_flush();
+  }
+}
+
+static const xo_bench_t benchmarks[] = {
+  { "mem/memcpy/64",          run_memcpy,        64,             64 },
+  { "mem/memcpy/4096",        run_memcpy,        4096,           4096 },
+  { "mem/memcpy/1M",          run_memcpy,        1 << 20,        1 << 20 },
+  { "mem/memmove/4096",       run_memmove,       4096,           4096 },
+  { "mem/memset/64",          run_memset,        64,             64 },
+  { "mem/memset/4096",        run_memset,        4096,           4096 },
+  { "mem/memset/1M",          run_memset,        1 << 20,        1 << 20 },
+  { "crc32c/64",              run_crc32c,        64,             64 },
+  { "crc32c/4096",            run_crc32c,        4096,           4096 },
+  { "crc32c/1M",              run_crc32c,        1 << 20,        1 << 20 },
+  { "pmm/alloc_free/order0",  run_pmm,           0,              0 },
+  { "pmm/alloc_free/order4",  run_pmm,           4,              0 },
+  { "pmm/batch/order0",       run_pmm_batch,     0,              0 },
+  { "kmalloc/alloc_free/64",  run_kmalloc,       64,             0 },
+  { "kmalloc/alloc_free/512", run_kmalloc,       512,            0 },
+  { "kmalloc/alloc_free/8192", run_kmalloc,      8192,           0 },
+  { "kmalloc/batch/64",       run_kmalloc_batch, 64,             0 },
+  { "gfx/fill_span/1920",     run_fill_span,     1920,           1920 * 4 },
+  { "gfx/copy_span/1920",     run_copy_span,     1920,           1920 * 4 },
+  { "gfx/pack_span/1920",     run_pack_span,     1920,           1920 * 4 },
+  { "fb/clear",               run_fb_clear,      0,              BENCH_FB_WIDTH * BENCH_FB_HEIGHT * 4 },
+  { "fb/plot",                run_fb_plot,       0,              0 },
+  { "fb/fill_rect/64",        run_fb_fill_rect,  64,             64 * 64 * 4 },
+  { "fb/flush/16",            run_fb_flush,      16,             BENCH_FB_WIDTH * 16 * 4 },
+  { "fb/flush/full",          run_fb_flush,      BENCH_FB_HEIGHT, BENCH_FB_WIDTH * BENCH_FB_HEIGHT * 4 },
+};
+
+// Bring up the pieces of the kernel under test, in boot order
+static int setup_kernel(void) {
+  percpu_setup(0, 0);
+  crc32c_init();
+
+  // The allocators want "physical" memory below 4 GiB; with the identity
+  // direct map any mapping there will do
+  void *arena = mmap(NULL, BENCH_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_POPULATE, -1, 0);
+  if (arena == MAP_FAILED) {
+    perror("bench: arena");
+    return -1;
+  }
+
+  static xo_memory_entry_t memory_map[1];
+  memory_map[0].base_address = (uint64_t)(uintptr_t)arena;
+  memory_map[0].length = BENCH_ARENA_SIZE;
+  memory_map[0].type = XO_MEMORY_AVAILABLE;
+  memory_map[0].attributes = 0;
+
+  xo_boot_info_t boot_info;
+  memset(&boot_info, 0, sizeof(boot_info));
+  boot_info.memory_map = memory_map;
+  boot_info.memory_map_entries = 1;
+  boot_info.cmdline = "";
+  if (pmm_init(&boot_info) != 0) {
+    fprintf(stderr, "bench: pmm_init failed\n");
+    return -1;
+  }
+  kmalloc_init();
+  gfx_init();
+
+  // Native 0x00RRGGBB layout, so flushing is a plain copy
+  xo_graphics_info_t graphics;
+  memset(&graphics, 0, sizeof(graphics));
+  graphics.framebuffer_address = 0xFD000000;
+  graphics.framebuffer_width = BENCH_FB_WIDTH;
+  graphics.framebuffer_height = BENCH_FB_HEIGHT;
+  graphics.framebuffer_pitch = BENCH_FB_WIDTH * 4;
+  graphics.framebuffer_bpp = 32;
+  graphics.red_mask_size = 8;
+  graphics.red_field_position = 16;
+  graphics.green_mask_size = 8;
+  graphics.green_field_position = 8;
+  graphics.blue_mask_size = 8;
+  graphics.blue_field_position = 0;
+  if (fb_init(&graphics) != 0) {
+    fprintf(stderr, "bench: fb_init failed\n");
+    return -1;
+  }
+
+  graphics.red_field_position = 0;
+  graphics.blue_field_position = 16;
+  gfx_pixel_format(&graphics, &rgb_format);
+  return 0;
+}
+
+static uint64_t time_run(const xo_bench_t *bench, uint64_t operations) {
+  uint64_t start = now_ns();
+  bench->run(bench->size, operations);
+  return now_ns() - start;
+}
+
+// Operations per sample so that one sample takes at least sample_ns
+static uint64_t calibrate(const xo_bench_t *bench, uint64_t sample_ns) {
+  uint64_t operations = 1;
+  for (;;) {
+    uint64_t elapsed = time_run(bench, operations);
+    if (elapsed >= sample_ns) {
+      return operations;
+    }
+    if (elapsed < sample_ns / 16) {
+      operations *= 8;
+    } else {
+      // Close enough to extrapolate, with some headroom
+      return (uint64_t)((double)operations * (double)sample_ns / (double)elapsed * 1.1) + 1;
+    }
+  }
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void summarize(double *samples, uint32_t count, xo_bench_stats_t *stats) {
+  qsort(samples, count, sizeof(double), compare_double);
+  double sum = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  stats->mean = sum / count;
+
+  double squares = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+  }
+  stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+  stats->median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+  stats->min = samples[0];
+  stats->max = samples[count - 1];
+}
+
+static void cpu_brand(char *brand) {
+  uint32_t *words = (uint32_t*)brand;
+  uint32_t leaf = 0x80000000;
+  __asm__ volatile ("cpuid" : "+a"(leaf) : "c"(0) : "ebx", "edx");
+  if (leaf < 0x80000004) {
+    strcpy(brand, "unknown");
+    return;
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    cpuid(0x80000002 + i, 0, &words[i * 4], &words[i * 4 + 1], &words[i * 4 + 2], &words[i * 4 + 3]);
+  }
+  brand[48] = 0;
+
+  // Trim the padding some CPUs report
+  char *start = brand;
+  while (*start == ' ') {
+    start++;
+  }
+  memmove(brand, start, strlen(start) + 1);
+  for (size_t length = strlen(brand); length && brand[length - 1] == ' '; length--) {
+    brand[length - 1] = 0;
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: bench [-f filter] [-r repetitions] [-w warmup] [-t sample ms]\n"
+          "             [-l label] [-o output.json] [-n]\n"
+          "  -n  list the benchmarks and exit\n");
+}
+
+int main(int argc, char **argv) {
+  const char *filter = NULL;
+  const char *label = "";
+  const char *output_path = NULL;
+  uint32_t repetitions = 20;
+  uint32_t warmup = 3;
+  uint64_t sample_ms = 20;
+  int option;
+
+  while ((option = getopt(argc, argv, "f:r:w:t:l:o:nh")) != -1) {
+    switch (option) {
+    case 'f': filter = optarg; break;
+    case 'r': repetitions = (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 'w': warmup = (uint32_t)strtoul(optarg, NULL, 10); break;
+    case 't': sample_ms = strtoull(optarg, NULL, 10); break;
+    case 'l': label = optarg; break;
+    case 'o': output_path = optarg; break;
+    case 'n':
+      for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        printf("%s\n", benchmarks[i].name);
+      }
+      return 0;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (repetitions < 1 || repetitions > BENCH_MAX_SAMPLES || !sample_ms) {
+    usage();
+    return 2;
+  }
+
+  // Stay on one CPU: the kernel code assumes it does not migrate under it
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(sched_getcpu(), &cpus);
+  sched_setaffinity(0, sizeof(cpus), &cpus);
+
+  source = aligned_alloc(4096, BENCH_BUFFER_SIZE);
+  destination = aligned_alloc(4096, BENCH_BUFFER_SIZE);
+  if (!source || !destination || setup_kernel() != 0) {
+    return 1;
+  }
+  for (uint64_t i = 0; i < BENCH_BUFFER_SIZE; i++) {
+    source[i] = (uint8_t)(i * 131 + 7);
+  }
+  memset(destination, 0, BENCH_BUFFER_SIZE);
+
+  FILE *output = stdout;
+  if (output_path && !(output = fopen(output_path, "w"))) {
+    perror(output_path);
+    return 1;
+  }
+
+  char brand[49];
+  cpu_brand(brand);
+  fprintf(output, "{\n  \"version\": 1,\n  \"label\": \"%s\",\n", label);
+  fprintf(output, "  \"cpu\": \"%s\",\n  \"gfx_backend\": \"%s\",\n", brand, gfx_backend());
+  fprintf(output, "  \"repetitions\": %u,\n  \"warmup\": %u,\n  \"sample_ms\": %lu,\n",
+          repetitions, warmup, sample_ms);
+  fprintf(output, "  \"results\": [");
+
+  static double samples[BENCH_MAX_SAMPLES];
+  uint32_t done = 0;
+  for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+    const xo_bench_t *bench = &benchmarks[b];
+    if (filter && !strstr(bench->name, filter)) {
+      continue;
+    }
+
+    uint64_t operations = calibrate(bench, sample_ms * 1000000);
+    for (uint32_t i = 0; i < warmup; i++) {
+      time_run(bench, operations);
+    }
+    for (uint32_t i = 0; i < repetitions; i++) {
+      samples[i] = (double)time_run(bench, operations) / (double)operations;
+    }
+
+    xo_bench_stats_t stats;
+    summarize(samples, repetitions, &stats);
+    double mib_per_s = bench->bytes ? (double)bench->bytes / stats.median * 1e9 / (1 << 20) : 0;
+
+    fprintf(output, "%s\n    {\"name\": \"%s\", \"operations\": %lu, \"bytes_per_op\": %lu,\n",
+            done ? "," : "", bench->name, operations, bench->bytes);
+    fprintf(output, "     \"ns_per_op\": {\"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, "
+            "\"min\": %.3f, \"max\": %.3f}, \"mib_per_s\": %.1f}",
+            stats.median, stats.mean, stats.stddev, stats.min, stats.max, mib_per_s);
+    fflush(output);
+
+    fprintf(stderr, "%-26s %12.2f ns/op  +-%5.1f%%", bench->name, stats.median,
+            stats.mean ? stats.stddev * 100 / stats.mean : 0);
+    if (bench->bytes) {
+      fprintf(stderr, "  %10.1f MiB/s", mib_per_s);
+    }
+    fprintf(stderr, "\n");
+    done++;
+  }
+
+  fprintf(output, "\n  ]\n}\n");
+  if (output != stdout) {
+    fclose(output);
+  }
+  return 0;
+}
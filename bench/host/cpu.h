@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for kernel/cpu.h, staged over it when kernel code is built
+// for the benchmarks (see bench/bench.c). Interrupts cannot be masked from
+// user mode, so irq_save/irq_restore only keep the compiler barrier, and
+// there are no ports to talk to. Everything else is the real instruction.
+// Anything privileged is deliberately missing so that a benchmarked unit
+// starting to use it fails to build instead of faulting.
+
+static inline uint64_t irq_save(void) {
+  __asm__ volatile ("" : : : "memory");
+  return 0;
+}
+
+static inline void irq_restore(uint64_t flags) {
+  (void)flags;
+  __asm__ volatile ("" : : : "memory");
+}
+
+static inline void outb(uint16_t port, uint8_t value) {
+  (void)port;
+  (void)value;
+}
+
+static inline uint8_t inb(uint16_t port) {
+  (void)port;
+  return 0xFF;
+}
+
+static inline uint32_t inl(uint16_t port) {
+  (void)port;
+  return 0xFFFFFFFF;
+}
+
+static inline uint64_t rdtsc(void) {
+  uint32_t low, high;
+  __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+static inline void cpu_relax(void) {
+  __asm__ volatile ("pause" : : : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  __asm__ volatile ("cpuid"
+                    : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                    : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint32_t cpu_initial_apic_id(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  return ebx >> 24;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for kernel/memlayout.h. The benchmark hands the allocators
+// an arena of its own address space as "physical" memory, so the direct map
+// is the identity. The arena sits below 4 GiB, as early memory does.
+
+#define DIRECT_MAP_BASE  0ULL
+#define EARLY_MAP_LIMIT  0x100000000ULL
+
+static inline void *phys_to_virt(uint64_t phys) {
+  return (void*)(uintptr_t)phys;
+}
+
+static inline uint64_t virt_to_phys(const void *virt) {
+  return (uint64_t)(uintptr_t)virt;
+}
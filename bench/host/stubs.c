@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <asm/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "paging.h"
+#include "percpu.h"
+#include "simd.h"
+
+// What the benchmarked kernel units link against besides each other: the
+// per-CPU blocks, linker symbols and the few services stubbed out on the
+// host.
+
+xo_percpu_t percpu_areas[MAX_CPUS];
+
+// Nothing in the arena belongs to the kernel image
+char _kernel_phys_start[1];
+char _kernel_phys_end[1];
+
+void percpu_setup(uint32_t cpu_id, uint32_t apic_id) {
+  xo_percpu_t *cpu = &percpu_areas[cpu_id];
+  cpu->self = cpu;
+  cpu->cpu_id = cpu_id;
+  cpu->apic_id = apic_id;
+  cpu->online = 1;
+  syscall(SYS_arch_prctl, ARCH_SET_GS, (unsigned long)cpu);
+}
+
+// User space always has the vector registers; there is no state to save
+int simd_init_cpu(void) {
+  return 0;
+}
+
+int simd_has_avx2(void) {
+  return __builtin_cpu_supports("avx2");
+}
+
+void simd_begin(void) {
+  this_cpu()->simd_depth++;
+}
+
+void simd_end(void) {
+  this_cpu()->simd_depth--;
+}
+
+// The "framebuffer" is ordinary memory
+void *paging_map_mmio_type(uint64_t phys, uint64_t size, xo_mem_type_t type) {
+  (void)phys;
+  (void)type;
+  return aligned_alloc(PAGE_SIZE_2M, (size + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1));
+}
+
+void *paging_map_mmio(uint64_t phys, uint64_t size) {
+  return paging_map_mmio_type(phys, size, MEM_TYPE_UC);
+}
@@ -1,4 +1,8 @@
 #include "../helpers/types.h"
+#include "../helpers/boot_tags.h"
+#include "../helpers/crc32c.h"
+#include "../helpers/lz4.h"
+#include "../helpers/mem.h"
 #include "elf.h"
 
 // Compiler intrinsics and runtime support
@@ -6,14 +10,6 @@ void __chkstk(void) {
   // Stack checking stub - not needed for our bootloader
 }
 
-void *memset(void *s, int c, size_t n) {
-  unsigned char *p = (unsigned char*)s;
-  while (n--) {
-    *p++ = (unsigned char)c;
-  }
-  return s;
-}
-
 // UEFI Basic Types
 typedef struct _EFI_SYSTEM_TABLE EFI_SYSTEM_TABLE;
 typedef struct _EFI_BOOT_SERVICES EFI_BOOT_SERVICES;
@@ -23,21 +19,21 @@ typedef struct _EFI_GRAPHICS_OUTPUT_PROTOCOL EFI_GRAPHICS_OUTPUT_PROTOCOL;
 typedef struct _EFI_LOADED_IMAGE_PROTOCOL EFI_LOADED_IMAGE_PROTOCOL;
 
 typedef void* EFI_HANDLE;
-typedef unsigned long EFI_STATUS;
 typedef uint64_t UINTN;
+typedef UINTN EFI_STATUS; // Native width: error codes have bit 63 set
 typedef uint16_t CHAR16;
 
-// UEFI Status Codes (using proper size for unsigned long)
-#define EFI_SUCCESS               0x00000000UL
-#define EFI_LOAD_ERROR            0x80000001UL
-#define EFI_INVALID_PARAMETER     0x80000002UL
-#define EFI_UNSUPPORTED           0x80000003UL
-#define EFI_BAD_BUFFER_SIZE       0x80000004UL
-#define EFI_BUFFER_TOO_SMALL      0x80000005UL
-#define EFI_NOT_READY             0x80000006UL
-#define EFI_DEVICE_ERROR          0x80000007UL
-#define EFI_NOT_FOUND             0x8000000EUL
-#define EFI_OUT_OF_RESOURCES      0x80000009UL
+// UEFI Status Codes
+#define EFI_SUCCESS               0x0000000000000000ULL
+#define EFI_LOAD_ERROR            0x8000000000000001ULL
+#define EFI_INVALID_PARAMETER     0x8000000000000002ULL
+#define EFI_UNSUPPORTED           0x8000000000000003ULL
+#define EFI_BAD_BUFFER_SIZE       0x8000000000000004ULL
+#define EFI_BUFFER_TOO_SMALL      0x8000000000000005ULL
+#define EFI_NOT_READY             0x8000000000000006ULL
+#define EFI_DEVICE_ERROR          0x8000000000000007ULL
+#define EFI_NOT_FOUND             0x800000000000000EULL
+#define EFI_OUT_OF_RESOURCES      0x8000000000000009ULL
 
 // UEFI Memory Types
 typedef enum {
@@ -144,14 +140,21 @@ struct _EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL {
 };
 
 struct _EFI_GRAPHICS_OUTPUT_PROTOCOL {
-  void* QueryMode;
-  void* SetMode;
+  EFI_STATUS (*QueryMode)(EFI_GRAPHICS_OUTPUT_PROTOCOL*, uint32_t, UINTN*, EFI_GRAPHICS_OUTPUT_MODE_INFORMATION**);
+  EFI_STATUS (*SetMode)(EFI_GRAPHICS_OUTPUT_PROTOCOL*, uint32_t);
   void* Blt;
   EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *Mode;
 };
 
+typedef struct {
+  uint32_t SizeOfEdid;
+  uint8_t *Edid;
+} EFI_EDID_ACTIVE_PROTOCOL;
+
+// Every slot is listed so that the offsets match the specification; only
+// the ones we call are typed
 struct _EFI_BOOT_SERVICES {
-  char _pad[24];
+  char _pad[24]; // EFI_TABLE_HEADER
   void* RaiseTPL;
   void* RestoreTPL;
   EFI_STATUS (*AllocatePages)(int, EFI_MEMORY_TYPE, UINTN, uint64_t*);
@@ -159,12 +162,43 @@ struct _EFI_BOOT_SERVICES {
   EFI_STATUS (*GetMemoryMap)(UINTN*, EFI_MEMORY_DESCRIPTOR*, UINTN*, UINTN*, uint32_t*);
   EFI_STATUS (*AllocatePool)(EFI_MEMORY_TYPE, UINTN, void**);
   EFI_STATUS (*FreePool)(void*);
-  char _pad2[88];
+  EFI_STATUS (*CreateEvent)(uint32_t, UINTN, void*, void*, void**);
+  void* SetTimer;
+  void* WaitForEvent;
+  void* SignalEvent;
+  void* CloseEvent;
+  void* CheckEvent;
+  void* InstallProtocolInterface;
+  void* ReinstallProtocolInterface;
+  void* UninstallProtocolInterface;
   EFI_STATUS (*HandleProtocol)(EFI_HANDLE, void*, void**);
-  char _pad3[64];
-  EFI_STATUS (*LocateProtocol)(void*, void*, void**);
-  char _pad4[96];
+  void* Reserved;
+  void* RegisterProtocolNotify;
+  void* LocateHandle;
+  void* LocateDevicePath;
+  void* InstallConfigurationTable;
+  void* LoadImage;
+  void* StartImage;
+  void* Exit;
+  void* UnloadImage;
   EFI_STATUS (*ExitBootServices)(EFI_HANDLE, UINTN);
+  void* GetNextMonotonicCount;
+  EFI_STATUS (*Stall)(UINTN);
+  EFI_STATUS (*SetWatchdogTimer)(UINTN, uint64_t, UINTN, CHAR16*);
+  void* ConnectController;
+  void* DisconnectController;
+  void* OpenProtocol;
+  void* CloseProtocol;
+  void* OpenProtocolInformation;
+  void* ProtocolsPerHandle;
+  void* LocateHandleBuffer;
+  EFI_STATUS (*LocateProtocol)(void*, void*, void**);
+  void* InstallMultipleProtocolInterfaces;
+  void* UninstallMultipleProtocolInterfaces;
+  EFI_STATUS (*CalculateCrc32)(void*, UINTN, uint32_t*);
+  void* CopyMem;
+  void* SetMem;
+  void* CreateEventEx;
 };
 
 struct _EFI_RUNTIME_SERVICES {
@@ -181,7 +215,7 @@ struct _EFI_SYSTEM_TABLE {
   uint32_t HeaderSize;
   uint32_t CRC32;
   uint32_t Reserved;
-  uint16_t FirmwareVendor;
+  CHAR16 *FirmwareVendor;
   uint32_t FirmwareRevision;
   EFI_HANDLE ConsoleInHandle;
   EFI_SIMPLE_TEXT_INPUT_PROTOCOL *ConIn;
@@ -192,95 +226,44 @@ struct _EFI_SYSTEM_TABLE {
   EFI_RUNTIME_SERVICES *RuntimeServices;
   EFI_BOOT_SERVICES *BootServices;
   UINTN NumberOfTableEntries;
-  void* ConfigurationTable;
+  struct _EFI_CONFIGURATION_TABLE *ConfigurationTable;
 };
 
-#define XO_BOOT_INFO_MAGIC 0x584F424F4F54ULL  // "XOBOOT"
-#define XO_MAX_MEMORY_ENTRIES 256
-#define XO_MAX_CMDLINE_LENGTH 1024
-
-typedef enum {
-  XO_MEMORY_AVAILABLE = 1,
-  XO_MEMORY_RESERVED = 2,
-  XO_MEMORY_ACPI_RECLAIMABLE = 3,
-  XO_MEMORY_ACPI_NVS = 4,
-  XO_MEMORY_BAD = 5,
-  XO_MEMORY_BOOTLOADER_CODE = 6,
-  XO_MEMORY_BOOTLOADER_DATA = 7,
-  XO_MEMORY_RUNTIME_CODE = 8,
-  XO_MEMORY_RUNTIME_DATA = 9,
-  XO_MEMORY_CONVENTIONAL = 10,
-  XO_MEMORY_UNUSABLE = 11,
-  XO_MEMORY_PERSISTENT = 12
-} xo_memory_type_t;
-
-typedef struct {
-  uint64_t base_address;
-  uint64_t length;
-  xo_memory_type_t type;
-  uint32_t attributes;
-} xo_memory_entry_t;
-
-typedef struct {
-  uint64_t framebuffer_address;
-  uint32_t framebuffer_width;
-  uint32_t framebuffer_height;
-  uint32_t framebuffer_pitch;
-  uint32_t framebuffer_bpp;
-  uint32_t red_mask_size;
-  uint32_t red_field_position;
-  uint32_t green_mask_size;
-  uint32_t green_field_position;
-  uint32_t blue_mask_size;
-  uint32_t blue_field_position;
-  uint32_t reserved_mask_size;
-  uint32_t reserved_field_position;
-} xo_graphics_info_t;
-
-typedef struct {
-  uint64_t acpi_rsdp_address;
-  uint64_t smbios_address;
-  uint64_t device_tree_address;
-  uint32_t device_tree_size;
-  uint32_t cpu_count;
-  uint64_t cpu_features;
-} xo_hardware_info_t;
-
-typedef struct {
-  uint64_t kernel_physical_address;
-  uint64_t kernel_virtual_address;
-  uint64_t kernel_size;
-  uint64_t kernel_entry_point;
-  uint64_t initrd_address;
-  uint64_t initrd_size;
-  char cmdline[XO_MAX_CMDLINE_LENGTH];
-} xo_kernel_info_t;
+// EFI_MP_SERVICES_PROTOCOL (PI specification). Procedures run on the APs
+// must not call boot services.
+typedef struct _EFI_MP_SERVICES_PROTOCOL EFI_MP_SERVICES_PROTOCOL;
+typedef void (*EFI_AP_PROCEDURE)(void *argument);
+
+struct _EFI_MP_SERVICES_PROTOCOL {
+  EFI_STATUS (*GetNumberOfProcessors)(EFI_MP_SERVICES_PROTOCOL*, UINTN*, UINTN*);
+  void* GetProcessorInfo;
+  EFI_STATUS (*StartupAllAPs)(EFI_MP_SERVICES_PROTOCOL*, EFI_AP_PROCEDURE, uint8_t single_thread,
+                              void *wait_event, UINTN timeout_us, void *argument, UINTN **failed_cpus);
+  void* StartupThisAP;
+  void* SwitchBSP;
+  void* EnableDisableAP;
+  void* WhoAmI;
+};
 
-typedef struct {
-  uint64_t efi_system_table;
-  uint64_t efi_runtime_services;
-  uint8_t runtime_services_supported;
-  uint32_t efi_version;
-  uint64_t loader_signature;
-} xo_uefi_info_t;
+typedef struct _EFI_CONFIGURATION_TABLE {
+  uint8_t VendorGuid[16];
+  void *VendorTable;
+} EFI_CONFIGURATION_TABLE;
 
+// What the loader gathers for the kernel. It is written out as a tagged
+// boot block (see helpers/boot_tags.h) right before the jump.
 typedef struct {
-  uint64_t magic;
-  uint32_t version;
-  uint32_t size;
-
-  xo_memory_entry_t memory_map[XO_MAX_MEMORY_ENTRIES];
   uint32_t memory_map_entries;
   uint64_t total_memory;
   uint64_t available_memory;
 
+  char cmdline[XO_MAX_CMDLINE_LENGTH];
   xo_graphics_info_t graphics;
-  xo_hardware_info_t hardware;
-  xo_kernel_info_t kernel;
-  xo_uefi_info_t uefi;
-
-  uint64_t bootloader_timestamp;
-  uint32_t checksum;
+  xo_boot_acpi_t acpi;
+  xo_boot_initrd_t initrd;
+  xo_boot_kernel_t kernel;
+  xo_boot_efi_t efi;
+  xo_boot_timing_t timing;
 } xo_boot_info_t;
 
 // Global variables
@@ -343,9 +326,16 @@ struct _EFI_LOADED_IMAGE_PROTOCOL {
 };
 
 // Protocol GUIDs (simplified representations)
+// 9042A9DE-23DC-4A38-96FB-7ADED080516A
 static uint8_t gEfiGraphicsOutputProtocolGuid[16] = {
-  0x9b, 0xc0, 0xb0, 0x3e, 0x74, 0x2f, 0x44, 0x9b,
-  0x85, 0x85, 0x3e, 0xd4, 0x5e, 0x5e, 0x3c, 0xd9
+  0xde, 0xa9, 0x42, 0x90, 0xdc, 0x23, 0x38, 0x4a,
+  0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a
+};
+
+// BD8C1056-9F36-44EC-92A8-A6337F817986
+static uint8_t gEfiEdidActiveProtocolGuid[16] = {
+  0x56, 0x10, 0x8c, 0xbd, 0x36, 0x9f, 0xec, 0x44,
+  0x92, 0xa8, 0xa6, 0x33, 0x7f, 0x81, 0x79, 0x86
 };
 
 static uint8_t gEfiSimpleFileSystemProtocolGuid[16] = {
@@ -358,20 +348,85 @@ static uint8_t gEfiLoadedImageProtocolGuid[16] = {
   0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b
 };
 
+// 09576E92-6D3F-11D2-8E39-00A0C969723B
 static uint8_t gEfiFileInfoGuid[16] = {
-  0x92, 0xec, 0x79, 0x09, 0x96, 0x8e, 0x11, 0xd1,
-  0x9f, 0x4d, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b
+  0x92, 0x6e, 0x57, 0x09, 0x3f, 0x6d, 0xd2, 0x11,
+  0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b
+};
+
+// 3FDDA605-A76E-4F46-AD29-12F4531B3D08
+static uint8_t gEfiMpServiceProtocolGuid[16] = {
+  0x05, 0xa6, 0xdd, 0x3f, 0x6e, 0xa7, 0x46, 0x4f,
+  0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08
+};
+
+// 8868E871-E4F1-11D3-BC22-0080C73C8881
+static uint8_t gEfiAcpi20TableGuid[16] = {
+  0x71, 0xe8, 0x68, 0x88, 0xf1, 0xe4, 0xd3, 0x11,
+  0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81
+};
+
+// EB9D2D30-2D88-11D3-9A16-0090273FC14D
+static uint8_t gEfiAcpi10TableGuid[16] = {
+  0x30, 0x2d, 0x9d, 0xeb, 0x88, 0x2d, 0xd3, 0x11,
+  0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d
 };
 
+static int guid_equal(const uint8_t *a, const uint8_t *b) {
+  for (int i = 0; i < 16; i++) {
+    if (a[i] != b[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Find the ACPI RSDP in the EFI configuration table, preferring ACPI 2.0+
+static uint64_t find_acpi_rsdp(void) {
+  uint64_t acpi10_rsdp = 0;
+
+  for (UINTN i = 0; i < gST->NumberOfTableEntries; i++) {
+    EFI_CONFIGURATION_TABLE *table = &gST->ConfigurationTable[i];
+    if (guid_equal(table->VendorGuid, gEfiAcpi20TableGuid)) {
+      return (uint64_t)(uintptr_t)table->VendorTable;
+    }
+    if (guid_equal(table->VendorGuid, gEfiAcpi10TableGuid)) {
+      acpi10_rsdp = (uint64_t)(uintptr_t)table->VendorTable;
+    }
+  }
+
+  return acpi10_rsdp;
+}
+
 // File system functions
-static EFI_STATUS load_file_from_device(EFI_HANDLE device_handle, const CHAR16 *file_name, void **file_buffer, UINTN *file_size) {
+// An open file on the boot volume, read in place with SetPosition/Read
+typedef struct {
+  EFI_FILE_PROTOCOL *root;
+  EFI_FILE_PROTOCOL *file;
+  uint64_t size;
+} xo_file_t;
+
+static void close_file(xo_file_t *file) {
+  if (file->file) {
+    file->file->Close(file->file);
+  }
+  if (file->root) {
+    file->root->Close(file->root);
+  }
+  file->file = NULL;
+  file->root = NULL;
+}
+
+static EFI_STATUS open_file(EFI_HANDLE device_handle, const CHAR16 *file_name, xo_file_t *file) {
   EFI_STATUS status;
   EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *file_system = NULL;
-  EFI_FILE_PROTOCOL *root_dir = NULL;
-  EFI_FILE_PROTOCOL *file = NULL;
-  EFI_FILE_INFO *file_info = NULL;
-  UINTN info_size;
-  void *buffer = NULL;
+  uint8_t info_buffer[sizeof(EFI_FILE_INFO) + 256 * sizeof(CHAR16)] __attribute__((aligned(8)));
+  EFI_FILE_INFO *file_info = (EFI_FILE_INFO*)(void*)info_buffer;
+  UINTN info_size = sizeof(info_buffer);
+
+  file->root = NULL;
+  file->file = NULL;
+  file->size = 0;
 
   // Get file system protocol
   status = gBS->HandleProtocol(device_handle, gEfiSimpleFileSystemProtocolGuid, (void**)&file_system);
@@ -379,78 +434,455 @@ static EFI_STATUS load_file_from_device(EFI_HANDLE device_handle, const CHAR16 *
     return status;
   }
 
-  // Open root directory
-  status = file_system->OpenVolume(file_system, &root_dir);
+  // Open root directory, then the file
+  status = file_system->OpenVolume(file_system, &file->root);
   if (status != EFI_SUCCESS) {
     return status;
   }
 
-  // Open the file
-  status = root_dir->Open(root_dir, &file, (CHAR16*)file_name, EFI_FILE_MODE_READ, 0);
+  status = file->root->Open(file->root, &file->file, (CHAR16*)file_name, EFI_FILE_MODE_READ, 0);
   if (status != EFI_SUCCESS) {
-    root_dir->Close(root_dir);
+    file->file = NULL;
+    close_file(file);
     return status;
   }
 
   // Get file information to determine size
-  info_size = sizeof(EFI_FILE_INFO) + 256 * sizeof(CHAR16);
-  status = gBS->AllocatePool(EfiLoaderData, info_size, (void**)&file_info);
+  status = file->file->GetInfo(file->file, gEfiFileInfoGuid, &info_size, file_info);
   if (status != EFI_SUCCESS) {
-    file->Close(file);
-    root_dir->Close(root_dir);
+    close_file(file);
     return status;
   }
 
-  status = file->GetInfo(file, gEfiFileInfoGuid, &info_size, file_info);
+  file->size = file_info->FileSize;
+  return EFI_SUCCESS;
+}
+
+// Read exactly size bytes at offset straight into buffer
+static EFI_STATUS read_file_at(xo_file_t *file, uint64_t offset, void *buffer, UINTN size) {
+  if (offset > file->size || size > file->size - offset) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  EFI_STATUS status = file->file->SetPosition(file->file, offset);
   if (status != EFI_SUCCESS) {
-    gBS->FreePool(file_info);
-    file->Close(file);
-    root_dir->Close(root_dir);
     return status;
   }
 
-  // Allocate buffer for file
-  UINTN buffer_size = (UINTN)file_info->FileSize;
-  status = gBS->AllocatePool(EfiLoaderData, buffer_size, &buffer);
+  uint8_t *cursor = (uint8_t*)buffer;
+  while (size) {
+    UINTN chunk = size;
+    status = file->file->Read(file->file, &chunk, cursor);
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
+    if (chunk == 0) {
+      return EFI_LOAD_ERROR; // Unexpected end of file
+    }
+    cursor += chunk;
+    size -= chunk;
+  }
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS open_boot_file(EFI_HANDLE image_handle, const CHAR16 *file_name, xo_file_t *file) {
+  EFI_STATUS status;
+  EFI_LOADED_IMAGE_PROTOCOL *loaded_image = NULL;
+
+  // Get loaded image protocol to find our device
+  status = gBS->HandleProtocol(image_handle, gEfiLoadedImageProtocolGuid, (void**)&loaded_image);
   if (status != EFI_SUCCESS) {
-    gBS->FreePool(file_info);
-    file->Close(file);
-    root_dir->Close(root_dir);
     return status;
   }
 
-  // Read file
-  status = file->Read(file, &buffer_size, buffer);
+  // Open the file on the same device as the bootloader
+  return open_file(loaded_image->DeviceHandle, file_name, file);
+}
+
+// Read the initrd archive into page-aligned loader memory. The kernel reads
+// it in place, so nothing is unpacked here. A missing file is not an error.
+static EFI_STATUS load_initrd(EFI_HANDLE image_handle, const CHAR16 *file_name,
+                              uint64_t *address, uint64_t *size) {
+  xo_file_t file;
+  *address = 0;
+  *size = 0;
+
+  EFI_STATUS status = open_boot_file(image_handle, file_name, &file);
+  if (status == EFI_NOT_FOUND) {
+    return EFI_SUCCESS;
+  }
   if (status != EFI_SUCCESS) {
-    gBS->FreePool(buffer);
-    gBS->FreePool(file_info);
-    file->Close(file);
-    root_dir->Close(root_dir);
     return status;
   }
 
-  // Cleanup
-  gBS->FreePool(file_info);
-  file->Close(file);
-  root_dir->Close(root_dir);
+  uint64_t base = 0;
+  UINTN pages = (UINTN)((file.size + 0xFFF) / 0x1000);
+  if (pages) {
+    status = gBS->AllocatePages(0, EfiLoaderData, pages, &base); // 0 = AllocateAnyPages
+    if (status == EFI_SUCCESS) {
+      status = read_file_at(&file, 0, (void*)(uintptr_t)base, (UINTN)file.size);
+      if (status != EFI_SUCCESS) {
+        gBS->FreePages(base, pages);
+      }
+    }
+  }
+  close_file(&file);
 
-  *file_buffer = buffer;
-  *file_size = buffer_size;
-  return EFI_SUCCESS;
+  if (status == EFI_SUCCESS && pages) {
+    *address = base;
+    *size = file.size;
+  }
+  return status;
 }
 
-static EFI_STATUS load_kernel_file(EFI_HANDLE image_handle, const CHAR16 *kernel_name, void **kernel_buffer, UINTN *kernel_size) {
-  EFI_STATUS status;
-  EFI_LOADED_IMAGE_PROTOCOL *loaded_image = NULL;
+// Kernel image reader. A raw ELF is read in place from the file, while an
+// LZ4 frame (independent blocks only) is decompressed on the fly. The ELF
+// loader asks for byte ranges of the uncompressed image in increasing order;
+// a range that starts on a block boundary and covers a whole block is
+// decoded straight into the caller's buffer, anything else goes through one
+// block-sized bounce buffer. Asking for an earlier range restarts the frame.
+typedef struct {
+  xo_file_t *file;
+  uint64_t size; // Uncompressed size, or ~0 if the frame does not say
+  int compressed;
+
+  xo_lz4_frame_t frame;
+  uint64_t input_position;  // File offset of the next block header
+  uint64_t output_position; // Image offset at which the next block starts
+  uint8_t *input;           // One compressed block
+  uint8_t *block;           // Bounce buffer
+  uint64_t block_start;     // Image offset of block[0]
+  uint32_t block_length;    // Valid bytes in block
+  int finished;             // End mark reached
+} xo_image_t;
+
+static void image_rewind(xo_image_t *image) {
+  image->input_position = image->frame.header_size;
+  image->output_position = 0;
+  image->block_start = 0;
+  image->block_length = 0;
+  image->finished = 0;
+}
 
-  // Get loaded image protocol to find our device
-  status = gBS->HandleProtocol(image_handle, gEfiLoadedImageProtocolGuid, (void**)&loaded_image);
+static void image_close(xo_image_t *image) {
+  if (image->input) {
+    gBS->FreePool(image->input);
+  }
+  if (image->block) {
+    gBS->FreePool(image->block);
+  }
+  image->input = NULL;
+  image->block = NULL;
+}
+
+static EFI_STATUS image_open(xo_file_t *file, xo_image_t *image) {
+  uint8_t header[LZ4_FRAME_HEADER_MAX];
+  UINTN header_size = file->size < sizeof(header) ? (UINTN)file->size : sizeof(header);
+
+  image->file = file;
+  image->size = file->size;
+  image->compressed = 0;
+  image->input = NULL;
+  image->block = NULL;
+
+  EFI_STATUS status = read_file_at(file, 0, header, header_size);
   if (status != EFI_SUCCESS) {
     return status;
   }
+  if (header_size < 4 || (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) != LZ4_FRAME_MAGIC) {
+    return EFI_SUCCESS; // Raw ELF
+  }
+
+  if (lz4_parse_frame_header(header, header_size, &image->frame) != 0 || !image->frame.independent) {
+    return EFI_UNSUPPORTED;
+  }
+
+  image->compressed = 1;
+  image->size = image->frame.content_size ? image->frame.content_size : ~0ULL;
 
-  // Try to load from the same device as the bootloader
-  return load_file_from_device(loaded_image->DeviceHandle, kernel_name, kernel_buffer, kernel_size);
+  status = gBS->AllocatePool(EfiLoaderData, image->frame.block_max_size, (void**)&image->input);
+  if (status == EFI_SUCCESS) {
+    status = gBS->AllocatePool(EfiLoaderData, image->frame.block_max_size, (void**)&image->block);
+  }
+  if (status != EFI_SUCCESS) {
+    image_close(image);
+    return status;
+  }
+
+  image_rewind(image);
+  return EFI_SUCCESS;
+}
+
+// Decode the next block into dst, which must hold block_max_size bytes
+static EFI_STATUS image_next_block(xo_image_t *image, uint8_t *dst, uint32_t *length) {
+  uint8_t block_header[4];
+  EFI_STATUS status = read_file_at(image->file, image->input_position, block_header, sizeof(block_header));
+  if (status != EFI_SUCCESS) {
+    return status;
+  }
+  image->input_position += sizeof(block_header);
+
+  uint32_t block_size = block_header[0] | block_header[1] << 8 | block_header[2] << 16 | (uint32_t)block_header[3] << 24;
+  if (block_size == 0) {
+    image->finished = 1;
+    *length = 0;
+    return EFI_SUCCESS;
+  }
+
+  uint32_t data_size = block_size & ~LZ4_BLOCK_UNCOMPRESSED;
+  if (data_size > image->frame.block_max_size) {
+    return EFI_LOAD_ERROR;
+  }
+
+  if (block_size & LZ4_BLOCK_UNCOMPRESSED) {
+    status = read_file_at(image->file, image->input_position, dst, data_size);
+    *length = data_size;
+  } else {
+    status = read_file_at(image->file, image->input_position, image->input, data_size);
+    if (status == EFI_SUCCESS) {
+      int64_t decoded = lz4_decompress_block(image->input, data_size, dst, image->frame.block_max_size);
+      if (decoded < 0) {
+        return EFI_LOAD_ERROR;
+      }
+      *length = (uint32_t)decoded;
+    }
+  }
+
+  image->input_position += data_size + (image->frame.block_checksum ? 4 : 0);
+  return status;
+}
+
+// Read exactly size bytes at offset of the uncompressed image
+static EFI_STATUS image_read_at(xo_image_t *image, uint64_t offset, void *buffer, UINTN size) {
+  if (!image->compressed) {
+    return read_file_at(image->file, offset, buffer, size);
+  }
+
+  if (offset < image->block_start) {
+    image_rewind(image);
+  }
+
+  uint8_t *dst = (uint8_t*)buffer;
+  while (size) {
+    uint64_t block_end = image->block_start + image->block_length;
+    if (offset >= image->block_start && offset < block_end) {
+      UINTN chunk = block_end - offset < size ? (UINTN)(block_end - offset) : size;
+      memcpy(dst, image->block + (offset - image->block_start), chunk);
+      dst += chunk;
+      offset += chunk;
+      size -= chunk;
+      continue;
+    }
+
+    if (image->finished) {
+      return EFI_LOAD_ERROR; // Past the end of the image
+    }
+
+    uint32_t length;
+    EFI_STATUS status;
+    if (offset == image->output_position && size >= image->frame.block_max_size) {
+      status = image_next_block(image, dst, &length);
+      dst += length;
+      offset += length;
+      size -= length;
+      image->output_position += length;
+      image->block_start = image->output_position;
+      image->block_length = 0;
+    } else {
+      status = image_next_block(image, image->block, &length);
+      image->block_start = image->output_position;
+      image->block_length = length;
+      image->output_position += length;
+    }
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+// Parallel work on the application processors. The APs are started once,
+// through EFI_MP_SERVICES_PROTOCOL in non-blocking mode, and run a worker
+// loop until stop_ap_pool. Batches of jobs are handed out through a shared
+// cursor: the BSP publishes a batch, claims jobs itself alongside the APs
+// and waits for the last one to finish. Starting the APs once matters: the
+// firmware only notices that non-blocking work has finished from a timer
+// (100 ms in EDK II), and refuses new work until then.
+//
+// Jobs are memory-bound and independent: zeroing, copying, decompressing
+// LZ4 blocks into place and checksumming. File I/O stays on the BSP.
+
+#define WORK_CHUNK (1ULL << 20) // Zeroing and hashing are split this finely
+
+typedef enum {
+  JOB_ZERO,
+  JOB_COPY,
+  JOB_LZ4,   // Decode src into dst, which must come out exactly size bytes
+  JOB_CRC32C
+} xo_job_type_t;
+
+typedef struct {
+  uint32_t type;
+  uint32_t crc;          // JOB_CRC32C result
+  const uint8_t *src;
+  uint8_t *dst;
+  uint64_t size;         // Bytes written or hashed
+  uint64_t source_size;  // JOB_LZ4 compressed size
+} xo_job_t;
+
+static struct {
+  int active;
+  uint32_t workers;          // APs asked to run the worker loop
+  xo_job_t *jobs;
+  volatile uint32_t count;
+  volatile uint64_t cursor;  // Batch number << 32 | next unclaimed job
+  volatile uint32_t done;
+  volatile uint32_t failed;
+  volatile uint32_t stop;
+  volatile uint32_t joined;
+  volatile uint32_t left;
+} ap_pool;
+
+static inline void cpu_pause(void) {
+  __asm__ volatile ("pause" : : : "memory");
+}
+
+static void run_job(xo_job_t *job) {
+  switch (job->type) {
+  case JOB_ZERO:
+    memset(job->dst, 0, job->size);
+    break;
+  case JOB_COPY:
+    memcpy(job->dst, job->src, job->size);
+    break;
+  case JOB_LZ4:
+    if (lz4_decompress_block(job->src, job->source_size, job->dst, job->size) != (int64_t)job->size) {
+      __atomic_store_n(&ap_pool.failed, 1, __ATOMIC_RELAXED);
+    }
+    break;
+  case JOB_CRC32C:
+    job->crc = crc32c(0, job->src, job->size);
+    break;
+  }
+}
+
+// Run jobs of the current batch until none are left unclaimed
+static void claim_jobs(void) {
+  for (;;) {
+    uint64_t cursor = __atomic_load_n(&ap_pool.cursor, __ATOMIC_ACQUIRE);
+    uint32_t index = (uint32_t)cursor;
+    if (index >= ap_pool.count) {
+      return;
+    }
+    // The batch number in the cursor stops a stale claim from succeeding
+    // once the next batch is out
+    if (!__atomic_compare_exchange_n(&ap_pool.cursor, &cursor, cursor + 1, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    run_job(&ap_pool.jobs[index]);
+    __atomic_fetch_add(&ap_pool.done, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void ap_worker(void *argument) {
+  __atomic_fetch_add(&ap_pool.joined, 1, __ATOMIC_ACQ_REL);
+  while (!__atomic_load_n(&ap_pool.stop, __ATOMIC_ACQUIRE)) {
+    claim_jobs();
+    cpu_pause();
+  }
+  __atomic_fetch_add(&ap_pool.left, 1, __ATOMIC_RELEASE);
+}
+
+// Start the worker loop on every enabled AP. Returns the number of
+// processors that will share batches, the BSP included.
+static uint32_t start_ap_pool(void) {
+  EFI_MP_SERVICES_PROTOCOL *mp = NULL;
+  UINTN processors = 0;
+  UINTN enabled = 0;
+  void *event = NULL;
+
+  if (gBS->LocateProtocol(gEfiMpServiceProtocolGuid, NULL, (void**)&mp) != EFI_SUCCESS ||
+      mp->GetNumberOfProcessors(mp, &processors, &enabled) != EFI_SUCCESS || enabled < 2) {
+    return 1;
+  }
+
+  // Non-blocking mode needs an event to signal; it is never waited on, nor
+  // closed, since the firmware may signal it after we are done
+  if (gBS->CreateEvent(0, 0, NULL, NULL, &event) != EFI_SUCCESS ||
+      mp->StartupAllAPs(mp, ap_worker, 0, event, 0, NULL, NULL) != EFI_SUCCESS) {
+    return 1;
+  }
+
+  ap_pool.workers = (uint32_t)(enabled - 1);
+  ap_pool.active = 1;
+  return (uint32_t)enabled;
+}
+
+// Send the APs back to the firmware. Must happen before ExitBootServices.
+static void stop_ap_pool(void) {
+  if (!ap_pool.active) {
+    return;
+  }
+  __atomic_store_n(&ap_pool.stop, 1, __ATOMIC_RELEASE);
+
+  // An AP that has not even started by now will see stop and return
+  // straight away; give up on it after about 100 ms
+  for (uint32_t i = 0; i < 10000; i++) {
+    uint32_t joined = __atomic_load_n(&ap_pool.joined, __ATOMIC_ACQUIRE);
+    if (joined == ap_pool.workers && __atomic_load_n(&ap_pool.left, __ATOMIC_ACQUIRE) == joined) {
+      break;
+    }
+    gBS->Stall(10);
+  }
+  ap_pool.active = 0;
+}
+
+// Run a batch on every processor in the pool (or just the BSP). Returns
+// EFI_SUCCESS if every job did.
+static EFI_STATUS run_jobs(xo_job_t *jobs, uint32_t count) {
+  static uint32_t batch = 0;
+
+  // Close the cursor while the batch is set up, so that a worker holding
+  // the previous value cannot claim against the new count
+  batch++;
+  __atomic_store_n(&ap_pool.cursor, (uint64_t)batch << 32 | 0xFFFFFFFF, __ATOMIC_SEQ_CST);
+  ap_pool.jobs = jobs;
+  ap_pool.count = count;
+  ap_pool.done = 0;
+  ap_pool.failed = 0;
+  __atomic_store_n(&ap_pool.cursor, (uint64_t)batch << 32, __ATOMIC_RELEASE);
+
+  claim_jobs();
+  while (__atomic_load_n(&ap_pool.done, __ATOMIC_ACQUIRE) != count) {
+    cpu_pause();
+  }
+  return ap_pool.failed ? EFI_LOAD_ERROR : EFI_SUCCESS;
+}
+
+// CRC32C of a buffer, hashed in chunks across the pool
+static uint32_t parallel_crc32c(const uint8_t *data, uint64_t size) {
+  xo_job_t *jobs = NULL;
+  uint32_t count = (uint32_t)((size + WORK_CHUNK - 1) / WORK_CHUNK);
+  if (!ap_pool.active || count < 2 ||
+      gBS->AllocatePool(EfiLoaderData, count * sizeof(xo_job_t), (void**)&jobs) != EFI_SUCCESS) {
+    return crc32c(0, data, (size_t)size);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t offset = (uint64_t)i * WORK_CHUNK;
+    jobs[i].type = JOB_CRC32C;
+    jobs[i].src = data + offset;
+    jobs[i].size = size - offset < WORK_CHUNK ? size - offset : WORK_CHUNK;
+  }
+  run_jobs(jobs, count);
+
+  uint32_t crc = jobs[0].crc;
+  for (uint32_t i = 1; i < count; i++) {
+    crc = crc32c_combine(crc, jobs[i].crc, (size_t)jobs[i].size);
+  }
+  gBS->FreePool(jobs);
+  return crc;
 }
 
 // ELF loading functions
@@ -486,27 +918,242 @@ static int validate_elf_header(const elf64_ehdr *header) {
   return 1;
 }
 
-static EFI_STATUS load_elf_segments(const void *elf_data, UINTN elf_size, uint64_t *entry_point) {
-  const elf64_ehdr *elf_header = (const elf64_ehdr*)elf_data;
+// Most program headers we accept in a kernel image
+#define ELF_MAX_PROGRAM_HEADERS 64
+
+// A PT_LOAD segment with its pages allocated: file bytes [offset, offset +
+// file_size) of the image go to dst, and the rest of memory_size is zeroed
+typedef struct {
+  uint64_t offset;
+  uint64_t file_size;
+  uint64_t memory_size;
+  uint8_t *dst;
+} xo_segment_t;
+
+// Fill the segments one after the other, streaming the image forward
+static EFI_STATUS fill_segments(xo_image_t *image, const xo_segment_t *segments, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    const xo_segment_t *segment = &segments[i];
+    EFI_STATUS status = image_read_at(image, segment->offset, segment->dst, (UINTN)segment->file_size);
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
+    memset(segment->dst + segment->file_size, 0, segment->memory_size - segment->file_size);
+  }
+  return EFI_SUCCESS;
+}
+
+// Copy the part of image bytes [position, position + size) that belongs to
+// each segment into it
+static void scatter_to_segments(const xo_segment_t *segments, uint32_t count,
+                                uint64_t position, const uint8_t *data, uint64_t size) {
+  for (uint32_t i = 0; i < count; i++) {
+    const xo_segment_t *segment = &segments[i];
+    uint64_t start = position > segment->offset ? position : segment->offset;
+    uint64_t end = position + size < segment->offset + segment->file_size ?
+                   position + size : segment->offset + segment->file_size;
+    if (start < end) {
+      memcpy(segment->dst + (start - segment->offset), data + (start - position), (UINTN)(end - start));
+    }
+  }
+}
+
+// Segment that holds all of image bytes [position, position + size), or
+// NULL; sets *touched if any segment holds part of them
+static const xo_segment_t *segment_holding(const xo_segment_t *segments, uint32_t count,
+                                           uint64_t position, uint64_t size, int *touched) {
+  const xo_segment_t *holder = NULL;
+  *touched = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const xo_segment_t *segment = &segments[i];
+    uint64_t end = segment->offset + segment->file_size;
+    if (position < end && position + size > segment->offset) {
+      if (*touched) {
+        return NULL; // Needed by more than one segment
+      }
+      *touched = 1;
+      if (position >= segment->offset && position + size <= end) {
+        holder = segment;
+      }
+    }
+  }
+  return holder;
+}
+
+// Fill the segments with the AP pool. A raw image is read in place on the
+// BSP (file I/O cannot move) and only the zeroing is shared out. A
+// compressed one is read whole and each block becomes a job that decodes
+// straight into its segment; the few blocks split across segments go
+// through the bounce buffer on the BSP, and blocks no segment needs (ELF
+// headers, symbols) are never decoded. Needs the frame's content size to
+// know where every block lands. On failure the segments may be partly
+// written; fill_segments can start over.
+static EFI_STATUS fill_segments_parallel(xo_image_t *image, const xo_segment_t *segments, uint32_t count) {
+  const xo_lz4_frame_t *frame = &image->frame;
+  uint8_t *data = NULL;
+  xo_job_t *jobs = NULL;
+  uint32_t blocks = 0;
   EFI_STATUS status;
 
+  if (image->compressed) {
+    if (!frame->content_size) {
+      return EFI_UNSUPPORTED;
+    }
+    status = gBS->AllocatePool(EfiLoaderData, (UINTN)image->file->size, (void**)&data);
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
+    status = read_file_at(image->file, 0, data, (UINTN)image->file->size);
+    if (status != EFI_SUCCESS) {
+      gBS->FreePool(data);
+      return status;
+    }
+    // Upper bound: every block has at least its 4-byte header
+    blocks = (uint32_t)((image->file->size - frame->header_size) / 4);
+  } else {
+    for (uint32_t i = 0; i < count; i++) {
+      status = read_file_at(image->file, segments[i].offset, segments[i].dst, (UINTN)segments[i].file_size);
+      if (status != EFI_SUCCESS) {
+        return status;
+      }
+    }
+  }
+
+  uint64_t capacity = blocks;
+  for (uint32_t i = 0; i < count; i++) {
+    capacity += (segments[i].memory_size - segments[i].file_size + WORK_CHUNK - 1) / WORK_CHUNK;
+  }
+  if (capacity > 0xFFFFFFFF) {
+    status = EFI_UNSUPPORTED;
+  } else {
+    status = gBS->AllocatePool(EfiLoaderData, (UINTN)capacity * sizeof(xo_job_t), (void**)&jobs);
+  }
+
+  uint32_t job_count = 0;
+  uint64_t input = frame->header_size;
+  uint64_t position = 0;
+  while (status == EFI_SUCCESS && data) {
+    if (input + 4 > image->file->size) {
+      status = EFI_LOAD_ERROR;
+      break;
+    }
+    uint32_t block_size = data[input] | data[input + 1] << 8 | data[input + 2] << 16 |
+                          (uint32_t)data[input + 3] << 24;
+    input += 4;
+    if (block_size == 0) {
+      if (position != frame->content_size) {
+        status = EFI_LOAD_ERROR;
+      }
+      break;
+    }
+
+    // Every block but the last decodes to exactly block_max_size bytes
+    uint32_t source_size = block_size & ~LZ4_BLOCK_UNCOMPRESSED;
+    uint64_t remaining = frame->content_size - position;
+    uint64_t size = remaining < frame->block_max_size ? remaining : frame->block_max_size;
+    if (position >= frame->content_size || source_size > frame->block_max_size ||
+        source_size > image->file->size - input) {
+      status = EFI_LOAD_ERROR;
+      break;
+    }
+
+    int touched;
+    const xo_segment_t *holder = segment_holding(segments, count, position, size, &touched);
+    const uint8_t *source = data + input;
+    int raw = (block_size & LZ4_BLOCK_UNCOMPRESSED) != 0;
+    if (raw && source_size != size) {
+      status = EFI_LOAD_ERROR;
+    } else if (holder) {
+      xo_job_t *job = &jobs[job_count++];
+      job->type = raw ? JOB_COPY : JOB_LZ4;
+      job->src = source;
+      job->dst = holder->dst + (position - holder->offset);
+      job->size = size;
+      job->source_size = source_size;
+    } else if (touched) {
+      const uint8_t *block = source;
+      if (!raw && lz4_decompress_block(source, source_size, image->block, frame->block_max_size) != (int64_t)size) {
+        status = EFI_LOAD_ERROR;
+      }
+      if (!raw) {
+        block = image->block;
+      }
+      if (status == EFI_SUCCESS) {
+        scatter_to_segments(segments, count, position, block, size);
+      }
+    }
+
+    input += source_size + (frame->block_checksum ? 4 : 0);
+    position += size;
+  }
+
+  if (status == EFI_SUCCESS) {
+    for (uint32_t i = 0; i < count; i++) {
+      const xo_segment_t *segment = &segments[i];
+      for (uint64_t offset = segment->file_size; offset < segment->memory_size; offset += WORK_CHUNK) {
+        xo_job_t *job = &jobs[job_count++];
+        job->type = JOB_ZERO;
+        job->dst = segment->dst + offset;
+        job->size = segment->memory_size - offset < WORK_CHUNK ? segment->memory_size - offset : WORK_CHUNK;
+      }
+    }
+    status = run_jobs(jobs, job_count);
+  }
+
+  if (jobs) {
+    gBS->FreePool(jobs);
+  }
+  if (data) {
+    gBS->FreePool(data);
+    image_rewind(image); // The bounce buffer no longer matches its offsets
+  }
+  return status;
+}
+
+// Load every PT_LOAD segment of the kernel image. Only the ELF and program
+// headers are read into loader memory; segment bytes go from the image
+// directly into their destination pages, in file order.
+static EFI_STATUS load_elf_segments(xo_image_t *image, uint64_t *entry_point) {
+  elf64_ehdr elf_header;
+  elf64_phdr program_headers[ELF_MAX_PROGRAM_HEADERS];
+  uint32_t order[ELF_MAX_PROGRAM_HEADERS];
+  xo_segment_t segments[ELF_MAX_PROGRAM_HEADERS];
+  uint32_t segment_count = 0;
+  EFI_STATUS status;
+
+  status = image_read_at(image, 0, &elf_header, sizeof(elf_header));
+  if (status != EFI_SUCCESS) {
+    return status;
+  }
+
   // Validate ELF header
-  if (!validate_elf_header(elf_header)) {
+  if (!validate_elf_header(&elf_header)) {
     return EFI_INVALID_PARAMETER;
   }
 
-  *entry_point = elf_header->e_entry;
+  if (elf_header.e_phentsize != sizeof(elf64_phdr) || elf_header.e_phnum > ELF_MAX_PROGRAM_HEADERS) {
+    return EFI_UNSUPPORTED;
+  }
 
-  // Check bounds
-  if (elf_header->e_phoff + (elf_header->e_phnum * elf_header->e_phentsize) > elf_size) {
-    return EFI_INVALID_PARAMETER;
+  status = image_read_at(image, elf_header.e_phoff, program_headers,
+                         (UINTN)elf_header.e_phnum * sizeof(elf64_phdr));
+  if (status != EFI_SUCCESS) {
+    return status;
   }
 
-  // Process program headers
-  const elf64_phdr *program_headers = (const elf64_phdr*)((const uint8_t*)elf_data + elf_header->e_phoff);
+  *entry_point = elf_header.e_entry;
+
+  // Visit segments by file offset so a compressed image streams forward
+  for (uint32_t i = 0; i < elf_header.e_phnum; i++) {
+    uint32_t j = i;
+    for (; j > 0 && program_headers[order[j - 1]].p_offset > program_headers[i].p_offset; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
 
-  for (int i = 0; i < elf_header->e_phnum; i++) {
-    const elf64_phdr *phdr = &program_headers[i];
+  for (uint32_t i = 0; i < elf_header.e_phnum; i++) {
+    const elf64_phdr *phdr = &program_headers[order[i]];
 
     // Only load LOAD segments
     if (phdr->p_type != PT_LOAD) {
@@ -514,39 +1161,33 @@ static EFI_STATUS load_elf_segments(const void *elf_data, UINTN elf_size, uint64
     }
 
     // Validate segment bounds
-    if (phdr->p_offset + phdr->p_filesz > elf_size) {
+    if (phdr->p_offset > image->size || phdr->p_filesz > image->size - phdr->p_offset ||
+        phdr->p_filesz > phdr->p_memsz) {
       return EFI_INVALID_PARAMETER;
     }
 
-    // Allocate pages for the segment
-    uint64_t pages = (phdr->p_memsz + 4095) / 4096; // Round up to page boundary
-    uint64_t segment_address = phdr->p_paddr;
-
-    status = gBS->AllocatePages(1, EfiLoaderData, pages, &segment_address); // 1 = AllocateAddress
+    // The kernel is linked at fixed physical addresses, so the segment has
+    // to land exactly there
+    uint64_t page_base = phdr->p_paddr & ~0xFFFULL;
+    uint64_t pages = (phdr->p_paddr + phdr->p_memsz - page_base + 4095) / 4096;
+    status = gBS->AllocatePages(2, EfiLoaderData, pages, &page_base); // 2 = AllocateAddress
     if (status != EFI_SUCCESS) {
-      // Try allocating at any address and hope it works
-      status = gBS->AllocatePages(0, EfiLoaderData, pages, &segment_address); // 0 = AllocateAnyPages
-      if (status != EFI_SUCCESS) {
-        return status;
-      }
-    }
-
-    // Copy segment data from file
-    const uint8_t *src = (const uint8_t*)elf_data + phdr->p_offset;
-    uint8_t *dst = (uint8_t*)(void*)(uintptr_t)segment_address;
-
-    // Copy file data
-    for (UINTN j = 0; j < phdr->p_filesz; j++) {
-      dst[j] = src[j];
+      return status;
     }
 
-    // Zero remaining memory (BSS)
-    for (UINTN j = phdr->p_filesz; j < phdr->p_memsz; j++) {
-      dst[j] = 0;
-    }
+    xo_segment_t *segment = &segments[segment_count++];
+    segment->offset = phdr->p_offset;
+    segment->file_size = phdr->p_filesz;
+    segment->memory_size = phdr->p_memsz;
+    segment->dst = (uint8_t*)(void*)(uintptr_t)phdr->p_paddr;
   }
 
-  return EFI_SUCCESS;
+  // Read file data in place, then zero the remaining memory (BSS); with
+  // other processors to help, share the work out
+  if (ap_pool.active && fill_segments_parallel(image, segments, segment_count) == EFI_SUCCESS) {
+    return EFI_SUCCESS;
+  }
+  return fill_segments(image, segments, segment_count);
 }
 
 // Utility functions
@@ -605,6 +1246,16 @@ static void print_hex(uint64_t value) {
   print_ascii(buffer);
 }
 
+static inline uint64_t read_tsc(void) {
+  uint32_t low, high;
+  __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+static void mark_phase(xo_boot_info_t *boot_info, xo_boot_phase_t phase) {
+  boot_info->timing.phase_tsc[phase] = read_tsc();
+}
+
 static uint64_t get_timestamp(void) {
   EFI_TIME time;
   EFI_STATUS status;
@@ -666,18 +1317,6 @@ static uint32_t find_bit_position(uint32_t mask) {
   return position;
 }
 
-static uint32_t calculate_checksum(const xo_boot_info_t *info) {
-  const uint8_t *data = (const uint8_t*)info;
-  uint32_t checksum = 0;
-  UINTN size = sizeof(xo_boot_info_t) - sizeof(uint32_t); // Exclude checksum field
-
-  for (UINTN i = 0; i < size; i++) {
-    checksum += data[i];
-  }
-
-  return ~checksum + 1; // Two's complement
-}
-
 static xo_memory_type_t efi_to_xo_memory_type(uint32_t efi_type) {
   switch (efi_type) {
     case EfiConventionalMemory:
@@ -708,59 +1347,397 @@ static xo_memory_type_t efi_to_xo_memory_type(uint32_t efi_type) {
 }
 
 // Memory map functions
-static EFI_STATUS get_memory_map(xo_boot_info_t *boot_info) {
-  EFI_STATUS status;
-  UINTN map_size = 0;
-  EFI_MEMORY_DESCRIPTOR *memory_map = NULL;
+//
+// The kernel gets the map from the last GetMemoryMap before ExitBootServices,
+// so every loader allocation is in it. Firmware descriptors are converted,
+// sorted by address and adjacent ranges of the same type and attributes are
+// merged into one entry.
+//
+// The converted map is written straight into the boot block as its first
+// tag; the other tags follow it once its length is known. Both the block and
+// the descriptor buffer are allocated up front: once the final map has been
+// read, no boot service may run until ExitBootServices.
+
+#define MEMORY_MAP_SLACK 16 // Descriptors our own allocations may add
+#define BOOT_TAGS_RESERVE 4096 // Room after the memory map for every other tag
+
+typedef struct {
+  EFI_MEMORY_DESCRIPTOR *descriptors; // Raw firmware map
+  UINTN descriptors_size;             // Bytes allocated for descriptors
+  uint8_t *block;                     // Boot block handed to the kernel
+  UINTN block_pages;
+  xo_memory_entry_t *entries;         // Memory map tag payload inside block
+  UINTN capacity;                     // Entries that fit in entries
   UINTN map_key;
-  UINTN descriptor_size;
-  uint32_t descriptor_version;
+} xo_memory_map_t;
 
-  // Get memory map size
-  status = gBS->GetMemoryMap(&map_size, memory_map, &map_key, &descriptor_size, &descriptor_version);
-  if (status != EFI_BUFFER_TOO_SMALL) {
-    return status;
+static void free_memory_map(xo_memory_map_t *map) {
+  if (map->descriptors) {
+    gBS->FreePool(map->descriptors);
+    map->descriptors = NULL;
   }
+  if (map->block) {
+    gBS->FreePages((uint64_t)(uintptr_t)map->block, map->block_pages);
+    map->block = NULL;
+    map->entries = NULL;
+  }
+  map->descriptors_size = 0;
+  map->capacity = 0;
+}
+
+static EFI_STATUS grow_memory_map(xo_memory_map_t *map, UINTN size, UINTN descriptor_size) {
+  free_memory_map(map);
 
-  // Allocate buffer with some extra space
-  map_size += 2 * descriptor_size;
-  status = gBS->AllocatePool(EfiLoaderData, map_size, (void**)&memory_map);
+  EFI_STATUS status = gBS->AllocatePool(EfiLoaderData, size, (void**)&map->descriptors);
   if (status != EFI_SUCCESS) {
+    map->descriptors = NULL;
     return status;
   }
-
-  // Get actual memory map
-  status = gBS->GetMemoryMap(&map_size, memory_map, &map_key, &descriptor_size, &descriptor_version);
+  map->descriptors_size = size;
+
+  // Merging never adds entries, so one per descriptor is enough. The kernel
+  // reads the block before it has its own page tables, when only the first
+  // 4 GiB are mapped.
+  UINTN count = size / descriptor_size;
+  UINTN map_offset = sizeof(xo_boot_header_t) + sizeof(xo_boot_tag_t);
+  uint64_t address = 0xFFFFFFFFULL;
+  map->block_pages = (map_offset + count * sizeof(xo_memory_entry_t) + BOOT_TAGS_RESERVE + 4095) / 4096;
+  status = gBS->AllocatePages(1, EfiLoaderData, map->block_pages, &address); // 1 = AllocateMaxAddress
   if (status != EFI_SUCCESS) {
-    gBS->FreePool(memory_map);
+    free_memory_map(map);
     return status;
   }
+  map->block = (uint8_t*)(uintptr_t)address;
+  map->entries = (xo_memory_entry_t*)(map->block + map_offset);
+  map->capacity = count;
+  return EFI_SUCCESS;
+}
 
-  // Convert to XO format
-  UINTN num_descriptors = map_size / descriptor_size;
-  boot_info->memory_map_entries = 0;
-  boot_info->total_memory = 0;
-  boot_info->available_memory = 0;
+// Convert, sort and merge; no boot services are called from here
+static void convert_memory_map(xo_memory_map_t *map, UINTN map_size, UINTN descriptor_size,
+                               xo_boot_info_t *boot_info) {
+  UINTN count = 0;
 
-  for (UINTN i = 0; i < num_descriptors && boot_info->memory_map_entries < XO_MAX_MEMORY_ENTRIES; i++) {
-    EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)memory_map + i * descriptor_size);
+  for (UINTN i = 0; i < map_size / descriptor_size; i++) {
+    EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR*)((uint8_t*)map->descriptors + i * descriptor_size);
+    if (desc->NumberOfPages == 0) {
+      continue;
+    }
 
-    xo_memory_entry_t *entry = &boot_info->memory_map[boot_info->memory_map_entries];
-    entry->base_address = desc->PhysicalStart;
-    entry->length = desc->NumberOfPages * 4096; // EFI pages are 4KB
-    entry->type = efi_to_xo_memory_type(desc->Type);
-    entry->attributes = (uint32_t)desc->Attribute;
+    xo_memory_entry_t entry;
+    entry.base_address = desc->PhysicalStart;
+    entry.length = desc->NumberOfPages * 4096; // EFI pages are 4KB
+    entry.type = efi_to_xo_memory_type(desc->Type);
+    entry.attributes = (uint32_t)desc->Attribute;
+
+    // Insertion sort: firmware maps are almost always in order already, so
+    // this is a single comparison per descriptor in practice
+    UINTN slot = count;
+    while (slot > 0 && map->entries[slot - 1].base_address > entry.base_address) {
+      map->entries[slot] = map->entries[slot - 1];
+      slot--;
+    }
+    map->entries[slot] = entry;
+    count++;
+  }
+
+  UINTN merged = 0;
+  boot_info->total_memory = 0;
+  boot_info->available_memory = 0;
+  for (UINTN i = 0; i < count; i++) {
+    xo_memory_entry_t *entry = &map->entries[i];
 
     boot_info->total_memory += entry->length;
     if (entry->type == XO_MEMORY_AVAILABLE) {
       boot_info->available_memory += entry->length;
     }
 
-    boot_info->memory_map_entries++;
+    if (merged > 0) {
+      xo_memory_entry_t *last = &map->entries[merged - 1];
+      if (last->base_address + last->length == entry->base_address &&
+          last->type == entry->type && last->attributes == entry->attributes) {
+        last->length += entry->length;
+        continue;
+      }
+    }
+    map->entries[merged++] = *entry;
   }
 
-  gBS->FreePool(memory_map);
-  return EFI_SUCCESS;
+  boot_info->memory_map_entries = (uint32_t)merged;
+}
+
+// Read the current memory map, growing the buffers until it fits. On success
+// map->map_key is valid for ExitBootServices as long as no boot service runs
+// in between.
+static EFI_STATUS get_memory_map(xo_memory_map_t *map, xo_boot_info_t *boot_info) {
+  EFI_STATUS status;
+  UINTN descriptor_size = sizeof(EFI_MEMORY_DESCRIPTOR);
+  uint32_t descriptor_version;
+
+  while (1) {
+    UINTN map_size = map->descriptors_size;
+    status = gBS->GetMemoryMap(&map_size, map->descriptors, &map->map_key, &descriptor_size, &descriptor_version);
+    if (status == EFI_SUCCESS) {
+      convert_memory_map(map, map_size, descriptor_size, boot_info);
+      return EFI_SUCCESS;
+    }
+    if (status != EFI_BUFFER_TOO_SMALL) {
+      return status;
+    }
+
+    // Allocating the buffers adds descriptors of its own
+    status = grow_memory_map(map, map_size + MEMORY_MAP_SLACK * descriptor_size, descriptor_size);
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
+  }
+}
+
+static uint8_t *append_tag(uint8_t *cursor, uint32_t type, const void *payload, UINTN size) {
+  xo_boot_tag_t *tag = (xo_boot_tag_t*)cursor;
+  tag->type = type;
+  tag->size = (uint32_t)(sizeof(xo_boot_tag_t) + size);
+  if (size) {
+    memcpy(tag + 1, payload, size);
+  }
+  return cursor + ((tag->size + XO_BOOT_TAG_ALIGN - 1) & ~(UINTN)(XO_BOOT_TAG_ALIGN - 1));
+}
+
+// Lay out the boot block behind the memory map already converted into it.
+// Only touches memory, so it is safe after ExitBootServices.
+static xo_boot_header_t *write_boot_block(xo_memory_map_t *map, const xo_boot_info_t *boot_info) {
+  xo_boot_header_t *header = (xo_boot_header_t*)map->block;
+  xo_boot_tag_t *map_tag = (xo_boot_tag_t*)(header + 1);
+  map_tag->type = XO_TAG_MEMORY_MAP;
+  map_tag->size = (uint32_t)(sizeof(xo_boot_tag_t) + boot_info->memory_map_entries * sizeof(xo_memory_entry_t));
+  uint8_t *cursor = (uint8_t*)(map->entries + boot_info->memory_map_entries);
+
+  UINTN cmdline_length = 0;
+  while (boot_info->cmdline[cmdline_length]) {
+    cmdline_length++;
+  }
+  if (cmdline_length) {
+    cursor = append_tag(cursor, XO_TAG_CMDLINE, boot_info->cmdline, cmdline_length + 1);
+  }
+  if (boot_info->graphics.framebuffer_address) {
+    cursor = append_tag(cursor, XO_TAG_FRAMEBUFFER, &boot_info->graphics, sizeof(boot_info->graphics));
+  }
+  if (boot_info->acpi.rsdp_address) {
+    cursor = append_tag(cursor, XO_TAG_ACPI, &boot_info->acpi, sizeof(boot_info->acpi));
+  }
+  if (boot_info->initrd.size) {
+    cursor = append_tag(cursor, XO_TAG_INITRD, &boot_info->initrd, sizeof(boot_info->initrd));
+  }
+  cursor = append_tag(cursor, XO_TAG_KERNEL, &boot_info->kernel, sizeof(boot_info->kernel));
+  cursor = append_tag(cursor, XO_TAG_EFI, &boot_info->efi, sizeof(boot_info->efi));
+  cursor = append_tag(cursor, XO_TAG_BOOT_TIMING, &boot_info->timing, sizeof(boot_info->timing));
+  cursor = append_tag(cursor, XO_TAG_END, NULL, 0);
+
+  header->magic = XO_BOOT_MAGIC;
+  header->version = XO_BOOT_VERSION;
+  header->size = (uint32_t)(cursor - map->block);
+  header->reserved = 0;
+  header->checksum = crc32c(0, header + 1, header->size - sizeof(xo_boot_header_t));
+  return header;
+}
+
+// Boot entries that firmware creates on its own (removable media, for one)
+// pass binary data such as a GUID as load options; only printable UTF-16
+// text is taken as a command line
+static int load_options_are_text(const CHAR16 *options, UINTN size) {
+  if (size == 0 || size % sizeof(CHAR16) != 0) {
+    return 0;
+  }
+  UINTN count = size / sizeof(CHAR16);
+  for (UINTN i = 0; i < count && options[i]; i++) {
+    if (options[i] < 0x20 || options[i] > 0x7E) {
+      return 0;
+    }
+  }
+  return options[0] != 0;
+}
+
+// Kernel command line: the image's load options (as set by a boot entry or
+// the shell) when they are text, else cmdline.txt next to the kernel
+static void read_cmdline(EFI_HANDLE image_handle, xo_boot_info_t *boot_info) {
+  char *cmdline = boot_info->cmdline;
+  UINTN length = 0;
+
+  EFI_LOADED_IMAGE_PROTOCOL *loaded_image = NULL;
+  if (gBS->HandleProtocol(image_handle, gEfiLoadedImageProtocolGuid, (void**)&loaded_image) == EFI_SUCCESS &&
+      loaded_image->LoadOptions &&
+      load_options_are_text((const CHAR16*)loaded_image->LoadOptions, loaded_image->LoadOptionsSize)) {
+    const CHAR16 *options = (const CHAR16*)loaded_image->LoadOptions;
+    UINTN count = loaded_image->LoadOptionsSize / sizeof(CHAR16);
+    for (UINTN i = 0; i < count && options[i] && length < XO_MAX_CMDLINE_LENGTH - 1; i++) {
+      cmdline[length++] = (char)options[i];
+    }
+  }
+
+  if (length == 0) {
+    xo_file_t file;
+    CHAR16 file_name[] = L"cmdline.txt";
+    if (open_boot_file(image_handle, file_name, &file) == EFI_SUCCESS) {
+      length = file.size < XO_MAX_CMDLINE_LENGTH - 1 ? (UINTN)file.size : XO_MAX_CMDLINE_LENGTH - 1;
+      if (read_file_at(&file, 0, cmdline, length) != EFI_SUCCESS) {
+        length = 0;
+      }
+      close_file(&file);
+    }
+  }
+
+  // One line of space separated options
+  for (UINTN i = 0; i < length; i++) {
+    if (cmdline[i] == '\r' || cmdline[i] == '\n' || cmdline[i] == '\t') {
+      cmdline[i] = ' ';
+    }
+  }
+  while (length && cmdline[length - 1] == ' ') {
+    length--;
+  }
+  cmdline[length] = 0;
+}
+
+// Rest of text after prefix, or NULL if it does not start with it
+static const char *skip_prefix(const char *text, const char *prefix) {
+  while (*prefix && *text == *prefix) {
+    text++;
+    prefix++;
+  }
+  return *prefix ? NULL : text;
+}
+
+// Value of the first name=value option (name includes the '='), or NULL
+static const char *cmdline_option(const char *cmdline, const char *name) {
+  for (const char *p = cmdline; *p; p++) {
+    if (p == cmdline || p[-1] == ' ') {
+      const char *value = skip_prefix(p, name);
+      if (value) {
+        return value;
+      }
+    }
+  }
+  return NULL;
+}
+
+static uint32_t parse_decimal(const char **p) {
+  uint32_t value = 0;
+  while (**p >= '0' && **p <= '9') {
+    value = value * 10 + (uint32_t)(**p - '0');
+    (*p)++;
+  }
+  return value;
+}
+
+// Preferred resolution from the first detailed timing of the active EDID
+static int native_resolution(uint32_t *width, uint32_t *height) {
+  EFI_EDID_ACTIVE_PROTOCOL *edid = NULL;
+  if (gBS->LocateProtocol(gEfiEdidActiveProtocolGuid, NULL, (void**)&edid) != EFI_SUCCESS ||
+      !edid || !edid->Edid || edid->SizeOfEdid < 128) {
+    return 0;
+  }
+
+  const uint8_t *timing = edid->Edid + 54;
+  if (timing[0] == 0 && timing[1] == 0) {
+    return 0; // A display descriptor, not a timing
+  }
+  *width = timing[2] | (uint32_t)(timing[4] >> 4) << 8;
+  *height = timing[5] | (uint32_t)(timing[7] >> 4) << 8;
+  return *width && *height;
+}
+
+static uint32_t mask_bits_used(const EFI_PIXEL_BITMASK *mask) {
+  uint32_t all = mask->RedMask | mask->GreenMask | mask->BlueMask | mask->ReservedMask;
+  uint32_t bits = 0;
+  while (all) {
+    bits++;
+    all >>= 1;
+  }
+  return bits;
+}
+
+// Bits per pixel of a mode with a linear framebuffer, 0 for PixelBltOnly
+static uint32_t mode_bpp(const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *info) {
+  switch (info->PixelFormat) {
+    case PixelRedGreenBlueReserved8BitPerColor:
+    case PixelBlueGreenRedReserved8BitPerColor:
+      return 32;
+    case PixelBitMask:
+      return (mask_bits_used(&info->PixelInformation) + 7) & ~7u;
+    default:
+      return 0;
+  }
+}
+
+// Mode selection. Only 32 bpp linear framebuffer modes count: the kernel's
+// framebuffer code stores 32-bit pixels and rejects anything else. In order
+// of preference:
+//   video=WxH     that exact resolution
+//   video=native  the panel's EDID resolution, else the largest mode
+//   (default)     the panel's resolution if it fits GRAPHICS_DEFAULT_MAX,
+//                 else the largest mode that does; full-screen work scales
+//                 with the pixel count and huge modes buy nothing at boot
+#define GRAPHICS_DEFAULT_MAX_WIDTH  1920
+#define GRAPHICS_DEFAULT_MAX_HEIGHT 1080
+
+typedef struct {
+  uint32_t want_width;  // Exact resolution requested, or 0
+  uint32_t want_height;
+  uint32_t max_width;   // Upper bound when nothing exact matches
+  uint32_t max_height;
+} xo_mode_policy_t;
+
+static uint64_t mode_score(const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *info, const xo_mode_policy_t *policy) {
+  uint32_t bpp = mode_bpp(info);
+  uint32_t width = info->HorizontalResolution;
+  uint32_t height = info->VerticalResolution;
+  if (bpp != 32) {
+    return 0;
+  }
+
+  if (width == policy->want_width && height == policy->want_height) {
+    return 1ULL << 63;
+  }
+  if (width <= policy->max_width && height <= policy->max_height) {
+    return (uint64_t)width * height | (1ULL << 62);
+  }
+  // Oversized: only if nothing fits, and then the smallest
+  return 0xFFFFFFFFULL - ((uint64_t)width * height >> 16);
+}
+
+static void set_graphics_info(xo_graphics_info_t *graphics, const EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *mode) {
+  const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *info = mode->Info;
+  uint32_t bpp = mode_bpp(info);
+
+  graphics->framebuffer_address = mode->FrameBufferBase;
+  graphics->framebuffer_width = info->HorizontalResolution;
+  graphics->framebuffer_height = info->VerticalResolution;
+  graphics->framebuffer_pitch = info->PixelsPerScanLine * (bpp / 8);
+  graphics->framebuffer_bpp = bpp;
+
+  EFI_PIXEL_BITMASK masks;
+  if (info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor) {
+    masks.RedMask = 0x000000FF;
+    masks.GreenMask = 0x0000FF00;
+    masks.BlueMask = 0x00FF0000;
+    masks.ReservedMask = 0xFF000000;
+  } else if (info->PixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
+    masks.RedMask = 0x00FF0000;
+    masks.GreenMask = 0x0000FF00;
+    masks.BlueMask = 0x000000FF;
+    masks.ReservedMask = 0xFF000000;
+  } else {
+    masks = info->PixelInformation;
+  }
+
+  graphics->red_mask_size = count_bits(masks.RedMask);
+  graphics->red_field_position = find_bit_position(masks.RedMask);
+  graphics->green_mask_size = count_bits(masks.GreenMask);
+  graphics->green_field_position = find_bit_position(masks.GreenMask);
+  graphics->blue_mask_size = count_bits(masks.BlueMask);
+  graphics->blue_field_position = find_bit_position(masks.BlueMask);
+  graphics->reserved_mask_size = count_bits(masks.ReservedMask);
+  graphics->reserved_field_position = find_bit_position(masks.ReservedMask);
 }
 
 // Graphics initialization
@@ -768,69 +1745,65 @@ static EFI_STATUS init_graphics(xo_boot_info_t *boot_info) {
   EFI_STATUS status;
   EFI_GRAPHICS_OUTPUT_PROTOCOL *gop = NULL;
 
+  boot_info->graphics.framebuffer_address = 0;
   status = gBS->LocateProtocol(gEfiGraphicsOutputProtocolGuid, NULL, (void**)&gop);
   if (status != EFI_SUCCESS || !gop) {
-    // No graphics output protocol found
-    boot_info->graphics.framebuffer_address = 0;
     return EFI_NOT_FOUND;
   }
-
-  // Get current graphics mode
-  EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *mode = gop->Mode;
-  if (!mode || !mode->Info) {
+  if (!gop->Mode || !gop->Mode->Info) {
     return EFI_DEVICE_ERROR;
   }
 
-  // Fill graphics info
-  boot_info->graphics.framebuffer_address = mode->FrameBufferBase;
-  boot_info->graphics.framebuffer_width = mode->Info->HorizontalResolution;
-  boot_info->graphics.framebuffer_height = mode->Info->VerticalResolution;
-  boot_info->graphics.framebuffer_pitch = mode->Info->PixelsPerScanLine * 4; // Assume 32bpp
-  boot_info->graphics.framebuffer_bpp = 32;
-
-  // Handle pixel format
-  switch (mode->Info->PixelFormat) {
-    case PixelRedGreenBlueReserved8BitPerColor:
-      boot_info->graphics.red_mask_size = 8;
-      boot_info->graphics.red_field_position = 0;
-      boot_info->graphics.green_mask_size = 8;
-      boot_info->graphics.green_field_position = 8;
-      boot_info->graphics.blue_mask_size = 8;
-      boot_info->graphics.blue_field_position = 16;
-      boot_info->graphics.reserved_mask_size = 8;
-      boot_info->graphics.reserved_field_position = 24;
-      break;
-
-    case PixelBlueGreenRedReserved8BitPerColor:
-      boot_info->graphics.blue_mask_size = 8;
-      boot_info->graphics.blue_field_position = 0;
-      boot_info->graphics.green_mask_size = 8;
-      boot_info->graphics.green_field_position = 8;
-      boot_info->graphics.red_mask_size = 8;
-      boot_info->graphics.red_field_position = 16;
-      boot_info->graphics.reserved_mask_size = 8;
-      boot_info->graphics.reserved_field_position = 24;
-      break;
+  xo_mode_policy_t policy = { 0, 0, GRAPHICS_DEFAULT_MAX_WIDTH, GRAPHICS_DEFAULT_MAX_HEIGHT };
+  uint32_t native_width = 0;
+  uint32_t native_height = 0;
+  int have_native = native_resolution(&native_width, &native_height);
+
+  const char *video = cmdline_option(boot_info->cmdline, "video=");
+  if (video && skip_prefix(video, "native")) {
+    policy.want_width = native_width;
+    policy.want_height = native_height;
+    policy.max_width = ~0u;
+    policy.max_height = ~0u;
+  } else if (video && *video >= '0' && *video <= '9') {
+    policy.want_width = parse_decimal(&video);
+    if (*video == 'x') {
+      video++;
+      policy.want_height = parse_decimal(&video);
+    }
+  } else if (have_native && native_width <= policy.max_width && native_height <= policy.max_height) {
+    policy.want_width = native_width;
+    policy.want_height = native_height;
+  }
 
-    case PixelBitMask:
-      // Use provided bitmask information
-      {
-        EFI_PIXEL_BITMASK *mask = &mode->Info->PixelInformation;
-        boot_info->graphics.red_mask_size = count_bits(mask->RedMask);
-        boot_info->graphics.red_field_position = find_bit_position(mask->RedMask);
-        boot_info->graphics.green_mask_size = count_bits(mask->GreenMask);
-        boot_info->graphics.green_field_position = find_bit_position(mask->GreenMask);
-        boot_info->graphics.blue_mask_size = count_bits(mask->BlueMask);
-        boot_info->graphics.blue_field_position = find_bit_position(mask->BlueMask);
-        boot_info->graphics.reserved_mask_size = count_bits(mask->ReservedMask);
-        boot_info->graphics.reserved_field_position = find_bit_position(mask->ReservedMask);
-      }
-      break;
+  // Score every mode; ties keep the current mode so no SetMode is needed
+  uint32_t best_mode = gop->Mode->Mode;
+  uint64_t best_score = mode_score(gop->Mode->Info, &policy);
+  for (uint32_t i = 0; i < gop->Mode->MaxMode; i++) {
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *info = NULL;
+    UINTN info_size = 0;
+    if (gop->QueryMode(gop, i, &info_size, &info) != EFI_SUCCESS || !info) {
+      continue;
+    }
+    uint64_t score = mode_score(info, &policy);
+    if (score > best_score) {
+      best_score = score;
+      best_mode = i;
+    }
+    gBS->FreePool(info);
+  }
 
-    default:
-      return EFI_UNSUPPORTED;
+  if (best_score == 0) {
+    return EFI_UNSUPPORTED; // No 32 bpp linear framebuffer mode
+  }
+  if (best_mode != gop->Mode->Mode) {
+    status = gop->SetMode(gop, best_mode);
+    if (status != EFI_SUCCESS) {
+      return status;
+    }
   }
 
+  set_graphics_info(&boot_info->graphics, gop->Mode);
   return EFI_SUCCESS;
 }
 
@@ -838,6 +1811,11 @@ static EFI_STATUS init_graphics(xo_boot_info_t *boot_info) {
 EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
   EFI_STATUS status;
   xo_boot_info_t boot_info = {0};
+  xo_memory_map_t memory_map = {0};
+
+  mark_phase(&boot_info, XO_BOOT_PHASE_LOADER_ENTRY);
+  mem_init();
+  crc32c_init();
 
   // Initialize globals
   gST = SystemTable;
@@ -852,36 +1830,52 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
   }
 
   // Initialize boot info structure
-  boot_info.magic = (uint64_t)XO_BOOT_INFO_MAGIC;
-  boot_info.version = 1;
-  boot_info.size = sizeof(xo_boot_info_t);
-  boot_info.bootloader_timestamp = get_timestamp();
+  boot_info.timing.phase_count = XO_BOOT_PHASE_COUNT;
+  boot_info.timing.timestamp = get_timestamp();
 
   // Get memory map
   print_ascii("Getting memory map...\r\n");
-  status = get_memory_map(&boot_info);
+  status = get_memory_map(&memory_map, &boot_info);
   if (status != EFI_SUCCESS) {
     print_ascii("ERROR: Failed to get memory map\r\n");
     return status;
   }
+  mark_phase(&boot_info, XO_BOOT_PHASE_MEMORY_MAP);
+
+  read_cmdline(ImageHandle, &boot_info);
+  if (boot_info.cmdline[0]) {
+    print_ascii("Command line: ");
+    print_ascii(boot_info.cmdline);
+    print_ascii("\r\n");
+  }
 
   // Initialize graphics
   print_ascii("Initializing graphics...\r\n");
   status = init_graphics(&boot_info);
   if (status == EFI_SUCCESS) {
-    print_ascii("Graphics initialized successfully\r\n");
+    print_ascii("Graphics mode ");
+    print_number(boot_info.graphics.framebuffer_width);
+    print_ascii("x");
+    print_number(boot_info.graphics.framebuffer_height);
+    print_ascii(", ");
+    print_number(boot_info.graphics.framebuffer_bpp);
+    print_ascii(" bpp\r\n");
   } else {
     print_ascii("WARNING: Graphics initialization failed\r\n");
   }
+  mark_phase(&boot_info, XO_BOOT_PHASE_GRAPHICS);
 
-  // Fill UEFI info
-  boot_info.uefi.efi_system_table = (uint64_t)(uintptr_t)(void*)SystemTable;
-  boot_info.uefi.efi_version = SystemTable->Revision;
-  boot_info.uefi.runtime_services_supported = (SystemTable->RuntimeServices != NULL) ? 1 : 0;
-  boot_info.uefi.loader_signature = (uint64_t)0x584F424F4F544552ULL; // "XOBOOTER"
+  // Locate ACPI tables for the kernel's SMP and interrupt setup
+  boot_info.acpi.rsdp_address = find_acpi_rsdp();
+  if (!boot_info.acpi.rsdp_address) {
+    print_ascii("WARNING: ACPI RSDP not found\r\n");
+  }
 
-  // Calculate checksum
-  boot_info.checksum = calculate_checksum(&boot_info);
+  // Fill UEFI info
+  boot_info.efi.system_table = (uint64_t)(uintptr_t)(void*)SystemTable;
+  boot_info.efi.version = SystemTable->Revision;
+  boot_info.efi.runtime_services = (SystemTable->RuntimeServices != NULL) ? 1 : 0;
+  boot_info.efi.loader_signature = (uint64_t)0x584F424F4F544552ULL; // "XOBOOTER"
 
   print_ascii("\r\nBoot information prepared:\r\n");
   print_ascii("- Memory entries: ");
@@ -901,113 +1895,148 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
   } else {
     print_ascii("Not found\r\n");
   }
-  print_ascii("- UEFI version: ");
-  print_hex(boot_info.uefi.efi_version);
+  print_ascii("- ACPI RSDP: ");
+  print_hex(boot_info.acpi.rsdp_address);
+  print_ascii("\r\n- UEFI version: ");
+  print_hex(boot_info.efi.version);
   print_ascii("\r\n- Boot timestamp: ");
-  print_number(boot_info.bootloader_timestamp);
+  print_number(boot_info.timing.timestamp);
   print_ascii(" seconds since 2000\r\n");
 
   // Load kernel
   print_ascii("\r\nLoading kernel...\r\n");
-  void *kernel_buffer = NULL;
-  UINTN kernel_size = 0;
+  xo_file_t kernel_file;
   uint64_t kernel_entry_point = 0;
 
   // Define kernel filename (UTF-16)
   CHAR16 kernel_filename[] = L"kernel.elf";
 
-  status = load_kernel_file(ImageHandle, kernel_filename, &kernel_buffer, &kernel_size);
+  status = open_boot_file(ImageHandle, kernel_filename, &kernel_file);
   if (status != EFI_SUCCESS) {
-    print_ascii("ERROR: Failed to load kernel file: ");
+    print_ascii("ERROR: Failed to open kernel file: ");
     print_hex(status);
     print_ascii("\r\nPress any key to exit...\r\n");
     wait_for_key();
     return status;
   }
 
-  print_ascii("Kernel loaded successfully (");
-  print_number(kernel_size);
+  mark_phase(&boot_info, XO_BOOT_PHASE_KERNEL_OPEN);
+
+  print_ascii("Kernel file opened (");
+  print_number(kernel_file.size);
   print_ascii(" bytes)\r\n");
 
-  // Parse and load ELF
-  print_ascii("Parsing ELF and loading segments...\r\n");
-  status = load_elf_segments(kernel_buffer, kernel_size, &kernel_entry_point);
+  // Put the other processors to work on the memory-bound part of loading,
+  // unless told not to ("loader.mp=off")
+  const char *mp_option = cmdline_option(boot_info.cmdline, "loader.mp=");
+  if (!mp_option || !skip_prefix(mp_option, "off")) {
+    uint32_t processors = start_ap_pool();
+    if (processors > 1) {
+      print_ascii("Loading on ");
+      print_number(processors);
+      print_ascii(" processors\r\n");
+    }
+  }
+
+  // Parse the ELF headers and read (or decompress) segments into place
+  xo_image_t kernel_image;
+  status = image_open(&kernel_file, &kernel_image);
+  if (status == EFI_SUCCESS) {
+    if (kernel_image.compressed) {
+      print_ascii("Kernel is LZ4 compressed\r\n");
+    }
+    print_ascii("Parsing ELF and loading segments...\r\n");
+    status = load_elf_segments(&kernel_image, &kernel_entry_point);
+    image_close(&kernel_image);
+  }
+  close_file(&kernel_file);
   if (status != EFI_SUCCESS) {
+    stop_ap_pool();
     print_ascii("ERROR: Failed to load ELF segments: ");
     print_hex(status);
     print_ascii("\r\nPress any key to exit...\r\n");
     wait_for_key();
-    gBS->FreePool(kernel_buffer);
     return status;
   }
 
+  mark_phase(&boot_info, XO_BOOT_PHASE_ELF_LOAD);
+
   print_ascii("ELF segments loaded successfully\r\n");
   print_ascii("Kernel entry point: ");
   print_hex(kernel_entry_point);
   print_ascii("\r\n");
 
-  // Fill kernel info in boot structure
-  boot_info.kernel.kernel_entry_point = kernel_entry_point;
-  boot_info.kernel.kernel_physical_address = kernel_entry_point; // For now, assume same
-  boot_info.kernel.kernel_virtual_address = kernel_entry_point;  // For now, assume same
-  boot_info.kernel.kernel_size = kernel_size;
-
-  // Recalculate checksum
-  boot_info.checksum = calculate_checksum(&boot_info);
-
-  // Get final memory map for kernel
-  print_ascii("Getting final memory map...\r\n");
-  UINTN map_size = 0;
-  EFI_MEMORY_DESCRIPTOR *memory_map = NULL;
-  UINTN map_key;
-  UINTN descriptor_size;
-  uint32_t descriptor_version;
-
-  // Get memory map size
-  status = gBS->GetMemoryMap(&map_size, memory_map, &map_key, &descriptor_size, &descriptor_version);
-  if (status != EFI_BUFFER_TOO_SMALL) {
-    print_ascii("ERROR: Failed to get memory map size\r\n");
-    gBS->FreePool(kernel_buffer);
-    return status;
-  }
-
-  // Allocate buffer
-  map_size += 2 * descriptor_size;
-  status = gBS->AllocatePool(EfiLoaderData, map_size, (void**)&memory_map);
+  // Load the initrd next to it, if there is one
+  CHAR16 initrd_filename[] = L"initrd.img";
+  status = load_initrd(ImageHandle, initrd_filename, &boot_info.initrd.address,
+                       &boot_info.initrd.size);
   if (status != EFI_SUCCESS) {
-    print_ascii("ERROR: Failed to allocate memory map buffer\r\n");
-    gBS->FreePool(kernel_buffer);
+    stop_ap_pool();
+    print_ascii("ERROR: Failed to load initrd: ");
+    print_hex(status);
+    print_ascii("\r\nPress any key to exit...\r\n");
+    wait_for_key();
     return status;
   }
+  if (boot_info.initrd.size) {
+    print_ascii("Initrd loaded (");
+    print_number(boot_info.initrd.size);
+    print_ascii(" bytes)\r\n");
+  }
+  if (boot_info.initrd.size && cmdline_option(boot_info.cmdline, "verify=initrd")) {
+    boot_info.initrd.crc32c = parallel_crc32c((const uint8_t*)(uintptr_t)boot_info.initrd.address,
+                                              boot_info.initrd.size);
+    boot_info.initrd.flags |= XO_INITRD_CRC32C;
+  }
+  stop_ap_pool();
+
+  mark_phase(&boot_info, XO_BOOT_PHASE_INITRD_LOAD);
 
-  // Get final memory map
-  status = gBS->GetMemoryMap(&map_size, memory_map, &map_key, &descriptor_size, &descriptor_version);
+  // Fill kernel info in boot structure
+  boot_info.kernel.entry_point = kernel_entry_point;
+  boot_info.kernel.physical_address = kernel_entry_point; // For now, assume same
+  boot_info.kernel.virtual_address = kernel_entry_point;  // For now, assume same
+  boot_info.kernel.size = kernel_image.compressed && kernel_image.frame.content_size ?
+                          kernel_image.frame.content_size : kernel_file.size;
+
+  // Get final memory map for kernel. Nothing may print or allocate between
+  // reading it and exiting boot services, or the map key goes stale.
+  print_ascii("Exiting UEFI boot services...\r\n");
+  status = get_memory_map(&memory_map, &boot_info);
   if (status != EFI_SUCCESS) {
     print_ascii("ERROR: Failed to get final memory map\r\n");
-    gBS->FreePool(memory_map);
-    gBS->FreePool(kernel_buffer);
     return status;
   }
-
-  // Exit boot services
-  print_ascii("Exiting UEFI boot services...\r\n");
-  status = gBS->ExitBootServices(ImageHandle, map_key);
+  mark_phase(&boot_info, XO_BOOT_PHASE_FINAL_MEMORY_MAP);
+
+  status = gBS->ExitBootServices(ImageHandle, memory_map.map_key);
+  if (status == EFI_INVALID_PARAMETER) {
+    // An event changed the map after we read it; the spec allows reading it
+    // again and retrying
+    status = get_memory_map(&memory_map, &boot_info);
+    if (status == EFI_SUCCESS) {
+      status = gBS->ExitBootServices(ImageHandle, memory_map.map_key);
+    }
+  }
   if (status != EFI_SUCCESS) {
     print_ascii("ERROR: Failed to exit boot services: ");
     print_hex(status);
     print_ascii("\r\n");
-    gBS->FreePool(memory_map);
-    gBS->FreePool(kernel_buffer);
+    free_memory_map(&memory_map);
     return status;
   }
 
+  // Write the boot block last, once nothing in it changes
+  mark_phase(&boot_info, XO_BOOT_PHASE_EXIT_BOOT_SERVICES);
+  xo_boot_header_t *boot_block = write_boot_block(&memory_map, &boot_info);
+
   // Boot services are no longer available - we're now in the kernel environment
   // Transfer control to kernel
-  typedef void (*kernel_entry_func)(xo_boot_info_t *boot_info);
+  typedef void (*kernel_entry_func)(xo_boot_header_t *boot_block);
   kernel_entry_func kernel_main = (kernel_entry_func)(void*)(uintptr_t)kernel_entry_point;
 
   // Jump to kernel!
-  kernel_main(&boot_info);
+  kernel_main(boot_block);
 
   // Should never reach here
   return EFI_SUCCESS;
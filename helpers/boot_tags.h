@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+
+// Boot handoff between the loader and the kernel. The loader passes the
+// physical address of a single block: an xo_boot_header_t followed by tags.
+// Each tag starts with its type and size (header included, padding not) and
+// the next tag follows at the next 8-byte boundary; an XO_TAG_END tag closes
+// the block.
+//
+// Readers skip tag types they do not know. A tag may grow by appending
+// fields: readers take the prefix they understand and treat missing fields
+// as zero. Changing the meaning of an existing field needs a new tag type;
+// the header version only changes if the framing itself does.
+
+#define XO_BOOT_MAGIC     0x584F424F4F54ULL // "XOBOOT"
+#define XO_BOOT_VERSION   5
+#define XO_BOOT_TAG_ALIGN 8
+
+#define XO_MAX_CMDLINE_LENGTH 1024
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t size;     // Header and all tags, in bytes
+  uint32_t checksum; // CRC32C of everything after the header
+  uint32_t reserved;
+} xo_boot_header_t;
+
+typedef struct {
+  uint32_t type;
+  uint32_t size;
+} xo_boot_tag_t;
+
+typedef enum {
+  XO_TAG_END = 0,
+  XO_TAG_MEMORY_MAP = 1,  // xo_memory_entry_t[]
+  XO_TAG_CMDLINE = 2,     // NUL-terminated ASCII
+  XO_TAG_FRAMEBUFFER = 3, // xo_graphics_info_t
+  XO_TAG_ACPI = 4,        // xo_boot_acpi_t
+  XO_TAG_INITRD = 5,      // xo_boot_initrd_t
+  XO_TAG_KERNEL = 6,      // xo_boot_kernel_t
+  XO_TAG_EFI = 7,         // xo_boot_efi_t
+  XO_TAG_BOOT_TIMING = 8  // xo_boot_timing_t
+} xo_boot_tag_type_t;
+
+// Memory map: sorted by base address, adjacent ranges of the same type and
+// attributes merged
+typedef enum {
+  XO_MEMORY_AVAILABLE = 1,
+  XO_MEMORY_RESERVED = 2,
+  XO_MEMORY_ACPI_RECLAIMABLE = 3,
+  XO_MEMORY_ACPI_NVS = 4,
+  XO_MEMORY_BAD = 5,
+  XO_MEMORY_BOOTLOADER_CODE = 6,
+  XO_MEMORY_BOOTLOADER_DATA = 7,
+  XO_MEMORY_RUNTIME_CODE = 8,
+  XO_MEMORY_RUNTIME_DATA = 9,
+  XO_MEMORY_CONVENTIONAL = 10,
+  XO_MEMORY_UNUSABLE = 11,
+  XO_MEMORY_PERSISTENT = 12
+} xo_memory_type_t;
+
+typedef struct {
+  uint64_t base_address;
+  uint64_t length;
+  xo_memory_type_t type;
+  uint32_t attributes;
+} xo_memory_entry_t;
+
+typedef struct {
+  uint64_t framebuffer_address;
+  uint32_t framebuffer_width;
+  uint32_t framebuffer_height;
+  uint32_t framebuffer_pitch;
+  uint32_t framebuffer_bpp;
+  uint32_t red_mask_size;
+  uint32_t red_field_position;
+  uint32_t green_mask_size;
+  uint32_t green_field_position;
+  uint32_t blue_mask_size;
+  uint32_t blue_field_position;
+  uint32_t reserved_mask_size;
+  uint32_t reserved_field_position;
+} xo_graphics_info_t;
+
+typedef struct {
+  uint64_t rsdp_address;
+} xo_boot_acpi_t;
+
+#define XO_INITRD_CRC32C 0x1 // The loader checksummed the initrd (verify=initrd)
+
+typedef struct {
+  uint64_t address;
+  uint64_t size;
+  uint32_t flags;  // XO_INITRD_*
+  uint32_t crc32c; // Valid with XO_INITRD_CRC32C
+} xo_boot_initrd_t;
+
+typedef struct {
+  uint64_t physical_address;
+  uint64_t virtual_address;
+  uint64_t size;
+  uint64_t entry_point;
+} xo_boot_kernel_t;
+
+typedef struct {
+  uint64_t system_table;
+  uint64_t loader_signature;
+  uint32_t version;          // EFI system table revision
+  uint32_t runtime_services; // Non-zero if runtime services are available
+} xo_boot_efi_t;
+
+// Boot phase timestamps: raw TSC values taken at the end of each phase, so
+// the loader needs no calibration. The kernel converts them once it knows
+// the TSC frequency. A zero stamp means the phase was not reached.
+typedef enum {
+  XO_BOOT_PHASE_LOADER_ENTRY = 0, // efi_main entered (time since reset before it)
+  XO_BOOT_PHASE_MEMORY_MAP,
+  XO_BOOT_PHASE_GRAPHICS,
+  XO_BOOT_PHASE_KERNEL_OPEN,
+  XO_BOOT_PHASE_ELF_LOAD,
+  XO_BOOT_PHASE_INITRD_LOAD,
+  XO_BOOT_PHASE_FINAL_MEMORY_MAP,
+  XO_BOOT_PHASE_EXIT_BOOT_SERVICES,
+  XO_BOOT_PHASE_KERNEL_ENTRY,     // Stamped by the kernel on entry
+  XO_BOOT_PHASE_COUNT
+} xo_boot_phase_t;
+
+typedef struct {
+  uint32_t phase_count;
+  uint32_t reserved;
+  uint64_t timestamp; // Wall clock at loader entry, seconds since 2000
+  uint64_t phase_tsc[XO_BOOT_PHASE_COUNT];
+} xo_boot_timing_t;
@@ -0,0 +1,106 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78u // Reflected Castagnoli polynomial
+
+#define CPUID_1_ECX_SSE42 (1u << 20)
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64_t;
+
+static uint32_t crc_table[8][256];
+static uint32_t x2n_table[32]; // x^(2^n) modulo the polynomial
+static int use_sse42 = 0;
+
+// a * b modulo the polynomial, bit-reflected; a must not be zero
+static uint32_t multiply_mod_poly(uint32_t a, uint32_t b) {
+  uint32_t product = 0;
+  for (uint32_t m = 1u << 31;; m >>= 1) {
+    if (a & m) {
+      product ^= b;
+      if (!(a & (m - 1))) {
+        return product;
+      }
+    }
+    b = (b >> 1) ^ (CRC32C_POLY & (0u - (b & 1)));
+  }
+}
+
+void crc32c_init(void) {
+  uint32_t power = 1u << 30; // x^1
+  for (int n = 0; n < 32; n++) {
+    x2n_table[n] = power;
+    power = multiply_mod_poly(power, power);
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+  if (ecx & CPUID_1_ECX_SSE42) {
+    use_sse42 = 1;
+    return;
+  }
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+    }
+    crc_table[0][i] = crc;
+  }
+  // Table k advances a byte through k further zero bytes
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < 8; k++) {
+      uint32_t crc = crc_table[k - 1][i];
+      crc_table[k][i] = (crc >> 8) ^ crc_table[0][crc & 0xFF];
+    }
+  }
+}
+
+// CRC32 is an integer instruction, so this needs no SIMD state and is safe
+// in kernel code built without SSE
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t size) {
+  uint64_t value = crc;
+  for (; size >= 8; p += 8, size -= 8) {
+    __asm__ ("crc32q %1, %0" : "+r"(value) : "rm"(*(const unaligned_u64_t*)p));
+  }
+  crc = (uint32_t)value;
+  for (; size; p++, size--) {
+    __asm__ ("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+  }
+  return crc;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t size) {
+  for (; size >= 8; p += 8, size -= 8) {
+    uint64_t value = *(const unaligned_u64_t*)p ^ crc;
+    uint32_t low = (uint32_t)value;
+    uint32_t high = (uint32_t)(value >> 32);
+    crc = crc_table[7][low & 0xFF] ^ crc_table[6][(low >> 8) & 0xFF] ^
+          crc_table[5][(low >> 16) & 0xFF] ^ crc_table[4][low >> 24] ^
+          crc_table[3][high & 0xFF] ^ crc_table[2][(high >> 8) & 0xFF] ^
+          crc_table[1][(high >> 16) & 0xFF] ^ crc_table[0][high >> 24];
+  }
+  for (; size; p++, size--) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xFF];
+  }
+  return crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size) {
+  const uint8_t *p = (const uint8_t*)data;
+  crc = ~crc;
+  crc = use_sse42 ? crc32c_hw(crc, p, size) : crc32c_sw(crc, p, size);
+  return ~crc;
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t size_b) {
+  // Appending size_b bytes multiplies crc_a's contribution by x^(8 * size_b)
+  uint32_t shift = 1u << 31; // x^0
+  for (uint32_t n = 3; size_b; size_b >>= 1, n++) {
+    if (size_b & 1) {
+      shift = multiply_mod_poly(x2n_table[n & 31], shift);
+    }
+  }
+  return multiply_mod_poly(shift, crc_a) ^ crc_b;
+}
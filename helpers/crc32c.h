@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli) shared by the loader and the kernel. Uses the SSE4.2
+// CRC32 instruction when the CPU has it and slicing-by-8 tables otherwise.
+
+// Probe CPUID and build the fallback tables; call before crc32c
+void crc32c_init(void);
+
+// Extend crc (0 to start) over size bytes. Chaining calls gives the same
+// result as one call over the concatenated data.
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+// CRC of a buffer A followed by B, given crc32c(0, A), crc32c(0, B) and B's
+// size, so pieces can be checksummed separately (e.g. on several CPUs)
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t size_b);
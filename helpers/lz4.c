@@ -0,0 +1,129 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lz4.h"
+#include "mem.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_FLG_VERSION_MASK     0xC0
+#define LZ4_FLG_VERSION_01       0x40
+#define LZ4_FLG_INDEPENDENT      0x20
+#define LZ4_FLG_BLOCK_CHECKSUM   0x10
+#define LZ4_FLG_CONTENT_SIZE     0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICTIONARY_ID    0x01
+
+static uint32_t read_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int lz4_parse_frame_header(const uint8_t *data, size_t size, xo_lz4_frame_t *frame) {
+  if (size < 7 || read_le32(data) != LZ4_FRAME_MAGIC) {
+    return -1;
+  }
+
+  uint8_t flags = data[4];
+  uint8_t block_descriptor = data[5];
+  if ((flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION_01 || (flags & LZ4_FLG_DICTIONARY_ID)) {
+    return -1;
+  }
+
+  // Block maximum size ids 4-7 are 64 KiB, 256 KiB, 1 MiB and 4 MiB
+  uint32_t size_id = (block_descriptor >> 4) & 0x7;
+  if (size_id < 4) {
+    return -1;
+  }
+
+  uint32_t header_size = 6;
+  frame->content_size = 0;
+  if (flags & LZ4_FLG_CONTENT_SIZE) {
+    if (size < header_size + 8 + 1) {
+      return -1;
+    }
+    frame->content_size = (uint64_t)read_le32(data + header_size) |
+                          ((uint64_t)read_le32(data + header_size + 4) << 32);
+    header_size += 8;
+  }
+  header_size++; // Header checksum
+
+  frame->header_size = header_size;
+  frame->block_max_size = 1u << (8 + 2 * size_id);
+  frame->block_checksum = (flags & LZ4_FLG_BLOCK_CHECKSUM) != 0;
+  frame->content_checksum = (flags & LZ4_FLG_CONTENT_CHECKSUM) != 0;
+  frame->independent = (flags & LZ4_FLG_INDEPENDENT) != 0;
+  return 0;
+}
+
+// Literal and match lengths: a 4-bit field, extended by bytes while 255
+static int read_length(const uint8_t **ip, const uint8_t *end, size_t *length) {
+  if (*length != 15) {
+    return 0;
+  }
+  uint8_t byte;
+  do {
+    if (*ip >= end) {
+      return -1;
+    }
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return 0;
+}
+
+int64_t lz4_decompress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity) {
+  const uint8_t *ip = src;
+  const uint8_t *input_end = src + src_size;
+  uint8_t *op = dst;
+  uint8_t *output_end = dst + dst_capacity;
+
+  while (ip < input_end) {
+    uint8_t token = *ip++;
+
+    size_t literal_length = token >> 4;
+    if (read_length(&ip, input_end, &literal_length) != 0 ||
+        literal_length > (size_t)(input_end - ip) ||
+        literal_length > (size_t)(output_end - op)) {
+      return -1;
+    }
+    memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // The last sequence carries literals only
+    if (ip == input_end) {
+      break;
+    }
+
+    if (input_end - ip < 2) {
+      return -1;
+    }
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst)) {
+      return -1;
+    }
+
+    size_t match_length = token & 0xF;
+    if (read_length(&ip, input_end, &match_length) != 0) {
+      return -1;
+    }
+    match_length += LZ4_MIN_MATCH;
+    if (match_length > (size_t)(output_end - op)) {
+      return -1;
+    }
+
+    // An overlapping match repeats the last offset bytes. Copy it in
+    // non-overlapping pieces; each piece doubles the repeated span, so a
+    // long run costs only a logarithmic number of copies.
+    size_t distance = offset;
+    while (match_length) {
+      size_t chunk = match_length < distance ? match_length : distance;
+      memcpy(op, op - distance, chunk);
+      op += chunk;
+      match_length -= chunk;
+      distance += chunk;
+    }
+  }
+
+  return (int64_t)(op - dst);
+}
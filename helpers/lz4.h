@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 frame format support (decoding only): frame header parsing and
+// decompression of single blocks. The caller does the block framing, so
+// data can be streamed from any source.
+
+#define LZ4_FRAME_MAGIC       0x184D2204u
+#define LZ4_FRAME_HEADER_MAX  19 // Magic, FLG, BD, content size, dictionary ID, HC
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000u // Block size flag: stored raw
+
+typedef struct {
+  uint32_t header_size;    // Bytes up to the first block header
+  uint32_t block_max_size;
+  uint64_t content_size;   // 0 if the frame does not record it
+  uint8_t block_checksum;  // Each block is followed by a 4-byte checksum
+  uint8_t content_checksum; // The end mark is followed by a 4-byte checksum
+  uint8_t independent;     // Blocks do not reference earlier blocks
+} xo_lz4_frame_t;
+
+// Parse the frame header at the start of data. Returns 0 on success, -1 if
+// it is not a valid LZ4 frame or uses a preset dictionary.
+int lz4_parse_frame_header(const uint8_t *data, size_t size, xo_lz4_frame_t *frame);
+
+// Decompress one block. Returns the number of bytes written, or -1 if the
+// input is malformed or would overflow dst_capacity.
+int64_t lz4_decompress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity);
@@ -0,0 +1,215 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem.h"
+
+// Nothing in here may be written as a plain byte loop: the compiler is free
+// to turn such a loop back into a call to memcpy or memset.
+
+#define CPUID_7_EBX_ERMS (1u << 9)
+#define CPUID_7_EDX_FSRM (1u << 4)
+
+// Without ERMS, REP MOVSB is slower than REP MOVSQ at any size; with ERMS
+// alone it only wins once its startup cost is amortised
+#define ERMS_THRESHOLD 256
+#define NO_FAST_STRINGS ((size_t)-1)
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32_t;
+typedef uint16_t __attribute__((may_alias, aligned(1))) unaligned_u16_t;
+
+static size_t rep_byte_threshold = NO_FAST_STRINGS;
+
+void mem_init(void) {
+  uint32_t eax, ebx, ecx, edx;
+  __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+  if (eax < 7) {
+    return;
+  }
+
+  __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+  if (edx & CPUID_7_EDX_FSRM) {
+    rep_byte_threshold = 0;
+  } else if (ebx & CPUID_7_EBX_ERMS) {
+    rep_byte_threshold = ERMS_THRESHOLD;
+  }
+}
+
+// Copy 0-16 bytes with at most two loads and two stores per size class.
+// All loads happen before the stores, so overlapping buffers are fine.
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t count) {
+  if (count >= 8) {
+    uint64_t head = *(const unaligned_u64_t*)s;
+    uint64_t tail = *(const unaligned_u64_t*)(s + count - 8);
+    *(unaligned_u64_t*)d = head;
+    *(unaligned_u64_t*)(d + count - 8) = tail;
+  } else if (count >= 4) {
+    uint32_t head = *(const unaligned_u32_t*)s;
+    uint32_t tail = *(const unaligned_u32_t*)(s + count - 4);
+    *(unaligned_u32_t*)d = head;
+    *(unaligned_u32_t*)(d + count - 4) = tail;
+  } else if (count >= 2) {
+    uint16_t head = *(const unaligned_u16_t*)s;
+    uint16_t tail = *(const unaligned_u16_t*)(s + count - 2);
+    *(unaligned_u16_t*)d = head;
+    *(unaligned_u16_t*)(d + count - 2) = tail;
+  } else if (count) {
+    *d = *s;
+  }
+}
+
+static inline void fill_small(uint8_t *d, uint64_t pattern, size_t count) {
+  if (count >= 8) {
+    *(unaligned_u64_t*)d = pattern;
+    *(unaligned_u64_t*)(d + count - 8) = pattern;
+  } else if (count >= 4) {
+    *(unaligned_u32_t*)d = (uint32_t)pattern;
+    *(unaligned_u32_t*)(d + count - 4) = (uint32_t)pattern;
+  } else if (count >= 2) {
+    *(unaligned_u16_t*)d = (uint16_t)pattern;
+    *(unaligned_u16_t*)(d + count - 2) = (uint16_t)pattern;
+  } else if (count) {
+    *d = (uint8_t)pattern;
+  }
+}
+
+void *memcpy(void *dest, const void *src, size_t count) {
+  uint8_t *d = (uint8_t*)dest;
+  const uint8_t *s = (const uint8_t*)src;
+
+  if (count <= 16) {
+    copy_small(d, s, count);
+    return dest;
+  }
+
+  if (count >= rep_byte_threshold) {
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(count) : : "memory");
+    return dest;
+  }
+
+  // Copy the first quadword unaligned, then continue from the next aligned
+  // destination address; the last quadword is copied unaligned as well
+  uint64_t tail = *(const unaligned_u64_t*)(s + count - 8);
+  uint8_t *tail_dest = d + count - 8;
+  *(unaligned_u64_t*)d = *(const unaligned_u64_t*)s;
+
+  size_t skew = 8 - ((uintptr_t)d & 7);
+  d += skew;
+  s += skew;
+  size_t quads = (count - skew) / 8;
+  __asm__ volatile ("rep movsq" : "+D"(d), "+S"(s), "+c"(quads) : : "memory");
+
+  *(unaligned_u64_t*)tail_dest = tail;
+  return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t count) {
+  uint8_t *d = (uint8_t*)dest;
+  const uint8_t *s = (const uint8_t*)src;
+
+  if (count <= 16) {
+    copy_small(d, s, count);
+    return dest;
+  }
+
+  if ((uintptr_t)d - (uintptr_t)s >= count) {
+    // Either no overlap or the destination is below the source, where a
+    // forward copy is safe. memcpy's unaligned tail is not overlap safe.
+    if (d + count <= s || d >= s + count) {
+      return memcpy(dest, src, count);
+    }
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(count) : : "memory");
+    return dest;
+  }
+
+  // Destination overlaps the end of the source: copy backwards. Mirror
+  // memcpy: both unaligned end quadwords are loaded up front and stored
+  // last, and the aligned destination quadwords in between are copied from
+  // the top down. Backward string instructions have no fast path, so the
+  // loop is explicit (and in asm, so it is not turned back into memmove).
+  uint64_t head = *(const unaligned_u64_t*)s;
+  uint64_t tail = *(const unaligned_u64_t*)(s + count - 8);
+  size_t aligned_end = count - ((uintptr_t)(d + count) & 7);
+  size_t quads = aligned_end / 8;
+  const uint8_t *qs = s + aligned_end % 8;
+  uint8_t *qd = d + aligned_end % 8;
+  uint64_t t0, t1, t2, t3;
+  size_t odd = quads & 3;
+  if (odd) {
+    quads -= odd;
+    __asm__ volatile ("1:\n\t"
+                      "movq -8(%[s],%[n],8), %[t0]\n\t"
+                      "movq %[t0], -8(%[d],%[n],8)\n\t"
+                      "decq %[n]\n\t"
+                      "jnz 1b"
+                      : [n] "+r"(odd), [t0] "=&r"(t0)
+                      : [s] "r"(qs + quads * 8), [d] "r"(qd + quads * 8)
+                      : "memory");
+  }
+  if (quads) {
+    // Four loads before four stores keeps this overlap safe at any distance
+    __asm__ volatile ("1:\n\t"
+                      "movq -8(%[s],%[n],8), %[t0]\n\t"
+                      "movq -16(%[s],%[n],8), %[t1]\n\t"
+                      "movq -24(%[s],%[n],8), %[t2]\n\t"
+                      "movq -32(%[s],%[n],8), %[t3]\n\t"
+                      "movq %[t0], -8(%[d],%[n],8)\n\t"
+                      "movq %[t1], -16(%[d],%[n],8)\n\t"
+                      "movq %[t2], -24(%[d],%[n],8)\n\t"
+                      "movq %[t3], -32(%[d],%[n],8)\n\t"
+                      "subq $4, %[n]\n\t"
+                      "jnz 1b"
+                      : [n] "+r"(quads), [t0] "=&r"(t0), [t1] "=&r"(t1), [t2] "=&r"(t2), [t3] "=&r"(t3)
+                      : [s] "r"(qs), [d] "r"(qd)
+                      : "memory");
+  }
+
+  *(unaligned_u64_t*)(d + count - 8) = tail;
+  *(unaligned_u64_t*)d = head;
+  return dest;
+}
+
+void *memset(void *dest, int value, size_t count) {
+  uint8_t *d = (uint8_t*)dest;
+  uint64_t pattern = (uint64_t)(uint8_t)value * 0x0101010101010101ULL;
+
+  if (count <= 16) {
+    fill_small(d, pattern, count);
+    return dest;
+  }
+
+  if (count >= rep_byte_threshold) {
+    __asm__ volatile ("rep stosb" : "+D"(d), "+c"(count) : "a"(value) : "memory");
+    return dest;
+  }
+
+  uint8_t *tail_dest = d + count - 8;
+  *(unaligned_u64_t*)d = pattern;
+
+  size_t skew = 8 - ((uintptr_t)d & 7);
+  d += skew;
+  size_t quads = (count - skew) / 8;
+  __asm__ volatile ("rep stosq" : "+D"(d), "+c"(quads) : "a"(pattern) : "memory");
+
+  *(unaligned_u64_t*)tail_dest = pattern;
+  return dest;
+}
+
+int memcmp(const void *a, const void *b, size_t count) {
+  const uint8_t *x = (const uint8_t*)a;
+  const uint8_t *y = (const uint8_t*)b;
+
+  // Skip equal quadwords, then find the first differing byte
+  while (count >= 8 && *(const unaligned_u64_t*)x == *(const unaligned_u64_t*)y) {
+    x += 8;
+    y += 8;
+    count -= 8;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (x[i] != y[i]) {
+      return x[i] < y[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+// Memory copy/fill/compare routines shared by the loader and the kernel.
+//
+// Large copies and fills use REP MOVSB/STOSB when the CPU advertises fast
+// strings (ERMS, or FSRM for short lengths too) and REP MOVSQ/STOSQ with an
+// aligned destination otherwise. Short lengths are done with a few
+// overlapping scalar moves. Everything works before mem_init; it only
+// selects the faster string paths.
+
+// Probe CPUID for ERMS/FSRM
+void mem_init(void);
+
+void *memcpy(void *dest, const void *src, size_t count);
+void *memmove(void *dest, const void *src, size_t count);
+void *memset(void *dest, int value, size_t count);
+int memcmp(const void *a, const void *b, size_t count);
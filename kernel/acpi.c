@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+#include "paging.h"
+#include "pmm.h"
+
+// Firmware may put the RSDP and tables in Reserved memory, which the direct
+// map leaves out, so each one gets its own write-back mapping. Tables are
+// mapped once in acpi_init and looked up from then on.
+
+#define ACPI_MAX_TABLES 64
+
+typedef struct {
+  char signature[8];
+  uint8_t checksum;
+  char oem_id[6];
+  uint8_t revision;
+  uint32_t rsdt_address;
+  // ACPI 2.0+
+  uint32_t length;
+  uint64_t xsdt_address;
+  uint8_t extended_checksum;
+  uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+// XSDT entries are only 4-byte aligned
+typedef struct {
+  uint64_t value;
+} __attribute__((packed)) acpi_unaligned_u64_t;
+
+static const acpi_sdt_header_t *tables[ACPI_MAX_TABLES];
+static uint32_t table_count = 0;
+
+static int checksum_ok(const void *data, uint32_t length) {
+  const uint8_t *bytes = (const uint8_t*)data;
+  uint8_t sum = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    sum += bytes[i];
+  }
+  return sum == 0;
+}
+
+static int signature_equal(const char *a, const char *b, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    if (a[i] != b[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Map the header first to learn the length, then the whole table unless the
+// header's pages already cover it
+static const acpi_sdt_header_t *map_table(uint64_t address) {
+  const acpi_sdt_header_t *header = (const acpi_sdt_header_t*)paging_map_mmio_type(
+      address, sizeof(acpi_sdt_header_t), MEM_TYPE_WB);
+  if (!header || header->length < sizeof(acpi_sdt_header_t)) {
+    return NULL;
+  }
+
+  uint64_t mapped = ((address + sizeof(acpi_sdt_header_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) - address;
+  const acpi_sdt_header_t *table = header;
+  if (header->length > mapped) {
+    table = (const acpi_sdt_header_t*)paging_map_mmio_type(address, header->length, MEM_TYPE_WB);
+    if (!table) {
+      return NULL;
+    }
+  }
+
+  if (!checksum_ok(table, table->length)) {
+    return NULL;
+  }
+  return table;
+}
+
+int acpi_init(uint64_t rsdp_address) {
+  if (!rsdp_address) {
+    return -1;
+  }
+
+  const acpi_rsdp_t *rsdp = (const acpi_rsdp_t*)paging_map_mmio_type(rsdp_address, sizeof(acpi_rsdp_t), MEM_TYPE_WB);
+  if (!rsdp || !signature_equal(rsdp->signature, "RSD PTR ", 8) || !checksum_ok(rsdp, 20)) {
+    return -1;
+  }
+
+  const acpi_sdt_header_t *root;
+  uint32_t entry_size; // 8 for the XSDT, 4 for the RSDT
+  if (rsdp->revision >= 2 && rsdp->xsdt_address && rsdp->length >= sizeof(acpi_rsdp_t) &&
+      checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+    root = map_table(rsdp->xsdt_address);
+    entry_size = 8;
+  } else {
+    root = map_table(rsdp->rsdt_address);
+    entry_size = 4;
+  }
+  if (!root) {
+    return -1;
+  }
+
+  const uint8_t *entries = (const uint8_t*)root + sizeof(acpi_sdt_header_t);
+  uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+
+  for (uint32_t i = 0; i < count && table_count < ACPI_MAX_TABLES; i++) {
+    uint64_t address;
+    if (entry_size == 8) {
+      address = ((const acpi_unaligned_u64_t*)(const void*)(entries + i * 8))->value;
+    } else {
+      address = *(const uint32_t*)(const void*)(entries + i * 4);
+    }
+
+    const acpi_sdt_header_t *table = address ? map_table(address) : NULL;
+    if (table) {
+      tables[table_count++] = table;
+    }
+  }
+  return 0;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *signature) {
+  for (uint32_t i = 0; i < table_count; i++) {
+    if (signature_equal(tables[i]->signature, signature, 4)) {
+      return tables[i];
+    }
+  }
+  return NULL;
+}
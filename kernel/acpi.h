@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  char signature[4];
+  uint32_t length;
+  uint8_t revision;
+  uint8_t checksum;
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// MADT (signature "APIC")
+typedef struct {
+  acpi_sdt_header_t header;
+  uint32_t local_apic_address;
+  uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t length;
+} __attribute__((packed)) acpi_madt_entry_t;
+
+#define ACPI_MADT_LOCAL_APIC          0
+#define ACPI_MADT_IO_APIC             1
+#define ACPI_MADT_INTERRUPT_OVERRIDE  2
+#define ACPI_MADT_LOCAL_APIC_OVERRIDE 5
+#define ACPI_MADT_LOCAL_X2APIC        9
+
+#define ACPI_MADT_CPU_ENABLED        0x1
+#define ACPI_MADT_CPU_ONLINE_CAPABLE 0x2
+
+typedef struct {
+  acpi_madt_entry_t entry;
+  uint8_t processor_id;
+  uint8_t apic_id;
+  uint32_t flags;
+} __attribute__((packed)) acpi_madt_local_apic_t;
+
+typedef struct {
+  acpi_madt_entry_t entry;
+  uint16_t reserved;
+  uint64_t local_apic_address;
+} __attribute__((packed)) acpi_madt_local_apic_override_t;
+
+typedef struct {
+  acpi_madt_entry_t entry;
+  uint16_t reserved;
+  uint32_t x2apic_id;
+  uint32_t flags;
+  uint32_t processor_uid;
+} __attribute__((packed)) acpi_madt_local_x2apic_t;
+
+typedef struct {
+  acpi_madt_entry_t entry;
+  uint8_t io_apic_id;
+  uint8_t reserved;
+  uint32_t io_apic_address;
+  uint32_t gsi_base;
+} __attribute__((packed)) acpi_madt_io_apic_t;
+
+// An ISA IRQ that is not identity-mapped to a GSI, or not edge/active-high
+typedef struct {
+  acpi_madt_entry_t entry;
+  uint8_t bus; // Always 0 (ISA)
+  uint8_t source;
+  uint32_t gsi;
+  uint16_t flags;
+} __attribute__((packed)) acpi_madt_interrupt_override_t;
+
+#define ACPI_MADT_POLARITY_MASK 0x3
+#define ACPI_MADT_POLARITY_LOW  0x3
+#define ACPI_MADT_TRIGGER_MASK  0xC
+#define ACPI_MADT_TRIGGER_LEVEL 0xC
+
+// Generic Address Structure
+typedef struct {
+  uint8_t address_space;
+  uint8_t register_bit_width;
+  uint8_t register_bit_offset;
+  uint8_t access_size;
+  uint64_t address;
+} __attribute__((packed)) acpi_gas_t;
+
+#define ACPI_GAS_SYSTEM_MEMORY 0
+#define ACPI_GAS_SYSTEM_IO     1
+
+// HPET description table (signature "HPET")
+typedef struct {
+  acpi_sdt_header_t header;
+  uint32_t event_timer_block_id;
+  acpi_gas_t base_address;
+  uint8_t hpet_number;
+  uint16_t minimum_tick;
+  uint8_t page_protection;
+} __attribute__((packed)) acpi_hpet_t;
+
+// Fixed ACPI Description Table (signature "FACP"), up to the flags word;
+// nothing past it is used yet
+typedef struct {
+  acpi_sdt_header_t header;
+  uint32_t firmware_ctrl;
+  uint32_t dsdt;
+  uint8_t reserved0;
+  uint8_t preferred_pm_profile;
+  uint16_t sci_interrupt;
+  uint32_t smi_command;
+  uint8_t acpi_enable;
+  uint8_t acpi_disable;
+  uint8_t s4bios_request;
+  uint8_t pstate_control;
+  uint32_t pm1a_event_block;
+  uint32_t pm1b_event_block;
+  uint32_t pm1a_control_block;
+  uint32_t pm1b_control_block;
+  uint32_t pm2_control_block;
+  uint32_t pm_timer_block;
+  uint32_t gpe0_block;
+  uint32_t gpe1_block;
+  uint8_t pm1_event_length;
+  uint8_t pm1_control_length;
+  uint8_t pm2_control_length;
+  uint8_t pm_timer_length;
+  uint8_t gpe0_block_length;
+  uint8_t gpe1_block_length;
+  uint8_t gpe1_base;
+  uint8_t cstate_control;
+  uint16_t c2_latency;
+  uint16_t c3_latency;
+  uint16_t flush_size;
+  uint16_t flush_stride;
+  uint8_t duty_offset;
+  uint8_t duty_width;
+  uint8_t day_alarm;
+  uint8_t month_alarm;
+  uint8_t century;
+  uint16_t iapc_boot_arch;
+  uint8_t reserved1;
+  uint32_t flags;
+} __attribute__((packed)) acpi_fadt_t;
+
+#define ACPI_FADT_TMR_VAL_EXT (1u << 8) // PM timer is 32 bits wide, not 24
+
+// Validate the RSDP and root table. Returns 0 on success.
+int acpi_init(uint64_t rsdp_address);
+
+// Find a table by its four-character signature; NULL if absent or corrupt
+const acpi_sdt_header_t *acpi_find_table(const char *signature);
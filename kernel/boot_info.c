@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "boot_info.h"
+#include "memlayout.h"
+#include "../helpers/crc32c.h"
+#include "../helpers/mem.h"
+
+// Copy the part of a tag payload we know about; fields a shorter (older)
+// tag lacks stay zero
+static void copy_payload(void *dest, size_t dest_size, const void *payload, uint32_t size) {
+  memcpy(dest, payload, size < dest_size ? size : dest_size);
+}
+
+int boot_info_parse(uint64_t phys, xo_boot_info_t *boot_info) {
+  const xo_boot_header_t *header = (const xo_boot_header_t*)phys_to_virt(phys);
+  if (header->magic != XO_BOOT_MAGIC || header->version != XO_BOOT_VERSION ||
+      header->size < sizeof(xo_boot_header_t) + sizeof(xo_boot_tag_t)) {
+    return -1;
+  }
+
+  const uint8_t *tags = (const uint8_t*)(header + 1);
+  uint32_t length = header->size - (uint32_t)sizeof(xo_boot_header_t);
+  if (crc32c(0, tags, length) != header->checksum) {
+    return -1;
+  }
+
+  memset(boot_info, 0, sizeof(*boot_info));
+  boot_info->block_address = phys;
+  boot_info->block_size = header->size;
+  boot_info->cmdline = "";
+
+  uint32_t offset = 0;
+  while (length - offset >= sizeof(xo_boot_tag_t)) {
+    const xo_boot_tag_t *tag = (const xo_boot_tag_t*)(tags + offset);
+    if (tag->size < sizeof(xo_boot_tag_t) || tag->size > length - offset) {
+      return -1;
+    }
+    const void *payload = tag + 1;
+    uint32_t size = tag->size - (uint32_t)sizeof(xo_boot_tag_t);
+
+    switch (tag->type) {
+      case XO_TAG_END:
+        return boot_info->memory_map_entries ? 0 : -1;
+      case XO_TAG_MEMORY_MAP:
+        boot_info->memory_map = (const xo_memory_entry_t*)payload;
+        boot_info->memory_map_entries = size / (uint32_t)sizeof(xo_memory_entry_t);
+        break;
+      case XO_TAG_CMDLINE:
+        if (size && ((const char*)payload)[size - 1] == '\0') {
+          boot_info->cmdline = (const char*)payload;
+        }
+        break;
+      case XO_TAG_FRAMEBUFFER:
+        copy_payload(&boot_info->graphics, sizeof(boot_info->graphics), payload, size);
+        break;
+      case XO_TAG_ACPI:
+        copy_payload(&boot_info->acpi, sizeof(boot_info->acpi), payload, size);
+        break;
+      case XO_TAG_INITRD:
+        copy_payload(&boot_info->initrd, sizeof(boot_info->initrd), payload, size);
+        break;
+      case XO_TAG_KERNEL:
+        copy_payload(&boot_info->kernel, sizeof(boot_info->kernel), payload, size);
+        break;
+      case XO_TAG_EFI:
+        copy_payload(&boot_info->efi, sizeof(boot_info->efi), payload, size);
+        break;
+      case XO_TAG_BOOT_TIMING:
+        copy_payload(&boot_info->timing, sizeof(boot_info->timing), payload, size);
+        break;
+      default:
+        break; // Newer than us
+    }
+
+    offset += (tag->size + XO_BOOT_TAG_ALIGN - 1) & ~(uint32_t)(XO_BOOT_TAG_ALIGN - 1);
+    if (offset > length) {
+      break;
+    }
+  }
+  return -1; // No end tag
+}
+
+const char *boot_info_option(const xo_boot_info_t *boot_info, const char *name) {
+  const char *cmdline = boot_info->cmdline;
+  for (const char *p = cmdline; *p; p++) {
+    if (p != cmdline && p[-1] != ' ') {
+      continue;
+    }
+    const char *value = p;
+    const char *n = name;
+    while (*n && *value == *n) {
+      value++;
+      n++;
+    }
+    if (!*n) {
+      return value;
+    }
+  }
+  return NULL;
+}
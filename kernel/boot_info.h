@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../helpers/boot_tags.h"
+
+// The kernel's view of the loader's boot block, filled in one pass over its
+// tags. Anything the loader did not provide is zero, and cmdline is "".
+// Pointers refer into the block itself, which pmm_init keeps reserved.
+typedef struct {
+  uint64_t block_address; // Physical address and size of the boot block
+  uint32_t block_size;
+
+  const xo_memory_entry_t *memory_map;
+  uint32_t memory_map_entries;
+
+  const char *cmdline;
+  xo_graphics_info_t graphics;
+  xo_boot_acpi_t acpi;
+  xo_boot_initrd_t initrd;
+  xo_boot_kernel_t kernel;
+  xo_boot_efi_t efi;
+  xo_boot_timing_t timing;
+} xo_boot_info_t;
+
+// Check the block at phys (magic, version, checksum, tag bounds) and parse
+// it into boot_info. The block must be reachable through the direct map.
+// Returns 0 on success, -1 if it is invalid or has no memory map.
+int boot_info_parse(uint64_t phys, xo_boot_info_t *boot_info);
+
+// Value of the first command-line word starting with name (so "trace" finds
+// "trace" and "trace=100", returning "" and "=100"), or NULL
+const char *boot_info_option(const xo_boot_info_t *boot_info, const char *name);
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "boot_profile.h"
+#include "clock.h"
+#include "cpu.h"
+#include "klog.h"
+
+static uint64_t phase_tsc[BOOT_PROFILE_PHASES];
+
+static const char *const phase_names[BOOT_PROFILE_PHASES] = {
+  [XO_BOOT_PHASE_LOADER_ENTRY] = "firmware",
+  [XO_BOOT_PHASE_MEMORY_MAP] = "memory map",
+  [XO_BOOT_PHASE_GRAPHICS] = "graphics init",
+  [XO_BOOT_PHASE_KERNEL_OPEN] = "kernel open",
+  [XO_BOOT_PHASE_ELF_LOAD] = "elf load",
+  [XO_BOOT_PHASE_INITRD_LOAD] = "initrd load",
+  [XO_BOOT_PHASE_FINAL_MEMORY_MAP] = "final memory map",
+  [XO_BOOT_PHASE_EXIT_BOOT_SERVICES] = "exit boot services",
+  [XO_BOOT_PHASE_KERNEL_ENTRY] = "kernel entry",
+  [BOOT_PROFILE_KERNEL_INIT] = "kernel init",
+};
+
+void boot_profile_init(const xo_boot_info_t *boot_info, uint64_t entry_tsc) {
+  // Without a timing tag phase_count is zero
+  uint32_t count = boot_info->timing.phase_count;
+  if (count > XO_BOOT_PHASE_COUNT) {
+    count = XO_BOOT_PHASE_COUNT;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    phase_tsc[i] = boot_info->timing.phase_tsc[i];
+  }
+  phase_tsc[XO_BOOT_PHASE_KERNEL_ENTRY] = entry_tsc;
+}
+
+uint64_t boot_profile_phase_ns(uint32_t phase) {
+  if (phase >= BOOT_PROFILE_PHASES || !phase_tsc[phase] || !clock_ready()) {
+    return 0;
+  }
+  if (phase == XO_BOOT_PHASE_LOADER_ENTRY) {
+    return clock_tsc_to_ns(phase_tsc[phase]);
+  }
+
+  // A phase starts where the last stamped one before it ended
+  uint32_t previous = phase;
+  while (previous-- > 0) {
+    if (phase_tsc[previous]) {
+      return phase_tsc[phase] > phase_tsc[previous] ?
+             clock_tsc_to_ns(phase_tsc[phase] - phase_tsc[previous]) : 0;
+    }
+  }
+  return 0;
+}
+
+static void log_duration(const char *name, uint64_t nanoseconds) {
+  klog("boot: %18s %6lu.%03lu ms", name,
+       nanoseconds / 1000000, (nanoseconds / 1000) % 1000);
+}
+
+void boot_profile_report(void) {
+  phase_tsc[BOOT_PROFILE_KERNEL_INIT] = rdtsc();
+
+  uint64_t total = 0;
+  for (uint32_t phase = 0; phase < BOOT_PROFILE_PHASES; phase++) {
+    uint64_t nanoseconds = boot_profile_phase_ns(phase);
+    total += nanoseconds;
+    if (phase_tsc[phase]) {
+      log_duration(phase_names[phase], nanoseconds);
+    }
+  }
+  log_duration("total", total);
+}
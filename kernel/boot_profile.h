@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "boot_info.h"
+
+// Kernel-side phase that follows the loader's: kernel_main up to the report
+#define BOOT_PROFILE_KERNEL_INIT XO_BOOT_PHASE_COUNT
+#define BOOT_PROFILE_PHASES      (XO_BOOT_PHASE_COUNT + 1)
+
+// Keep the loader's phase stamps and close the handoff phase with the TSC
+// read on kernel entry
+void boot_profile_init(const xo_boot_info_t *boot_info, uint64_t entry_tsc);
+
+// Close the kernel init phase and log the per-phase breakdown (needs the
+// calibrated clock)
+void boot_profile_report(void);
+
+// Nanoseconds spent in a phase, 0 if either end was not stamped. Phase 0
+// (loader entry) is the time from reset to efi_main.
+uint64_t boot_profile_phase_ns(uint32_t phase);
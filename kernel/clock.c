@@ -0,0 +1,192 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "clock.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "delay.h"
+#include "klog.h"
+#include "lapic.h"
+#include "paging.h"
+
+// The TSC is the clocksource: one RDTSC per timestamp, no MMIO or port I/O.
+// Its rate is measured once at boot against a timer of known frequency, and
+// tick counts are turned into nanoseconds with a 32.32 fixed-point multiply
+// so the read path has no division.
+//
+// Timer interrupts are one-shot. With TSC-deadline support the deadline is a
+// single MSR write in TSC units; otherwise the LAPIC timer counts down the
+// remaining time, clamped to its 32-bit range (the handler simply re-arms
+// when it fires early). A TSC that is not invariant may change rate with
+// P-states or stop in deep C-states, so TSC deadlines are only trusted when
+// CPUID reports an invariant TSC.
+
+#define CALIBRATION_NS 10000000ULL // 10 ms
+
+#define HPET_REG_CAPABILITIES 0x000
+#define HPET_REG_CONFIG       0x010
+#define HPET_REG_COUNTER      0x0F0
+#define HPET_CAP_COUNTER_64   (1ULL << 13)
+#define HPET_CONFIG_ENABLE    (1ULL << 0)
+#define HPET_MAX_PERIOD_FS    100000000ULL // 100 ns, per the HPET specification
+
+#define PM_TIMER_FREQUENCY 3579545ULL
+
+#define CPUID_1_ECX_TSC_DEADLINE        (1u << 24)
+#define CPUID_80000007_EDX_INVARIANT_TSC (1u << 8)
+
+#define NS_PER_SECOND 1000000000ULL
+
+static uint64_t tsc_hz = 0;
+static uint64_t tsc_base = 0;
+static uint64_t ns_per_tsc_32 = 0; // Nanoseconds per TSC tick, 32.32 fixed point
+static int tsc_deadline_supported = 0;
+
+static uint64_t calibrate_with_hpet(void) {
+  const acpi_hpet_t *table = (const acpi_hpet_t*)acpi_find_table("HPET");
+  if (!table || table->base_address.address_space != ACPI_GAS_SYSTEM_MEMORY) {
+    return 0;
+  }
+
+  volatile uint64_t *hpet = (volatile uint64_t*)paging_map_mmio(table->base_address.address, 0x1000);
+  if (!hpet) {
+    return 0;
+  }
+
+  uint64_t capabilities = hpet[HPET_REG_CAPABILITIES / 8];
+  uint64_t period_fs = capabilities >> 32;
+  if (!period_fs || period_fs > HPET_MAX_PERIOD_FS) {
+    return 0;
+  }
+  uint64_t mask = (capabilities & HPET_CAP_COUNTER_64) ? ~0ULL : 0xFFFFFFFFULL;
+
+  hpet[HPET_REG_CONFIG / 8] |= HPET_CONFIG_ENABLE;
+
+  uint64_t target = CALIBRATION_NS * 1000000 / period_fs;
+  uint64_t start = hpet[HPET_REG_COUNTER / 8];
+  uint64_t tsc_start = rdtsc();
+  uint64_t elapsed;
+  do {
+    elapsed = (hpet[HPET_REG_COUNTER / 8] - start) & mask;
+  } while (elapsed < target);
+  uint64_t tsc_elapsed = rdtsc() - tsc_start;
+
+  uint64_t elapsed_ns = elapsed * period_fs / 1000000;
+  return tsc_elapsed * NS_PER_SECOND / elapsed_ns;
+}
+
+static uint64_t calibrate_with_pm_timer(void) {
+  const acpi_fadt_t *fadt = (const acpi_fadt_t*)acpi_find_table("FACP");
+  if (!fadt || fadt->header.length < sizeof(acpi_fadt_t) || !fadt->pm_timer_block) {
+    return 0;
+  }
+
+  uint16_t port = (uint16_t)fadt->pm_timer_block;
+  uint32_t mask = (fadt->flags & ACPI_FADT_TMR_VAL_EXT) ? 0xFFFFFFFFu : 0x00FFFFFFu;
+
+  uint64_t target = PM_TIMER_FREQUENCY * CALIBRATION_NS / NS_PER_SECOND;
+  uint32_t last = inl(port) & mask;
+  uint64_t tsc_start = rdtsc();
+  uint64_t elapsed = 0;
+  while (elapsed < target) {
+    uint32_t now = inl(port) & mask;
+    elapsed += (now - last) & mask;
+    last = now;
+  }
+  uint64_t tsc_elapsed = rdtsc() - tsc_start;
+
+  return tsc_elapsed * PM_TIMER_FREQUENCY / elapsed;
+}
+
+static uint64_t calibrate_with_pit(void) {
+  uint64_t tsc_start = rdtsc();
+  udelay(CALIBRATION_NS / 1000);
+  return (rdtsc() - tsc_start) * (NS_PER_SECOND / CALIBRATION_NS);
+}
+
+int clock_init(void) {
+  uint64_t hz = calibrate_with_hpet();
+  if (!hz) {
+    hz = calibrate_with_pm_timer();
+  }
+  if (!hz) {
+    hz = calibrate_with_pit();
+  }
+  if (!hz) {
+    return -1;
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+  int invariant = 0;
+  if (eax >= 0x80000007) {
+    cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+    invariant = (edx & CPUID_80000007_EDX_INVARIANT_TSC) != 0;
+  }
+
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  tsc_deadline_supported = invariant && (ecx & CPUID_1_ECX_TSC_DEADLINE) != 0;
+  if (!invariant) {
+    klog("clock: tsc is not invariant, timestamps may drift; using the lapic timer");
+  }
+
+  ns_per_tsc_32 = (NS_PER_SECOND << 32) / hz;
+  tsc_base = rdtsc();
+  __atomic_store_n(&tsc_hz, hz, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int clock_ready(void) {
+  return __atomic_load_n(&tsc_hz, __ATOMIC_ACQUIRE) != 0;
+}
+
+uint64_t clock_tsc_hz(void) {
+  return tsc_hz;
+}
+
+uint64_t clock_tsc_to_ns(uint64_t ticks) {
+  return (uint64_t)(((unsigned __int128)ticks * ns_per_tsc_32) >> 32);
+}
+
+uint64_t clock_ns_to_tsc(uint64_t nanoseconds) {
+  // Split at whole seconds so the product cannot overflow
+  return (nanoseconds / NS_PER_SECOND) * tsc_hz +
+         (nanoseconds % NS_PER_SECOND) * tsc_hz / NS_PER_SECOND;
+}
+
+uint64_t clock_now_ns(void) {
+  return clock_tsc_to_ns(rdtsc() - tsc_base);
+}
+
+void clockevent_init_cpu(uint8_t vector) {
+  if (tsc_deadline_supported) {
+    lapic_timer_set_tsc_deadline(vector);
+  } else {
+    lapic_timer_set_oneshot(vector);
+  }
+}
+
+void clockevent_program(uint64_t deadline_ns) {
+  if (tsc_deadline_supported) {
+    wrmsr(MSR_TSC_DEADLINE, tsc_base + clock_ns_to_tsc(deadline_ns));
+    return;
+  }
+
+  uint64_t now = clock_now_ns();
+  uint64_t delta = deadline_ns > now ? deadline_ns - now : 0;
+  uint64_t ticks = delta * lapic_timer_ticks_per_ms() / 1000000;
+  if (ticks == 0) {
+    ticks = 1;
+  } else if (ticks > 0xFFFFFFFF) {
+    ticks = 0xFFFFFFFF;
+  }
+  lapic_timer_arm((uint32_t)ticks);
+}
+
+void clockevent_cancel(void) {
+  if (tsc_deadline_supported) {
+    wrmsr(MSR_TSC_DEADLINE, 0);
+  } else {
+    lapic_timer_arm(0);
+  }
+}
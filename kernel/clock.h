@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+// Calibrate the TSC against the HPET, falling back to the ACPI PM timer and
+// then the PIT. Needs ACPI and the MMIO window. Returns 0 on success.
+int clock_init(void);
+
+// Non-zero once the TSC has been calibrated
+int clock_ready(void);
+
+uint64_t clock_tsc_hz(void);
+
+// Nanoseconds since clock_init
+uint64_t clock_now_ns(void);
+
+uint64_t clock_tsc_to_ns(uint64_t ticks);
+uint64_t clock_ns_to_tsc(uint64_t nanoseconds);
+
+// Per-CPU one-shot timer interrupt on the given vector, using the
+// TSC-deadline MSR when the TSC is invariant and supports it, and the LAPIC
+// count-down otherwise. Nothing fires until clockevent_program is called.
+void clockevent_init_cpu(uint8_t vector);
+
+// Raise one interrupt at (or shortly after) the clock_now_ns deadline
+void clockevent_program(uint64_t deadline_ns);
+void clockevent_cancel(void);
@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "console.h"
+#include "fb.h"
+#include "font.h"
+#include "gfx.h"
+#include "klog.h"
+#include "kmalloc.h"
+#include "sched.h"
+#include "simd.h"
+#include "spinlock.h"
+
+// Each glyph is expanded once, at init, into a cell of back-buffer pixels in
+// the console colors (and at the console scale), so drawing a character is
+// a block copy of cell rows. Scrolling goes through fb_scroll, which turns a
+// new line into clearing one row of cells rather than moving the screen.
+
+#define CELL_PAD_ROWS 2 // Blank font rows below each line of text
+#define TAB_WIDTH     8
+
+#define CONSOLE_FOREGROUND 0x00C0C0C0
+#define CONSOLE_BACKGROUND 0x00000000
+
+static uint32_t *glyph_cache = NULL; // FONT_GLYPH_COUNT cells
+static uint32_t scale = 1;
+static uint32_t cell_width = 0;
+static uint32_t cell_height = 0;
+static uint32_t columns = 0;
+static uint32_t lines = 0;
+static uint32_t cursor_x = 0;
+static uint32_t cursor_y = 0;
+static size_t log_position = 0;
+static spinlock_t console_lock = SPINLOCK_INIT;
+static thread_t *console_task = NULL;
+static volatile uint32_t log_pending = 0;
+static volatile uint32_t panicked = 0;
+
+static void expand_glyphs(void) {
+  uint32_t cell_pixels = cell_width * cell_height;
+  for (uint32_t glyph = 0; glyph < FONT_GLYPH_COUNT; glyph++) {
+    uint32_t *cell = glyph_cache + glyph * cell_pixels;
+    for (uint32_t y = 0; y < cell_height; y++) {
+      uint32_t font_row = y / scale;
+      uint8_t bits = font_row < FONT_HEIGHT ? font_glyphs[glyph][font_row] : 0;
+      for (uint32_t x = 0; x < cell_width; x++) {
+        cell[y * cell_width + x] = (bits & (0x80 >> (x / scale))) ? CONSOLE_FOREGROUND : CONSOLE_BACKGROUND;
+      }
+    }
+  }
+}
+
+static void new_line(void) {
+  cursor_x = 0;
+  if (++cursor_y == lines) {
+    fb_scroll(cell_height, CONSOLE_BACKGROUND);
+    cursor_y = lines - 1;
+  }
+}
+
+static void draw_char(char c) {
+  uint32_t index = (uint8_t)c >= FONT_FIRST_CHAR && (uint8_t)c <= FONT_LAST_CHAR
+                   ? (uint8_t)c - FONT_FIRST_CHAR : '?' - FONT_FIRST_CHAR;
+  fb_blit(cursor_x * cell_width, cursor_y * cell_height, cell_width, cell_height,
+          glyph_cache + index * cell_width * cell_height, cell_width);
+  if (++cursor_x == columns) {
+    new_line();
+  }
+}
+
+// Caller holds console_lock
+static void put_text(const char *text, size_t length) {
+  simd_begin();
+  for (size_t i = 0; i < length; i++) {
+    switch (text[i]) {
+      case '\n':
+        new_line();
+        break;
+      case '\r':
+        cursor_x = 0;
+        break;
+      case '\t':
+        do {
+          draw_char(' ');
+        } while (cursor_x % TAB_WIDTH && cursor_x);
+        break;
+      default:
+        draw_char(text[i]);
+        break;
+    }
+  }
+  simd_end();
+}
+
+// klog listener: runs after every line, on any CPU
+static void log_listener(void) {
+  if (panicked) {
+    // Threads may never run again; the fatal path syncs by itself
+    return;
+  }
+  __atomic_store_n(&log_pending, 1, __ATOMIC_SEQ_CST);
+  thread_t *thread = __atomic_load_n(&console_task, __ATOMIC_ACQUIRE);
+  if (thread) {
+    thread_wake(thread);
+  }
+}
+
+// Blocks while the log is quiet, so an idle machine takes no timer
+// interrupts for the console
+static void console_thread(void *arg) {
+  // Lines logged before this are drained by the first sync
+  __atomic_store_n(&console_task, thread_current(), __ATOMIC_RELEASE);
+  while (1) {
+    __atomic_store_n(&log_pending, 0, __ATOMIC_SEQ_CST);
+    console_sync();
+    thread_wait(&log_pending);
+    // Let the rest of a burst arrive so it costs one flush
+    thread_sleep(CONSOLE_BATCH_MS * 1000000ULL);
+  }
+}
+
+int console_init(void) {
+  if (!fb_ready()) {
+    return -1;
+  }
+
+  // Keep text readable on high resolution modes
+  scale = fb_height() >= 1000 ? 2 : 1;
+  cell_width = FONT_WIDTH * scale;
+  cell_height = (FONT_HEIGHT + CELL_PAD_ROWS) * scale;
+  columns = fb_width() / cell_width;
+  lines = fb_height() / cell_height;
+  if (!columns || !lines) {
+    return -1;
+  }
+
+  glyph_cache = (uint32_t*)kmalloc((size_t)FONT_GLYPH_COUNT * cell_width * cell_height * sizeof(uint32_t));
+  if (!glyph_cache) {
+    return -1;
+  }
+  expand_glyphs();
+
+  fb_clear(CONSOLE_BACKGROUND);
+  fb_flush();
+
+  klog_add_listener(log_listener);
+  if (!thread_create("console", console_thread, NULL)) {
+    return -1;
+  }
+  return 0;
+}
+
+// Fatal paths: this CPU may have faulted holding the console or framebuffer
+// lock, so skip the screen unless both come free
+static int lock_after_fault(void) {
+  for (uint32_t i = 0; i < SPIN_PROBE_TRIES; i++) {
+    if (spin_trylock(&console_lock)) {
+      if (fb_lock_available()) {
+        return 1;
+      }
+      spin_unlock(&console_lock);
+      return 0;
+    }
+    cpu_relax();
+  }
+  return 0;
+}
+
+void console_panic(void) {
+  panicked = 1;
+  gfx_force_scalar();
+  simd_disable();
+}
+
+void console_write(const char *text, size_t length) {
+  if (!glyph_cache) {
+    return;
+  }
+  spin_lock(&console_lock);
+  put_text(text, length);
+  spin_unlock(&console_lock);
+  fb_flush();
+}
+
+void console_sync(void) {
+  char buffer[256];
+  size_t count;
+
+  if (!glyph_cache) {
+    return;
+  }
+  if (!panicked) {
+    spin_lock(&console_lock);
+  } else if (!lock_after_fault()) {
+    return;
+  }
+  while ((count = klog_read(&log_position, buffer, sizeof(buffer))) != 0) {
+    put_text(buffer, count);
+  }
+  spin_unlock(&console_lock);
+  fb_flush();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+// Text console on the framebuffer, fed from the kernel log. A console thread
+// blocks until klog gains a line, waits CONSOLE_BATCH_MS for the rest of the
+// burst and flushes once per batch, so code that logs heavily never waits
+// for the screen.
+
+#define CONSOLE_BATCH_MS 16
+
+// Build the glyph cache, clear the screen and start the console thread.
+// Requires fb_init and the scheduler's thread_create. Returns 0 on success.
+int console_init(void);
+
+// Draw text at the cursor and flush the screen
+void console_write(const char *text, size_t length);
+
+// Draw whatever klog has gained since the last call and flush
+void console_sync(void);
+
+// Switch to the fatal path for good, without taking any lock: klog no longer
+// wakes the console thread, drawing avoids SIMD, and console_sync skips the
+// screen if the console or framebuffer lock stays held.
+void console_panic(void);
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+
+// Save RFLAGS and disable interrupts; pair with irq_restore
+static inline uint64_t irq_save(void) {
+  uint64_t flags;
+  __asm__ volatile ("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+  return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+  __asm__ volatile ("pushq %0; popfq" : : "r"(flags) : "memory", "cc");
+}
+
+static inline void outb(uint16_t port, uint8_t value) {
+  __asm__ volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+  uint8_t value;
+  __asm__ volatile ("inb %1, %0" : "=a"(value) : "Nd"(port));
+  return value;
+}
+
+static inline uint32_t inl(uint16_t port) {
+  uint32_t value;
+  __asm__ volatile ("inl %1, %0" : "=a"(value) : "Nd"(port));
+  return value;
+}
+
+static inline uint64_t rdtsc(void) {
+  uint32_t low, high;
+  __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+static inline void cpu_relax(void) {
+  __asm__ volatile ("pause" : : : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  __asm__ volatile ("cpuid"
+                    : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                    : "a"(leaf), "c"(subleaf));
+}
+
+// Initial APIC ID of the calling CPU (CPUID leaf 1)
+static inline uint32_t cpu_initial_apic_id(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  return ebx >> 24;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+  uint32_t low, high;
+  __asm__ volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+  return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+  __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+  __asm__ volatile ("xsetbv" : : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t read_cr0(void) {
+  uint64_t value;
+  __asm__ volatile ("mov %%cr0, %0" : "=r"(value));
+  return value;
+}
+
+static inline void write_cr0(uint64_t value) {
+  __asm__ volatile ("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint64_t read_cr3(void) {
+  uint64_t value;
+  __asm__ volatile ("mov %%cr3, %0" : "=r"(value));
+  return value;
+}
+
+static inline void write_cr3(uint64_t value) {
+  __asm__ volatile ("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+  uint64_t value;
+  __asm__ volatile ("mov %%cr4, %0" : "=r"(value));
+  return value;
+}
+
+static inline void write_cr4(uint64_t value) {
+  __asm__ volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+#define MSR_APIC_BASE    0x0000001B
+#define MSR_PAT          0x00000277
+#define MSR_TSC_DEADLINE 0x000006E0
+#define MSR_EFER         0xC0000080
+#define MSR_GS_BASE      0xC0000101
+#define EFER_LME         (1ULL << 8)
+#define EFER_NXE         (1ULL << 11)
+#define CR0_MP           (1ULL << 1)
+#define CR0_EM           (1ULL << 2)
+#define CR0_TS           (1ULL << 3)
+#define CR0_WP           (1ULL << 16)
+#define CR4_PGE          (1ULL << 7)
+#define CR4_OSFXSR       (1ULL << 9)
+#define CR4_OSXMMEXCPT   (1ULL << 10)
+#define CR4_OSXSAVE      (1ULL << 18)
+#define XCR0_X87         (1ULL << 0)
+#define XCR0_SSE         (1ULL << 1)
+#define XCR0_AVX         (1ULL << 2)
@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+#include "delay.h"
+#include "clock.h"
+#include "cpu.h"
+
+// Busy-wait delays spin on the TSC once clock_init has calibrated it. Before
+// that they run on PIT channel 2 (gate controlled through port 0x61), which
+// needs no interrupt or prior calibration.
+
+#define PIT_FREQUENCY    1193182ULL
+#define PIT_CHANNEL2     0x42
+#define PIT_COMMAND      0x43
+#define PIT_GATE_PORT    0x61
+#define PIT_GATE_ENABLE  0x01
+#define PIT_SPEAKER      0x02
+#define PIT_OUT2         0x20
+#define PIT_MAX_TICKS    0xFFFF
+
+static void pit_wait_ticks(uint16_t ticks) {
+  uint8_t gate = inb(PIT_GATE_PORT);
+  outb(PIT_GATE_PORT, (uint8_t)((gate & ~PIT_SPEAKER) & ~PIT_GATE_ENABLE));
+
+  // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+  outb(PIT_COMMAND, 0xB0);
+  outb(PIT_CHANNEL2, (uint8_t)ticks);
+  outb(PIT_CHANNEL2, (uint8_t)(ticks >> 8));
+
+  outb(PIT_GATE_PORT, (uint8_t)((gate & ~PIT_SPEAKER) | PIT_GATE_ENABLE));
+  while (!(inb(PIT_GATE_PORT) & PIT_OUT2)) {
+    cpu_relax();
+  }
+
+  outb(PIT_GATE_PORT, gate);
+}
+
+void udelay(uint64_t microseconds) {
+  if (clock_ready()) {
+    uint64_t end = rdtsc() + clock_ns_to_tsc(microseconds * 1000);
+    while (rdtsc() < end) {
+      cpu_relax();
+    }
+    return;
+  }
+
+  uint64_t ticks = (microseconds * PIT_FREQUENCY + 999999) / 1000000;
+
+  while (ticks) {
+    uint64_t chunk = ticks > PIT_MAX_TICKS ? PIT_MAX_TICKS : ticks;
+    pit_wait_ticks((uint16_t)chunk);
+    ticks -= chunk;
+  }
+}
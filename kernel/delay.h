@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Busy-wait for at least the given number of microseconds
+void udelay(uint64_t microseconds);
@@ -0,0 +1,310 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "fb.h"
+#include "gfx.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "pmm.h"
+#include "simd.h"
+#include "spinlock.h"
+
+// The back buffer is packed (width pixels per row) and built from buddy
+// blocks of at most 2^PMM_MAX_ORDER pages, each holding a band of whole
+// rows, so large modes do not need physically contiguous memory. A row
+// pointer table hides the banding from the drawing code. It holds every
+// row pointer twice and screen row y is table[top + y], so scrolling only
+// moves top and clears the rows that come into view. The back buffer
+// holds 0x00RRGGBB pixels; flushing packs them into the framebuffer's
+// layout unless that is the same.
+//
+// Damage is a short list of rectangles. A new rectangle that overlaps or
+// touches an existing one is merged into it; when the list is full it is
+// merged with whichever entry grows the least.
+
+#define FB_MAX_DAMAGE 16
+
+// Rows copied to video memory per fb_lock hold; a full-width band at 1080p
+// is about 120 KiB
+#define FB_FLUSH_BAND_ROWS 16
+
+static uint8_t *front = NULL;
+static uint32_t front_pitch = 0; // Bytes
+static uint32_t width = 0;
+static uint32_t height = 0;
+static uint32_t **rows = NULL; // 2 * height entries
+static uint32_t top = 0;
+static xo_pixel_format_t format;
+static int native_format = 0;
+
+static xo_rect_t damage[FB_MAX_DAMAGE];
+static uint32_t damage_count = 0;
+static spinlock_t fb_lock = SPINLOCK_INIT;
+
+static inline uint32_t *row_at(uint32_t y) {
+  return rows[top + y];
+}
+
+static int clip(uint32_t *x, uint32_t *y, uint32_t *w, uint32_t *h) {
+  if (*x >= width || *y >= height || !*w || !*h) {
+    return 0;
+  }
+  if (*w > width - *x) {
+    *w = width - *x;
+  }
+  if (*h > height - *y) {
+    *h = height - *y;
+  }
+  return 1;
+}
+
+static uint64_t area(const xo_rect_t *r) {
+  return (uint64_t)r->width * r->height;
+}
+
+static xo_rect_t rect_union(const xo_rect_t *a, const xo_rect_t *b) {
+  uint32_t x0 = a->x < b->x ? a->x : b->x;
+  uint32_t y0 = a->y < b->y ? a->y : b->y;
+  uint32_t x1 = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+  uint32_t y1 = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+  xo_rect_t r = { x0, y0, x1 - x0, y1 - y0 };
+  return r;
+}
+
+// Overlapping or edge-adjacent
+static int rect_touches(const xo_rect_t *a, const xo_rect_t *b) {
+  return a->x <= b->x + b->width && b->x <= a->x + a->width &&
+         a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+// Caller holds fb_lock and has clipped the rectangle
+static void add_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+  xo_rect_t rect = { x, y, w, h };
+
+  // Absorb every entry the rectangle touches; the union may reach others
+  for (uint32_t i = 0; i < damage_count;) {
+    if (rect_touches(&rect, &damage[i])) {
+      rect = rect_union(&rect, &damage[i]);
+      damage[i] = damage[--damage_count];
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+
+  if (damage_count < FB_MAX_DAMAGE) {
+    damage[damage_count++] = rect;
+    return;
+  }
+
+  uint32_t best = 0;
+  uint64_t best_growth = ~0ULL;
+  for (uint32_t i = 0; i < damage_count; i++) {
+    xo_rect_t merged = rect_union(&rect, &damage[i]);
+    uint64_t growth = area(&merged) - area(&damage[i]);
+    if (growth < best_growth) {
+      best_growth = growth;
+      best = i;
+    }
+  }
+  damage[best] = rect_union(&rect, &damage[best]);
+}
+
+static uint32_t band_order(uint64_t bytes) {
+  uint32_t order = 0;
+  while ((PAGE_SIZE << order) < bytes) {
+    order++;
+  }
+  return order;
+}
+
+// Release the bands backing rows [0, end) of table
+static void free_bands(uint32_t **table, uint32_t end, uint64_t band_rows, uint64_t row_bytes) {
+  for (uint32_t y = 0; y < end; y += (uint32_t)band_rows) {
+    uint64_t count = end - y < band_rows ? end - y : band_rows;
+    pmm_free_pages(virt_to_phys(table[y]), band_order(count * row_bytes));
+  }
+}
+
+int fb_init(const xo_graphics_info_t *graphics) {
+  if (!graphics->framebuffer_address || graphics->framebuffer_bpp != 32 ||
+      !graphics->framebuffer_width || !graphics->framebuffer_height) {
+    return -1;
+  }
+
+  uint32_t w = graphics->framebuffer_width;
+  uint32_t h = graphics->framebuffer_height;
+  uint64_t row_bytes = (uint64_t)w * 4;
+  uint64_t band_rows = (PAGE_SIZE << PMM_MAX_ORDER) / row_bytes;
+  if (!band_rows) {
+    return -1;
+  }
+
+  uint32_t **table = (uint32_t**)kmalloc(2 * (size_t)h * sizeof(uint32_t*));
+  if (!table) {
+    return -1;
+  }
+
+  for (uint32_t y = 0; y < h; y += (uint32_t)band_rows) {
+    uint64_t count = h - y < band_rows ? h - y : band_rows;
+    uint64_t phys = pmm_alloc_pages(band_order(count * row_bytes));
+    if (!phys) {
+      free_bands(table, y, band_rows, row_bytes);
+      kfree(table);
+      return -1;
+    }
+
+    uint8_t *band = (uint8_t*)phys_to_virt(phys);
+    for (uint64_t i = 0; i < count; i++) {
+      table[y + i] = (uint32_t*)(band + i * row_bytes);
+      table[h + y + i] = table[y + i];
+    }
+  }
+
+  uint64_t size = (uint64_t)graphics->framebuffer_pitch * h;
+  uint8_t *mapped = (uint8_t*)paging_map_mmio_type(graphics->framebuffer_address, size, MEM_TYPE_WC);
+  if (!mapped) {
+    free_bands(table, h, band_rows, row_bytes);
+    kfree(table);
+    return -1;
+  }
+
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  front = mapped;
+  front_pitch = graphics->framebuffer_pitch;
+  width = w;
+  height = h;
+  rows = table;
+  top = 0;
+  gfx_pixel_format(graphics, &format);
+  native_format = gfx_format_is_native(&format);
+  damage_count = 0;
+  spin_unlock_irqrestore(&fb_lock, flags);
+  return 0;
+}
+
+int fb_ready(void) {
+  return rows != NULL;
+}
+
+uint32_t fb_width(void) {
+  return width;
+}
+
+uint32_t fb_height(void) {
+  return height;
+}
+
+void fb_plot(uint32_t x, uint32_t y, uint32_t color) {
+  fb_fill_rect(x, y, 1, 1, color);
+}
+
+void fb_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color) {
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  if (rows && clip(&x, &y, &w, &h)) {
+    simd_begin();
+    for (uint32_t row = y; row < y + h; row++) {
+      gfx_fill_span(row_at(row) + x, color, w);
+    }
+    simd_end();
+    add_damage(x, y, w, h);
+  }
+  spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+void fb_clear(uint32_t color) {
+  fb_fill_rect(0, 0, width, height, color);
+}
+
+void fb_blit(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+             const uint32_t *pixels, uint32_t stride) {
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  if (rows && clip(&x, &y, &w, &h)) {
+    simd_begin();
+    for (uint32_t row = 0; row < h; row++) {
+      gfx_copy_span(row_at(y + row) + x, pixels + (uint64_t)row * stride, w);
+    }
+    simd_end();
+    add_damage(x, y, w, h);
+  }
+  spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+void fb_scroll(uint32_t lines, uint32_t color) {
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  if (rows) {
+    if (lines > height) {
+      lines = height;
+    }
+    top = (top + lines) % height;
+    simd_begin();
+    for (uint32_t row = height - lines; row < height; row++) {
+      gfx_fill_span(row_at(row), color, width);
+    }
+    simd_end();
+    add_damage(0, 0, width, height);
+  }
+  spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+uint32_t *fb_row(uint32_t y) {
+  return rows && y < height ? row_at(y) : NULL;
+}
+
+void fb_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  if (rows && clip(&x, &y, &w, &h)) {
+    add_damage(x, y, w, h);
+  }
+  spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+void fb_flush(void) {
+  xo_rect_t pending[FB_MAX_DAMAGE];
+
+  // Take the damage list, then copy in bands so interrupts are only ever
+  // off for one band. Damage recorded meanwhile goes to the next flush.
+  uint64_t flags = spin_lock_irqsave(&fb_lock);
+  uint32_t count = damage_count;
+  for (uint32_t i = 0; i < count; i++) {
+    pending[i] = damage[i];
+  }
+  damage_count = 0;
+  spin_unlock_irqrestore(&fb_lock, flags);
+
+  for (uint32_t i = 0; i < count; i++) {
+    const xo_rect_t *rect = &pending[i];
+    uint32_t end = rect->y + rect->height;
+    for (uint32_t y = rect->y; y < end; y += FB_FLUSH_BAND_ROWS) {
+      uint32_t band_end = end - y > FB_FLUSH_BAND_ROWS ? y + FB_FLUSH_BAND_ROWS : end;
+
+      flags = spin_lock_irqsave(&fb_lock);
+      uint8_t *dst = front + (uint64_t)y * front_pitch + (uint64_t)rect->x * 4;
+      simd_begin();
+      for (uint32_t row = y; row < band_end; row++) {
+        if (native_format) {
+          gfx_copy_span((uint32_t*)dst, row_at(row) + rect->x, rect->width);
+        } else {
+          gfx_pack_span((uint32_t*)dst, row_at(row) + rect->x, rect->width, &format);
+        }
+        dst += front_pitch;
+      }
+      simd_end();
+      spin_unlock_irqrestore(&fb_lock, flags);
+    }
+  }
+
+  // Drain the write-combining buffers so the frame is complete on return
+  __asm__ volatile ("sfence" : : : "memory");
+}
+
+int fb_lock_available(void) {
+  for (uint32_t i = 0; i < SPIN_PROBE_TRIES; i++) {
+    if (spin_trylock(&fb_lock)) {
+      spin_unlock(&fb_lock);
+      return 1;
+    }
+    cpu_relax();
+  }
+  return 0;
+}
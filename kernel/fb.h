@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "boot_info.h"
+
+// Double-buffered framebuffer. All drawing goes to a shadow buffer in normal
+// RAM and records the damaged rectangle; fb_flush copies only damaged spans
+// to video memory, which is mapped write-combining. Colors are 0x00RRGGBB;
+// the flush converts them to the framebuffer's pixel layout.
+
+typedef struct {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+} xo_rect_t;
+
+// Map the framebuffer and allocate the back buffer. Only 32 bpp modes are
+// supported. Requires kmalloc_init and gfx_init. Returns 0 on success, -1 otherwise.
+int fb_init(const xo_graphics_info_t *graphics);
+
+// Non-zero once fb_init has succeeded
+int fb_ready(void);
+
+uint32_t fb_width(void);
+uint32_t fb_height(void);
+
+// Drawing; coordinates are clipped to the screen
+void fb_plot(uint32_t x, uint32_t y, uint32_t color);
+void fb_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color);
+void fb_clear(uint32_t color);
+
+// Copy a width x height block of pixels, stride pixels per source row
+void fb_blit(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+             const uint32_t *pixels, uint32_t stride);
+
+// Move the screen contents up by lines rows and fill the exposed rows. The
+// back buffer is not copied, so the cost is that of the new rows alone (the
+// next flush still copies the whole screen).
+void fb_scroll(uint32_t lines, uint32_t color);
+
+// Back buffer row for direct drawing, valid until the next fb_scroll.
+// Callers must report what they touched with fb_damage so the next flush
+// picks it up.
+uint32_t *fb_row(uint32_t y);
+void fb_damage(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+// Copy all damaged rectangles to the screen and clear the damage list.
+// Interrupts are disabled for one band of rows at a time, not the whole copy.
+void fb_flush(void);
+
+// For fatal paths: non-zero if the framebuffer lock comes free within a
+// bounded wait. A lock the faulting CPU held is never released, and drawing
+// would spin on it forever.
+int fb_lock_available(void);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Built-in 8x8 bitmap font covering printable ASCII. Each glyph is eight
+// bytes, one per row from the top, most significant bit leftmost.
+
+#define FONT_WIDTH       8
+#define FONT_HEIGHT      8
+#define FONT_FIRST_CHAR  0x20
+#define FONT_LAST_CHAR   0x7E
+#define FONT_GLYPH_COUNT (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+
+extern const uint8_t font_glyphs[FONT_GLYPH_COUNT][FONT_HEIGHT];
@@ -0,0 +1,88 @@
+#include <stdint.h>
+
+#include "gdt.h"
+#include "memlayout.h"
+#include "percpu.h"
+#include "pmm.h"
+
+// One GDT for all CPUs: the flat kernel segments, then a 16-byte TSS
+// descriptor per CPU. Each CPU's TSS only supplies its IST stacks; with no
+// user mode there is no privilege-level stack to switch to.
+
+#define GDT_TSS_FIRST   3 // GDT index of CPU 0's TSS descriptor
+#define GDT_TSS_PRESENT 0x89ULL // Present, DPL 0, available 64-bit TSS
+
+#define IST_STACK_ORDER 1 // 8 KiB; enough for the fatal exception path
+
+typedef struct {
+  uint32_t reserved0;
+  uint64_t rsp[3];
+  uint64_t reserved1;
+  uint64_t ist[7];
+  uint64_t reserved2;
+  uint16_t reserved3;
+  uint16_t iomap_base;
+} __attribute__((packed)) xo_tss_t;
+
+typedef struct {
+  uint16_t limit;
+  uint64_t base;
+} __attribute__((packed)) xo_gdt_pointer_t;
+
+static uint64_t gdt[GDT_TSS_FIRST + 2 * MAX_CPUS] = {
+  0x0000000000000000ULL, // Null
+  0x00AF9A000000FFFFULL, // Kernel code: 64-bit, present, DPL 0
+  0x00CF92000000FFFFULL, // Kernel data
+};
+
+static xo_tss_t tss[MAX_CPUS] __attribute__((aligned(16)));
+
+void gdt_init(void) {
+  xo_gdt_pointer_t pointer = {
+    .limit = sizeof(gdt) - 1,
+    .base = (uint64_t)(uintptr_t)gdt,
+  };
+
+  __asm__ volatile ("lgdt %0" : : "m"(pointer));
+
+  // Reload CS with a far return, then the data segments
+  __asm__ volatile (
+    "pushq %0\n"
+    "leaq 1f(%%rip), %%rax\n"
+    "pushq %%rax\n"
+    "lretq\n"
+    "1:\n"
+    "movw %w1, %%ds\n"
+    "movw %w1, %%es\n"
+    "movw %w1, %%ss\n"
+    "xorl %%eax, %%eax\n"
+    "movw %%ax, %%fs\n"
+    "movw %%ax, %%gs\n"
+    :
+    : "i"(GDT_KERNEL_CODE), "r"(GDT_KERNEL_DATA)
+    : "rax", "memory");
+}
+
+int gdt_init_cpu(void) {
+  uint32_t cpu_id = this_cpu_id();
+  xo_tss_t *cpu_tss = &tss[cpu_id];
+
+  for (uint32_t i = 0; i < IST_STACKS; i++) {
+    uint64_t stack = pmm_alloc_pages(IST_STACK_ORDER);
+    if (!stack) {
+      return -1;
+    }
+    cpu_tss->ist[i] = (uint64_t)(uintptr_t)phys_to_virt(stack) + (PAGE_SIZE << IST_STACK_ORDER);
+  }
+  cpu_tss->iomap_base = sizeof(xo_tss_t); // No I/O permission bitmap
+
+  uint64_t base = (uint64_t)(uintptr_t)cpu_tss;
+  uint64_t limit = sizeof(xo_tss_t) - 1;
+  uint32_t index = GDT_TSS_FIRST + 2 * cpu_id;
+  gdt[index] = (limit & 0xFFFF) | (base & 0xFFFFFF) << 16 | GDT_TSS_PRESENT << 40 |
+               ((limit >> 16) & 0xF) << 48 | ((base >> 24) & 0xFF) << 56;
+  gdt[index + 1] = base >> 32;
+
+  __asm__ volatile ("ltr %w0" : : "r"(index * 8) : "memory");
+  return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+
+// Interrupt stack table slots (1-based, as IDT gates name them). Each CPU's
+// TSS gives these vectors a stack of their own, so they still run when the
+// interrupted stack is bad or overflowed.
+#define IST_NMI            1
+#define IST_DOUBLE_FAULT   2
+#define IST_MACHINE_CHECK  3
+#define IST_STACKS         3
+
+// Load the kernel's own GDT; the firmware's lives in memory we will reclaim
+void gdt_init(void);
+
+// Allocate the calling CPU's IST stacks and load its TSS. Requires pmm_init
+// and percpu_setup, and must run before the CPU loads the IDT. Returns 0 on
+// success, -1 if a stack could not be allocated.
+int gdt_init_cpu(void);
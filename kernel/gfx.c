@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "gfx.h"
+#include "simd.h"
+#include "../helpers/mem.h"
+
+static const xo_gfx_ops_t *vector_ops = NULL;
+
+static void fill_scalar(uint32_t *dst, uint32_t color, size_t count) {
+  __asm__ volatile ("rep stosl" : "+D"(dst), "+c"(count) : "a"(color) : "memory");
+}
+
+static void remap_scalar(uint32_t *dst, const uint32_t *src, size_t count, const xo_channel_map_t map[3]) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t pixel = src[i];
+    dst[i] = ((pixel >> map[0].right) & map[0].mask) << map[0].left |
+             ((pixel >> map[1].right) & map[1].mask) << map[1].left |
+             ((pixel >> map[2].right) & map[2].mask) << map[2].left;
+  }
+}
+
+// Map one 8-bit channel at native_shift in 0x00RRGGBB to a size-bit field at
+// shift, keeping the most significant bits either way
+static void channel_map(uint32_t native_shift, uint32_t size, uint32_t shift, int pack,
+                        xo_channel_map_t *map) {
+  if (size == 0) {
+    map->right = 0;
+    map->mask = 0;
+    map->left = 0;
+    return;
+  }
+
+  uint32_t narrow = size < 8 ? size : 8;
+  map->mask = (1u << narrow) - 1;
+  if (pack) {
+    map->right = native_shift + 8 - narrow;
+    map->left = shift + size - narrow;
+  } else {
+    map->right = shift + size - narrow;
+    map->left = native_shift + 8 - narrow;
+  }
+}
+
+static void format_map(const xo_pixel_format_t *format, int pack, xo_channel_map_t map[3]) {
+  channel_map(16, format->red_size, format->red_shift, pack, &map[0]);
+  channel_map(8, format->green_size, format->green_shift, pack, &map[1]);
+  channel_map(0, format->blue_size, format->blue_shift, pack, &map[2]);
+}
+
+static void remap_span(uint32_t *dst, const uint32_t *src, size_t count, const xo_pixel_format_t *format,
+                       int pack) {
+  xo_channel_map_t map[3];
+  format_map(format, pack, map);
+  if (!vector_ops || count < GFX_SIMD_MIN) {
+    remap_scalar(dst, src, count, map);
+    return;
+  }
+  simd_begin();
+  vector_ops->remap(dst, src, count, map);
+  simd_end();
+}
+
+void gfx_init(void) {
+  vector_ops = simd_has_avx2() ? &gfx_avx2_ops : &gfx_sse2_ops;
+}
+
+void gfx_force_scalar(void) {
+  __atomic_store_n(&vector_ops, NULL, __ATOMIC_RELEASE);
+}
+
+const char *gfx_backend(void) {
+  return vector_ops ? vector_ops->name : "scalar";
+}
+
+void gfx_pixel_format(const xo_graphics_info_t *graphics, xo_pixel_format_t *format) {
+  format->red_size = (uint8_t)graphics->red_mask_size;
+  format->red_shift = (uint8_t)graphics->red_field_position;
+  format->green_size = (uint8_t)graphics->green_mask_size;
+  format->green_shift = (uint8_t)graphics->green_field_position;
+  format->blue_size = (uint8_t)graphics->blue_mask_size;
+  format->blue_shift = (uint8_t)graphics->blue_field_position;
+}
+
+int gfx_format_is_native(const xo_pixel_format_t *format) {
+  return format->red_size == 8 && format->red_shift == 16 &&
+         format->green_size == 8 && format->green_shift == 8 &&
+         format->blue_size == 8 && format->blue_shift == 0;
+}
+
+void gfx_fill_span(uint32_t *dst, uint32_t color, size_t count) {
+  if (!vector_ops || count < GFX_SIMD_MIN) {
+    fill_scalar(dst, color, count);
+    return;
+  }
+  simd_begin();
+  vector_ops->fill(dst, color, count);
+  simd_end();
+}
+
+void gfx_copy_span(uint32_t *dst, const uint32_t *src, size_t count) {
+  if (!vector_ops || count < GFX_SIMD_MIN) {
+    memcpy(dst, src, count * sizeof(uint32_t));
+    return;
+  }
+  simd_begin();
+  vector_ops->copy(dst, src, count);
+  simd_end();
+}
+
+void gfx_pack_span(uint32_t *dst, const uint32_t *src, size_t count, const xo_pixel_format_t *format) {
+  remap_span(dst, src, count, format, 1);
+}
+
+void gfx_unpack_span(uint32_t *dst, const uint32_t *src, size_t count, const xo_pixel_format_t *format) {
+  remap_span(dst, src, count, format, 0);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "boot_info.h"
+
+// 32-bit pixel span primitives. Kernel-side pixels are 0x00RRGGBB; a
+// xo_pixel_format_t describes the framebuffer's layout so spans can be
+// packed into it (and unpacked back). gfx_init picks AVX2, SSE2 or scalar
+// code; spans shorter than GFX_SIMD_MIN always take the scalar path.
+//
+// Vector paths run inside simd_begin/simd_end. Each call enters its own
+// section, so callers looping over many rows should wrap the loop in one
+// section to pay for the state save once.
+
+#define GFX_SIMD_MIN 16
+
+typedef struct {
+  uint8_t red_size;
+  uint8_t red_shift;
+  uint8_t green_size;
+  uint8_t green_shift;
+  uint8_t blue_size;
+  uint8_t blue_shift;
+} xo_pixel_format_t;
+
+// Per-channel move used by pack and unpack:
+// out |= ((pixel >> right) & mask) << left
+typedef struct {
+  uint32_t right;
+  uint32_t mask;
+  uint32_t left;
+} xo_channel_map_t;
+
+typedef struct {
+  const char *name;
+  void (*fill)(uint32_t *dst, uint32_t color, size_t count);
+  void (*copy)(uint32_t *dst, const uint32_t *src, size_t count);
+  void (*remap)(uint32_t *dst, const uint32_t *src, size_t count, const xo_channel_map_t map[3]);
+} xo_gfx_ops_t;
+
+// Vector backends; count is at least GFX_SIMD_MIN
+extern const xo_gfx_ops_t gfx_sse2_ops;
+extern const xo_gfx_ops_t gfx_avx2_ops;
+
+// Select the backend. Requires simd_init_cpu on the boot CPU.
+void gfx_init(void);
+const char *gfx_backend(void);
+
+// Use the scalar paths from now on (fatal paths, with simd_disable)
+void gfx_force_scalar(void);
+
+void gfx_pixel_format(const xo_graphics_info_t *graphics, xo_pixel_format_t *format);
+
+// True when the format is 0x00RRGGBB and packing is a plain copy
+int gfx_format_is_native(const xo_pixel_format_t *format);
+
+void gfx_fill_span(uint32_t *dst, uint32_t color, size_t count);
+
+// Spans must not overlap
+void gfx_copy_span(uint32_t *dst, const uint32_t *src, size_t count);
+void gfx_pack_span(uint32_t *dst, const uint32_t *src, size_t count, const xo_pixel_format_t *format);
+void gfx_unpack_span(uint32_t *dst, const uint32_t *src, size_t count, const xo_pixel_format_t *format);
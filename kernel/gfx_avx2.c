@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+#include "gfx.h"
+
+// AVX2 span kernels, eight pixels per vector; same structure as gfx_sse2.c.
+// Every function relies on count >= GFX_SIMD_MIN.
+
+static inline size_t align_skew(const uint32_t *dst) {
+  return ((32 - ((uintptr_t)dst & 31)) & 31) / 4;
+}
+
+static void fill_avx2(uint32_t *dst, uint32_t color, size_t count) {
+  __m256i value = _mm256_set1_epi32((int)color);
+  _mm256_storeu_si256((__m256i*)dst, value);
+  _mm256_storeu_si256((__m256i*)(dst + count - 8), value);
+
+  size_t i = align_skew(dst);
+  for (; i + 32 <= count; i += 32) {
+    _mm256_store_si256((__m256i*)(dst + i), value);
+    _mm256_store_si256((__m256i*)(dst + i + 8), value);
+    _mm256_store_si256((__m256i*)(dst + i + 16), value);
+    _mm256_store_si256((__m256i*)(dst + i + 24), value);
+  }
+  for (; i + 8 <= count; i += 8) {
+    _mm256_store_si256((__m256i*)(dst + i), value);
+  }
+}
+
+static void copy_avx2(uint32_t *dst, const uint32_t *src, size_t count) {
+  __m256i head = _mm256_loadu_si256((const __m256i*)src);
+  __m256i tail = _mm256_loadu_si256((const __m256i*)(src + count - 8));
+
+  size_t i = align_skew(dst);
+  for (; i + 32 <= count; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 24));
+    _mm256_store_si256((__m256i*)(dst + i), a);
+    _mm256_store_si256((__m256i*)(dst + i + 8), b);
+    _mm256_store_si256((__m256i*)(dst + i + 16), c);
+    _mm256_store_si256((__m256i*)(dst + i + 24), d);
+  }
+  for (; i + 8 <= count; i += 8) {
+    _mm256_store_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+  }
+
+  _mm256_storeu_si256((__m256i*)dst, head);
+  _mm256_storeu_si256((__m256i*)(dst + count - 8), tail);
+}
+
+static inline __m256i remap_vector(__m256i pixels, const __m128i shifts[6], const __m256i masks[3]) {
+  __m256i out = _mm256_setzero_si256();
+  for (int c = 0; c < 3; c++) {
+    __m256i channel = _mm256_and_si256(_mm256_srl_epi32(pixels, shifts[c * 2]), masks[c]);
+    out = _mm256_or_si256(out, _mm256_sll_epi32(channel, shifts[c * 2 + 1]));
+  }
+  return out;
+}
+
+static void remap_avx2(uint32_t *dst, const uint32_t *src, size_t count, const xo_channel_map_t map[3]) {
+  __m128i shifts[6];
+  __m256i masks[3];
+  for (int c = 0; c < 3; c++) {
+    shifts[c * 2] = _mm_cvtsi32_si128((int)map[c].right);
+    shifts[c * 2 + 1] = _mm_cvtsi32_si128((int)map[c].left);
+    masks[c] = _mm256_set1_epi32((int)map[c].mask);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), remap_vector(pixels, shifts, masks));
+  }
+  if (i < count) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + count - 8));
+    _mm256_storeu_si256((__m256i*)(dst + count - 8), remap_vector(pixels, shifts, masks));
+  }
+}
+
+const xo_gfx_ops_t gfx_avx2_ops = {
+  .name = "avx2",
+  .fill = fill_avx2,
+  .copy = copy_avx2,
+  .remap = remap_avx2,
+};
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <emmintrin.h>
+
+#include "gfx.h"
+
+// SSE2 span kernels. The first and last four pixels are handled with
+// unaligned accesses that may overlap the body; the body uses aligned
+// stores. Every function relies on count >= GFX_SIMD_MIN.
+
+static inline size_t align_skew(const uint32_t *dst) {
+  return ((16 - ((uintptr_t)dst & 15)) & 15) / 4;
+}
+
+static void fill_sse2(uint32_t *dst, uint32_t color, size_t count) {
+  __m128i value = _mm_set1_epi32((int)color);
+  _mm_storeu_si128((__m128i*)dst, value);
+  _mm_storeu_si128((__m128i*)(dst + count - 4), value);
+
+  size_t i = align_skew(dst);
+  for (; i + 16 <= count; i += 16) {
+    _mm_store_si128((__m128i*)(dst + i), value);
+    _mm_store_si128((__m128i*)(dst + i + 4), value);
+    _mm_store_si128((__m128i*)(dst + i + 8), value);
+    _mm_store_si128((__m128i*)(dst + i + 12), value);
+  }
+  for (; i + 4 <= count; i += 4) {
+    _mm_store_si128((__m128i*)(dst + i), value);
+  }
+}
+
+static void copy_sse2(uint32_t *dst, const uint32_t *src, size_t count) {
+  __m128i head = _mm_loadu_si128((const __m128i*)src);
+  __m128i tail = _mm_loadu_si128((const __m128i*)(src + count - 4));
+
+  size_t i = align_skew(dst);
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+    __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 8));
+    __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 12));
+    _mm_store_si128((__m128i*)(dst + i), a);
+    _mm_store_si128((__m128i*)(dst + i + 4), b);
+    _mm_store_si128((__m128i*)(dst + i + 8), c);
+    _mm_store_si128((__m128i*)(dst + i + 12), d);
+  }
+  for (; i + 4 <= count; i += 4) {
+    _mm_store_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+  }
+
+  _mm_storeu_si128((__m128i*)dst, head);
+  _mm_storeu_si128((__m128i*)(dst + count - 4), tail);
+}
+
+static inline __m128i remap_vector(__m128i pixels, const __m128i shifts[6], const __m128i masks[3]) {
+  __m128i out = _mm_setzero_si128();
+  for (int c = 0; c < 3; c++) {
+    __m128i channel = _mm_and_si128(_mm_srl_epi32(pixels, shifts[c * 2]), masks[c]);
+    out = _mm_or_si128(out, _mm_sll_epi32(channel, shifts[c * 2 + 1]));
+  }
+  return out;
+}
+
+static void remap_sse2(uint32_t *dst, const uint32_t *src, size_t count, const xo_channel_map_t map[3]) {
+  __m128i shifts[6];
+  __m128i masks[3];
+  for (int c = 0; c < 3; c++) {
+    shifts[c * 2] = _mm_cvtsi32_si128((int)map[c].right);
+    shifts[c * 2 + 1] = _mm_cvtsi32_si128((int)map[c].left);
+    masks[c] = _mm_set1_epi32((int)map[c].mask);
+  }
+
+  // Source and destination do not overlap, so recomputing the last vector
+  // over pixels already written is harmless
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), remap_vector(pixels, shifts, masks));
+  }
+  if (i < count) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)(src + count - 4));
+    _mm_storeu_si128((__m128i*)(dst + count - 4), remap_vector(pixels, shifts, masks));
+  }
+}
+
+const xo_gfx_ops_t gfx_sse2_ops = {
+  .name = "sse2",
+  .fill = fill_sse2,
+  .copy = copy_sse2,
+  .remap = remap_sse2,
+};
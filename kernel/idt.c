@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include "idt.h"
+#include "gdt.h"
+
+#define IDT_TYPE_INTERRUPT_GATE 0x8E // Present, DPL 0, 64-bit interrupt gate
+
+typedef struct {
+  uint16_t offset_low;
+  uint16_t selector;
+  uint8_t ist;
+  uint8_t type_attributes;
+  uint16_t offset_middle;
+  uint32_t offset_high;
+  uint32_t reserved;
+} __attribute__((packed)) xo_idt_gate_t;
+
+typedef struct {
+  uint16_t limit;
+  uint64_t base;
+} __attribute__((packed)) xo_idt_pointer_t;
+
+// Entry stubs (isr.S): one ISR_STUB_SIZE-byte stub per vector, all of
+// which funnel into irq_dispatch
+#define ISR_STUB_SIZE 16 // Must match isr.S
+extern char isr_stubs[];
+
+static xo_idt_gate_t idt[IDT_ENTRIES] __attribute__((aligned(16)));
+
+void idt_set_gate(uint8_t vector, void (*handler)(void)) {
+  uint64_t address = (uint64_t)(uintptr_t)handler;
+  xo_idt_gate_t *gate = &idt[vector];
+
+  gate->offset_low = (uint16_t)address;
+  gate->selector = GDT_KERNEL_CODE;
+  gate->ist = 0;
+  gate->type_attributes = IDT_TYPE_INTERRUPT_GATE;
+  gate->offset_middle = (uint16_t)(address >> 16);
+  gate->offset_high = (uint32_t)(address >> 32);
+  gate->reserved = 0;
+}
+
+void idt_load(void) {
+  xo_idt_pointer_t pointer = {
+    .limit = sizeof(idt) - 1,
+    .base = (uint64_t)(uintptr_t)idt,
+  };
+  __asm__ volatile ("lidt %0" : : "m"(pointer));
+}
+
+void idt_init(void) {
+  for (uint32_t vector = 0; vector < IDT_ENTRIES; vector++) {
+    idt_set_gate((uint8_t)vector, (void (*)(void))(isr_stubs + vector * ISR_STUB_SIZE));
+  }
+
+  // These can arrive on a stack that is unusable, or in the middle of
+  // another handler's entry; give them the CPU's own IST stacks
+  idt[VECTOR_NMI].ist = IST_NMI;
+  idt[VECTOR_DOUBLE_FAULT].ist = IST_DOUBLE_FAULT;
+  idt[VECTOR_MACHINE_CHECK].ist = IST_MACHINE_CHECK;
+  idt_load();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#define IDT_ENTRIES 256
+
+// Interrupt vectors. 0-31 are CPU exceptions. ISA IRQ n is routed through
+// the IOAPIC to VECTOR_IRQ_BASE + n; the legacy PICs are remapped out of the
+// way to VECTOR_PIC_BASE and masked.
+#define VECTOR_NMI           2
+#define VECTOR_DOUBLE_FAULT  8
+#define VECTOR_MACHINE_CHECK 18
+#define VECTOR_EXCEPTIONS    32
+#define VECTOR_TIMER         0x20
+#define VECTOR_IRQ_BASE      0x30
+#define VECTOR_PIC_BASE      0xE0
+#define VECTOR_RESCHEDULE    0xF0
+#define VECTOR_SPURIOUS      0xFF
+
+// Point every vector at its entry stub and load the IDT on the bootstrap
+// processor. Handlers are attached with irq_register.
+void idt_init(void);
+
+// Load the shared IDT on the calling CPU
+void idt_load(void);
+
+void idt_set_gate(uint8_t vector, void (*handler)(void));
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "initrd.h"
+#include "memlayout.h"
+#include "../helpers/mem.h"
+
+static const uint8_t *archive = NULL;
+static const xo_initrd_entry_t *entries = NULL;
+static const char *strings = NULL;
+static uint32_t entry_count = 0;
+
+static uint32_t fnv1a(const char *s, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)s[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static size_t string_length(const char *s) {
+  size_t length = 0;
+  while (s[length]) {
+    length++;
+  }
+  return length;
+}
+
+// Order used by the index: hash first, then the name bytes
+static int compare_entry(const char *names, const xo_initrd_entry_t *entry,
+                         uint32_t hash, const char *name, size_t length) {
+  if (entry->hash != hash) {
+    return entry->hash < hash ? -1 : 1;
+  }
+  size_t common = entry->name_length < length ? entry->name_length : length;
+  int result = memcmp(names + entry->name_offset, name, common);
+  if (result || entry->name_length == length) {
+    return result;
+  }
+  return entry->name_length < length ? -1 : 1;
+}
+
+int initrd_init(uint64_t phys, uint64_t size) {
+  if (!phys || size < sizeof(xo_initrd_header_t)) {
+    return -1;
+  }
+
+  const uint8_t *base = (const uint8_t*)phys_to_virt(phys);
+  const xo_initrd_header_t *header = (const xo_initrd_header_t*)base;
+  if (header->magic != XO_INITRD_MAGIC || header->version != XO_INITRD_VERSION ||
+      header->total_size > size) {
+    return -1;
+  }
+
+  uint64_t index_end = sizeof(*header) + (uint64_t)header->entry_count * sizeof(xo_initrd_entry_t);
+  if (index_end > header->strings_offset || header->strings_offset > header->total_size) {
+    return -1;
+  }
+
+  // One pass over the index so lookups can trust it: every name and file
+  // must lie inside the archive and the entries must be in search order
+  const xo_initrd_entry_t *index = (const xo_initrd_entry_t*)(base + sizeof(*header));
+  const char *names = (const char*)(base + header->strings_offset);
+  uint64_t strings_size = header->total_size - header->strings_offset;
+  for (uint32_t i = 0; i < header->entry_count; i++) {
+    const xo_initrd_entry_t *entry = &index[i];
+    if ((uint64_t)entry->name_offset + entry->name_length >= strings_size ||
+        names[entry->name_offset + entry->name_length] != '\0' ||
+        entry->data_offset > header->total_size ||
+        entry->size > header->total_size - entry->data_offset ||
+        fnv1a(names + entry->name_offset, entry->name_length) != entry->hash) {
+      return -1;
+    }
+    if (i > 0 && compare_entry(names, &index[i - 1], entry->hash,
+                               names + entry->name_offset, entry->name_length) >= 0) {
+      return -1;
+    }
+  }
+
+  archive = base;
+  entries = index;
+  strings = names;
+  entry_count = header->entry_count;
+  return 0;
+}
+
+const void *initrd_find(const char *path, uint64_t *size) {
+  while (*path == '/') {
+    path++;
+  }
+  size_t length = string_length(path);
+  uint32_t hash = fnv1a(path, length);
+
+  uint32_t low = 0;
+  uint32_t high = entry_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int result = compare_entry(strings, &entries[middle], hash, path, length);
+    if (result == 0) {
+      if (size) {
+        *size = entries[middle].size;
+      }
+      return archive + entries[middle].data_offset;
+    }
+    if (result < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return NULL;
+}
+
+uint32_t initrd_file_count(void) {
+  return entry_count;
+}
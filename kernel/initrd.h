@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// Initrd archive, read in place from the pages the loader put it in.
+//
+//   header | entries[entry_count] | string table | file data
+//
+// Entries are sorted by (hash, name), where hash is the 32-bit FNV-1a of the
+// path without a leading '/'. A lookup is a binary search over the hashes and
+// a single name compare; file contents are returned as pointers into the
+// archive. Offsets are from the start of the archive, and file data starts
+// on a XO_INITRD_DATA_ALIGN boundary. tools/mkinitrd.py builds the image.
+
+#define XO_INITRD_MAGIC      0x445254494E494F58ULL // "XOINITRD"
+#define XO_INITRD_VERSION    1
+#define XO_INITRD_DATA_ALIGN 16
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint64_t strings_offset;
+  uint64_t total_size;
+} xo_initrd_header_t;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t name_offset; // From strings_offset; names are NUL-terminated
+  uint32_t name_length; // Excluding the NUL
+  uint32_t reserved;
+  uint64_t data_offset;
+  uint64_t size;
+} xo_initrd_entry_t;
+
+// Validate the archive at the given physical range. Returns 0 on success and
+// -1 if it is missing or malformed, in which case lookups find nothing.
+int initrd_init(uint64_t phys, uint64_t size);
+
+// Contents of the file at path (leading '/' optional), or NULL if absent
+const void *initrd_find(const char *path, uint64_t *size);
+
+uint32_t initrd_file_count(void);
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ioapic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "idt.h"
+#include "paging.h"
+#include "spinlock.h"
+
+#define IOAPIC_MAX        8
+#define IOAPIC_ISA_IRQS   16
+
+// Indirect register window
+#define IOAPIC_IOREGSEL   0x00
+#define IOAPIC_IOWIN      0x10
+
+#define IOAPIC_REG_VERSION 0x01
+#define IOAPIC_REG_REDIRECTION(pin) (0x10 + 2 * (pin))
+
+#define IOAPIC_MASKED     (1u << 16)
+
+// Legacy 8259 PICs
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+#define PIC_ICW1_INIT 0x11 // Edge triggered, cascaded, ICW4 follows
+#define PIC_ICW4_8086 0x01
+
+typedef struct {
+  volatile uint32_t *registers;
+  uint32_t gsi_base;
+  uint32_t pins;
+} xo_ioapic_t;
+
+typedef struct {
+  uint32_t gsi;
+  uint32_t flags; // IOAPIC_*
+} xo_isa_route_t;
+
+static xo_ioapic_t ioapics[IOAPIC_MAX];
+static uint32_t ioapic_count = 0;
+static xo_isa_route_t isa_routes[IOAPIC_ISA_IRQS];
+static spinlock_t ioapic_lock = SPINLOCK_INIT;
+
+static uint32_t ioapic_read(const xo_ioapic_t *ioapic, uint32_t reg) {
+  ioapic->registers[IOAPIC_IOREGSEL / 4] = reg;
+  return ioapic->registers[IOAPIC_IOWIN / 4];
+}
+
+static void ioapic_write(const xo_ioapic_t *ioapic, uint32_t reg, uint32_t value) {
+  ioapic->registers[IOAPIC_IOREGSEL / 4] = reg;
+  ioapic->registers[IOAPIC_IOWIN / 4] = value;
+}
+
+static const xo_ioapic_t *find_ioapic(uint32_t gsi) {
+  for (uint32_t i = 0; i < ioapic_count; i++) {
+    if (gsi >= ioapics[i].gsi_base && gsi - ioapics[i].gsi_base < ioapics[i].pins) {
+      return &ioapics[i];
+    }
+  }
+  return NULL;
+}
+
+// Move the PICs' vectors off the exception range (a spurious IRQ 7 would
+// otherwise arrive as a double fault) and mask every line
+static void disable_pics(void) {
+  outb(PIC1_COMMAND, PIC_ICW1_INIT);
+  outb(PIC2_COMMAND, PIC_ICW1_INIT);
+  outb(PIC1_DATA, VECTOR_PIC_BASE);
+  outb(PIC2_DATA, VECTOR_PIC_BASE + 8);
+  outb(PIC1_DATA, 4); // Slave on IRQ 2
+  outb(PIC2_DATA, 2); // Cascade identity
+  outb(PIC1_DATA, PIC_ICW4_8086);
+  outb(PIC2_DATA, PIC_ICW4_8086);
+  outb(PIC1_DATA, 0xFF);
+  outb(PIC2_DATA, 0xFF);
+}
+
+static void add_ioapic(const acpi_madt_io_apic_t *entry) {
+  if (ioapic_count >= IOAPIC_MAX) {
+    return;
+  }
+  xo_ioapic_t *ioapic = &ioapics[ioapic_count];
+  ioapic->registers = (volatile uint32_t*)paging_map_mmio(entry->io_apic_address, 0x1000);
+  if (!ioapic->registers) {
+    return;
+  }
+  ioapic->gsi_base = entry->gsi_base;
+  ioapic->pins = ((ioapic_read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+  for (uint32_t pin = 0; pin < ioapic->pins; pin++) {
+    ioapic_write(ioapic, IOAPIC_REG_REDIRECTION(pin), IOAPIC_MASKED);
+  }
+  ioapic_count++;
+}
+
+static void add_override(const acpi_madt_interrupt_override_t *entry) {
+  if (entry->bus != 0 || entry->source >= IOAPIC_ISA_IRQS) {
+    return;
+  }
+  xo_isa_route_t *route = &isa_routes[entry->source];
+  route->gsi = entry->gsi;
+  route->flags = 0;
+  if ((entry->flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW) {
+    route->flags |= IOAPIC_ACTIVE_LOW;
+  }
+  if ((entry->flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL) {
+    route->flags |= IOAPIC_LEVEL;
+  }
+}
+
+uint32_t ioapic_init(void) {
+  // ISA IRQs are identity-mapped, edge-triggered and active-high unless the
+  // MADT says otherwise
+  for (uint32_t irq = 0; irq < IOAPIC_ISA_IRQS; irq++) {
+    isa_routes[irq].gsi = irq;
+    isa_routes[irq].flags = 0;
+  }
+
+  const acpi_madt_t *madt = (const acpi_madt_t*)acpi_find_table("APIC");
+  if (!madt) {
+    return 0;
+  }
+  disable_pics();
+
+  const uint8_t *cursor = (const uint8_t*)madt + sizeof(acpi_madt_t);
+  const uint8_t *end = (const uint8_t*)madt + madt->header.length;
+  while (cursor + sizeof(acpi_madt_entry_t) <= end) {
+    const acpi_madt_entry_t *entry = (const acpi_madt_entry_t*)cursor;
+    if (entry->length < sizeof(acpi_madt_entry_t) || cursor + entry->length > end) {
+      break;
+    }
+    if (entry->type == ACPI_MADT_IO_APIC && entry->length >= sizeof(acpi_madt_io_apic_t)) {
+      add_ioapic((const acpi_madt_io_apic_t*)entry);
+    } else if (entry->type == ACPI_MADT_INTERRUPT_OVERRIDE &&
+               entry->length >= sizeof(acpi_madt_interrupt_override_t)) {
+      add_override((const acpi_madt_interrupt_override_t*)entry);
+    }
+    cursor += entry->length;
+  }
+
+  uint32_t pins = 0;
+  for (uint32_t i = 0; i < ioapic_count; i++) {
+    pins += ioapics[i].pins;
+  }
+  return pins;
+}
+
+int ioapic_route(uint32_t gsi, uint8_t vector, uint32_t apic_id, uint32_t flags) {
+  const xo_ioapic_t *ioapic = find_ioapic(gsi);
+  if (!ioapic || apic_id > 0xFF) {
+    return -1;
+  }
+  uint32_t pin = gsi - ioapic->gsi_base;
+
+  // Fixed delivery, physical destination. The low half holds the mask bit,
+  // so write the destination first.
+  uint64_t irq_flags = spin_lock_irqsave(&ioapic_lock);
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION(pin) + 1, apic_id << 24);
+  ioapic_write(ioapic, IOAPIC_REG_REDIRECTION(pin), vector | (flags & (IOAPIC_ACTIVE_LOW | IOAPIC_LEVEL)));
+  spin_unlock_irqrestore(&ioapic_lock, irq_flags);
+  return 0;
+}
+
+int ioapic_route_isa(uint8_t irq, uint8_t vector, uint32_t apic_id) {
+  if (irq >= IOAPIC_ISA_IRQS) {
+    return -1;
+  }
+  return ioapic_route(isa_routes[irq].gsi, vector, apic_id, isa_routes[irq].flags);
+}
+
+void ioapic_mask(uint32_t gsi) {
+  const xo_ioapic_t *ioapic = find_ioapic(gsi);
+  if (!ioapic) {
+    return;
+  }
+  uint32_t reg = IOAPIC_REG_REDIRECTION(gsi - ioapic->gsi_base);
+
+  uint64_t irq_flags = spin_lock_irqsave(&ioapic_lock);
+  ioapic_write(ioapic, reg, ioapic_read(ioapic, reg) | IOAPIC_MASKED);
+  spin_unlock_irqrestore(&ioapic_lock, irq_flags);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Redirection entry flags for ioapic_route; the default is edge-triggered,
+// active-high (ISA)
+#define IOAPIC_ACTIVE_LOW (1u << 13)
+#define IOAPIC_LEVEL      (1u << 15)
+
+// Find the IO APICs in the MADT, mask every pin, and remap and mask the
+// legacy 8259 PICs. Returns the number of pins found (0 without an MADT or
+// IO APIC, in which case no device interrupts can be routed).
+uint32_t ioapic_init(void);
+
+// Deliver a global system interrupt to one CPU (by APIC ID, which must fit
+// in 8 bits) on the given vector, and unmask it. Returns 0 on success, -1
+// if no IO APIC serves the GSI.
+int ioapic_route(uint32_t gsi, uint8_t vector, uint32_t apic_id, uint32_t flags);
+
+// Same for an ISA IRQ, following the MADT's interrupt source overrides
+int ioapic_route_isa(uint8_t irq, uint8_t vector, uint32_t apic_id);
+
+void ioapic_mask(uint32_t gsi);
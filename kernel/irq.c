@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "irq.h"
+#include "console.h"
+#include "cpu.h"
+#include "idt.h"
+#include "klog.h"
+#include "lapic.h"
+#include "memlayout.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "sched.h"
+#include "serial.h"
+#include "trace.h"
+#include "../helpers/mem.h"
+
+#define IRQ_STATS_ORDER 2 // 256 64-byte records in four pages
+
+static const char *const exception_names[VECTOR_EXCEPTIONS] = {
+  "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range",
+  "invalid opcode", "device not available", "double fault", "coprocessor overrun",
+  "invalid TSS", "segment not present", "stack fault", "general protection",
+  "page fault", "reserved", "x87 error", "alignment check", "machine check",
+  "SIMD error", "virtualization", "control protection",
+};
+
+static void spurious_interrupt(xo_irq_frame_t *frame);
+
+// Written before the vectors are unmasked and read on every interrupt
+static irq_handler_t handlers[IDT_ENTRIES] = {
+  [VECTOR_SPURIOUS] = spurious_interrupt,
+};
+
+// Spurious APIC interrupts must not be acknowledged
+static void spurious_interrupt(xo_irq_frame_t *frame) {
+  (void)frame;
+}
+
+// Nothing recovers from a CPU exception yet: report it and stop this CPU
+static __attribute__((noreturn)) void fatal_exception(xo_irq_frame_t *frame) {
+  uint64_t cr2;
+  __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+
+  // Interrupts stay off from here on: flush the serial ring by polling
+  serial_set_polled();
+  console_panic();
+
+  const char *name = exception_names[frame->vector];
+  klog("fault: %s (vector %lu, error 0x%lx) on cpu %u",
+       name ? name : "reserved", frame->vector, frame->error_code, this_cpu_id());
+  klog("fault: rip %016lx rsp %016lx cr2 %016lx", frame->rip, frame->rsp, cr2);
+  console_sync();
+
+  while (1) {
+    __asm__ volatile ("cli; hlt");
+  }
+}
+
+static void unexpected_interrupt(xo_irq_frame_t *frame) {
+  klog("irq: unexpected vector %lu on cpu %u", frame->vector, this_cpu_id());
+  lapic_eoi();
+}
+
+static uint32_t histogram_bucket(uint64_t cycles) {
+  if (cycles < (1ULL << IRQ_HISTOGRAM_SHIFT)) {
+    return 0;
+  }
+  uint32_t bucket = 64 - (uint32_t)__builtin_clzll(cycles) - IRQ_HISTOGRAM_SHIFT;
+  return bucket < IRQ_HISTOGRAM_BUCKETS ? bucket : IRQ_HISTOGRAM_BUCKETS - 1;
+}
+
+void irq_register(uint8_t vector, irq_handler_t handler) {
+  __atomic_store_n(&handlers[vector], handler, __ATOMIC_RELEASE);
+}
+
+int irq_init_cpu(void) {
+  uint64_t phys = pmm_alloc_pages(IRQ_STATS_ORDER);
+  if (!phys) {
+    return -1;
+  }
+  xo_irq_stats_t *stats = (xo_irq_stats_t*)phys_to_virt(phys);
+  memset(stats, 0, IDT_ENTRIES * sizeof(xo_irq_stats_t));
+  __atomic_store_n(&this_cpu()->irq_stats, stats, __ATOMIC_RELEASE);
+  return 0;
+}
+
+void irq_dispatch(xo_irq_frame_t *frame) {
+  uint64_t start = rdtsc();
+  uint8_t vector = (uint8_t)frame->vector;
+
+  irq_handler_t handler = handlers[vector];
+  if (handler) {
+    handler(frame);
+  } else if (vector < VECTOR_EXCEPTIONS) {
+    fatal_exception(frame);
+  } else {
+    unexpected_interrupt(frame);
+  }
+
+  // Plain increments: only this CPU writes its records, with interrupts off
+  uint64_t cycles = rdtsc() - start;
+  xo_irq_stats_t *stats = this_cpu()->irq_stats;
+  if (stats) {
+    stats += vector;
+    stats->count++;
+    stats->cycles += cycles;
+    stats->histogram[histogram_bucket(cycles)]++;
+  }
+
+  trace(TRACE_IRQ, vector, cycles);
+
+  // Switch threads on the way out if the handler asked for it
+  sched_irq_exit();
+}
+
+void irq_stats(uint8_t vector, xo_irq_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (uint32_t i = 0; i < MAX_CPUS; i++) {
+    const xo_irq_stats_t *cpu_stats = __atomic_load_n(&cpu_area(i)->irq_stats, __ATOMIC_ACQUIRE);
+    if (!cpu_stats) {
+      continue;
+    }
+    cpu_stats += vector;
+    stats->count += __atomic_load_n(&cpu_stats->count, __ATOMIC_RELAXED);
+    stats->cycles += __atomic_load_n(&cpu_stats->cycles, __ATOMIC_RELAXED);
+    for (uint32_t b = 0; b < IRQ_HISTOGRAM_BUCKETS; b++) {
+      stats->histogram[b] += __atomic_load_n(&cpu_stats->histogram[b], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Upper bound of the bucket holding the given fraction of samples
+static uint64_t histogram_percentile(const xo_irq_stats_t *stats, uint32_t percent) {
+  uint64_t total = 0;
+  for (uint32_t b = 0; b < IRQ_HISTOGRAM_BUCKETS; b++) {
+    total += stats->histogram[b];
+  }
+
+  uint64_t target = (total * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (uint32_t b = 0; b < IRQ_HISTOGRAM_BUCKETS; b++) {
+    seen += stats->histogram[b];
+    if (seen >= target) {
+      return 1ULL << (IRQ_HISTOGRAM_SHIFT + b);
+    }
+  }
+  return 1ULL << (IRQ_HISTOGRAM_SHIFT + IRQ_HISTOGRAM_BUCKETS - 1);
+}
+
+void irq_report(void) {
+  xo_irq_stats_t stats;
+  for (uint32_t vector = 0; vector < IDT_ENTRIES; vector++) {
+    irq_stats((uint8_t)vector, &stats);
+    if (!stats.count) {
+      continue;
+    }
+    klog("irq: vector 0x%02x: %lu, mean %lu cycles, p50 <%lu, p99 <%lu", vector,
+         stats.count, stats.cycles / stats.count,
+         histogram_percentile(&stats, 50), histogram_percentile(&stats, 99));
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// Interrupt dispatch. Every vector enters through the same stub path and
+// lands in irq_dispatch, which calls the registered handler and charges the
+// cycles it took to a per-CPU, per-vector record. Handlers run with
+// interrupts disabled and must send their own EOI.
+
+// Cycle histogram: bucket 0 counts handlers that took under
+// 2^IRQ_HISTOGRAM_SHIFT cycles, each later bucket twice the range of the one
+// before, and the last bucket everything above
+#define IRQ_HISTOGRAM_BUCKETS 12
+#define IRQ_HISTOGRAM_SHIFT   7
+
+// Register state saved by the entry stub (isr.S), lowest address first
+typedef struct {
+  uint64_t r11, r10, r9, r8;
+  uint64_t rdi, rsi, rdx, rcx, rax;
+  uint64_t vector;
+  uint64_t error_code; // Zero unless the CPU pushed one
+  uint64_t rip, cs, rflags, rsp, ss;
+} xo_irq_frame_t;
+
+typedef void (*irq_handler_t)(xo_irq_frame_t *frame);
+
+// One cache line per vector per CPU; only the owning CPU writes it
+typedef struct xo_irq_stats {
+  uint64_t count;
+  uint64_t cycles;
+  uint32_t histogram[IRQ_HISTOGRAM_BUCKETS];
+} xo_irq_stats_t;
+
+// Attach a handler to a vector, replacing the default one
+void irq_register(uint8_t vector, irq_handler_t handler);
+
+// Allocate the calling CPU's statistics. Interrupts taken before this are
+// dispatched but not counted. Returns 0 on success.
+int irq_init_cpu(void);
+
+// Called by the entry stubs with interrupts disabled
+void irq_dispatch(xo_irq_frame_t *frame);
+
+// Sum one vector's statistics over all CPUs. The result is a snapshot, not
+// an atomic one.
+void irq_stats(uint8_t vector, xo_irq_stats_t *stats);
+
+// Log count, mean and approximate median and 99th percentile cycles for
+// every vector that has fired
+void irq_report(void);
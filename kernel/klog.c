@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#include "klog.h"
+#include "spinlock.h"
+
+// Kernel log: formatted lines appended to a fixed ring. The write position
+// only grows, so a reader tracks an absolute offset and can tell how much it
+// missed if it fell a full ring behind.
+
+#define KLOG_LINE_MAX     256
+#define KLOG_MAX_LISTENERS 4
+
+static char log_buffer[KLOG_BUFFER_SIZE];
+static size_t log_head = 0; // Total bytes ever written
+static spinlock_t log_lock = SPINLOCK_INIT;
+static klog_listener_t log_listeners[KLOG_MAX_LISTENERS];
+static uint32_t listener_count = 0;
+
+typedef struct {
+  char *buffer;
+  size_t size;
+  size_t length;
+} xo_format_out_t;
+
+static void out_char(xo_format_out_t *out, char c) {
+  if (out->length + 1 < out->size) {
+    out->buffer[out->length] = c;
+  }
+  out->length++;
+}
+
+static void out_number(xo_format_out_t *out, uint64_t value, uint32_t base, int upper,
+                       int negative, uint32_t width, char pad) {
+  const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char temp[24];
+  uint32_t count = 0;
+
+  do {
+    temp[count++] = digits[value % base];
+    value /= base;
+  } while (value);
+
+  uint32_t length = count + (negative ? 1 : 0);
+  if (negative && pad == '0') {
+    out_char(out, '-');
+  }
+  for (; length < width; length++) {
+    out_char(out, pad);
+  }
+  if (negative && pad != '0') {
+    out_char(out, '-');
+  }
+  while (count) {
+    out_char(out, temp[--count]);
+  }
+}
+
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args) {
+  xo_format_out_t out = { buffer, size, 0 };
+
+  for (const char *p = format; *p; p++) {
+    if (*p != '%') {
+      out_char(&out, *p);
+      continue;
+    }
+    p++;
+
+    char pad = ' ';
+    if (*p == '0') {
+      pad = '0';
+      p++;
+    }
+
+    uint32_t width = 0;
+    while (*p >= '0' && *p <= '9') {
+      width = width * 10 + (uint32_t)(*p - '0');
+      p++;
+    }
+
+    int is_long = 0;
+    while (*p == 'l' || *p == 'z') {
+      is_long = 1;
+      p++;
+    }
+
+    switch (*p) {
+      case 'd':
+      case 'i': {
+        int64_t value = is_long ? va_arg(args, int64_t) : va_arg(args, int);
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+        out_number(&out, magnitude, 10, 0, value < 0, width, pad);
+        break;
+      }
+      case 'u':
+      case 'x':
+      case 'X': {
+        uint64_t value = is_long ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+        out_number(&out, value, *p == 'u' ? 10 : 16, *p == 'X', 0, width, pad);
+        break;
+      }
+      case 'p':
+        out_char(&out, '0');
+        out_char(&out, 'x');
+        out_number(&out, (uint64_t)(uintptr_t)va_arg(args, void*), 16, 0, 0, 16, '0');
+        break;
+      case 'c':
+        out_char(&out, (char)va_arg(args, int));
+        break;
+      case 's': {
+        const char *string = va_arg(args, const char*);
+        if (!string) {
+          string = "(null)";
+        }
+        uint32_t length = 0;
+        while (string[length]) {
+          length++;
+        }
+        for (; length < width; length++) {
+          out_char(&out, ' ');
+        }
+        while (*string) {
+          out_char(&out, *string++);
+        }
+        break;
+      }
+      case '%':
+        out_char(&out, '%');
+        break;
+      case '\0':
+        p--;
+        break;
+      default:
+        out_char(&out, '%');
+        out_char(&out, *p);
+        break;
+    }
+  }
+
+  if (size) {
+    buffer[out.length < size ? out.length : size - 1] = '\0';
+  }
+  return (int)out.length;
+}
+
+int ksnprintf(char *buffer, size_t size, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = kvsnprintf(buffer, size, format, args);
+  va_end(args);
+  return length;
+}
+
+void klog(const char *format, ...) {
+  char line[KLOG_LINE_MAX];
+  va_list args;
+  va_start(args, format);
+  int length = kvsnprintf(line, sizeof(line) - 1, format, args);
+  va_end(args);
+
+  if (length > (int)sizeof(line) - 2) {
+    length = (int)sizeof(line) - 2;
+  }
+  line[length++] = '\n';
+
+  uint64_t flags = spin_lock_irqsave(&log_lock);
+  for (int i = 0; i < length; i++) {
+    log_buffer[(log_head + (size_t)i) & (KLOG_BUFFER_SIZE - 1)] = line[i];
+  }
+  log_head += (size_t)length;
+  spin_unlock_irqrestore(&log_lock, flags);
+
+  uint32_t count = __atomic_load_n(&listener_count, __ATOMIC_ACQUIRE);
+  for (uint32_t i = 0; i < count; i++) {
+    log_listeners[i]();
+  }
+}
+
+int klog_add_listener(klog_listener_t listener) {
+  uint64_t flags = spin_lock_irqsave(&log_lock);
+  if (listener_count == KLOG_MAX_LISTENERS) {
+    spin_unlock_irqrestore(&log_lock, flags);
+    return -1;
+  }
+  // Publish the slot before the count that makes klog call it
+  log_listeners[listener_count] = listener;
+  __atomic_store_n(&listener_count, listener_count + 1, __ATOMIC_RELEASE);
+  spin_unlock_irqrestore(&log_lock, flags);
+  return 0;
+}
+
+size_t klog_read(size_t *position, char *buffer, size_t size) {
+  uint64_t flags = spin_lock_irqsave(&log_lock);
+
+  if (log_head - *position > KLOG_BUFFER_SIZE) {
+    *position = log_head - KLOG_BUFFER_SIZE;
+  }
+
+  size_t count = 0;
+  while (count < size && *position < log_head) {
+    buffer[count++] = log_buffer[*position & (KLOG_BUFFER_SIZE - 1)];
+    (*position)++;
+  }
+
+  spin_unlock_irqrestore(&log_lock, flags);
+  return count;
+}
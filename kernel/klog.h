@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#define KLOG_BUFFER_SIZE 16384 // Power of two
+
+// printf-style formatting: %d %i %u %x %X %c %s %p %%, with optional '0'
+// flag, field width and l/ll/z length modifiers. Output is truncated to the
+// buffer size and always NUL-terminated; the untruncated length is returned.
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args);
+int ksnprintf(char *buffer, size_t size, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Append a formatted line to the kernel log ring
+void klog(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Called after every line is appended, outside the log lock, on whichever
+// CPU logged it (possibly in interrupt context). Listeners cannot be removed.
+// Returns 0 on success, -1 when all slots are taken.
+typedef void (*klog_listener_t)(void);
+int klog_add_listener(klog_listener_t listener);
+
+// Copy out up to size bytes of log text starting at absolute offset
+// *position and advance it. Text that has already been overwritten is
+// skipped. Returns the number of bytes copied.
+size_t klog_read(size_t *position, char *buffer, size_t size);
@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kmalloc.h"
+#include "cpu.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "spinlock.h"
+
+// Slab allocator with per-CPU magazine caches.
+//
+// Each size class is backed by single-page slabs whose header sits at the
+// start of the page, so kfree finds an object's slab by masking its address.
+// In front of the slabs every CPU holds two magazines (small stacks of free
+// objects). The common kmalloc/kfree path only pops or pushes the current
+// CPU's magazine with interrupts disabled and takes no lock. Full and empty
+// magazines are traded with a per-cache depot under the cache lock, and the
+// depot refills from (or drains to) the slab layer in batches.
+
+#define SLAB_MAGIC  0x534C4142u // "SLAB"
+#define LARGE_MAGIC 0x4C415247u // "LARG"
+
+#define SLAB_HEADER_SIZE  64
+#define LARGE_HEADER_SIZE 16
+#define CACHE_LINE_SIZE   64
+
+#define MAGAZINE_SIZE  30
+#define DEPOT_MAX_FULL 8 // Full magazines kept in a depot before draining to slabs
+
+typedef struct xo_slab {
+  uint32_t magic;
+  uint32_t cache_index;
+  uint32_t in_use;
+  uint32_t reserved;
+  void *free_list;
+  struct xo_slab *next; // Partial list links
+  struct xo_slab *prev;
+} xo_slab_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t order;
+} xo_large_header_t;
+
+typedef struct xo_magazine {
+  struct xo_magazine *next;
+  uint32_t rounds;
+  uint32_t reserved;
+  void *objects[MAGAZINE_SIZE];
+} xo_magazine_t;
+
+// Invariant: previous is always either completely full or completely empty
+typedef struct {
+  xo_magazine_t *loaded;
+  xo_magazine_t *previous;
+} __attribute__((aligned(CACHE_LINE_SIZE))) xo_cpu_cache_t;
+
+typedef struct {
+  xo_cpu_cache_t cpu[MAX_CPUS];
+  spinlock_t lock; // Protects the depot and the slab lists
+  uint32_t object_size;
+  uint32_t objects_per_slab;
+  uint32_t index;
+  uint32_t full_count;
+  xo_slab_t *partial; // Slabs with at least one free object
+  xo_magazine_t *full_magazines;
+  xo_magazine_t *empty_magazines;
+} xo_kmem_cache_t;
+
+_Static_assert(sizeof(xo_slab_t) <= SLAB_HEADER_SIZE, "slab header too large");
+_Static_assert(sizeof(xo_large_header_t) <= LARGE_HEADER_SIZE, "large header too large");
+
+static const uint32_t size_classes[] = {
+  8, 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+#define SIZE_CLASS_COUNT (sizeof(size_classes) / sizeof(size_classes[0]))
+
+static xo_kmem_cache_t caches[SIZE_CLASS_COUNT];
+static uint8_t size_index[KMALLOC_MAX_SMALL / 8 + 1]; // (size + 7) / 8 -> cache
+
+// Magazines are carved out of whole pages and never returned
+static spinlock_t magazine_lock = SPINLOCK_INIT;
+static xo_magazine_t *free_magazines = NULL;
+
+static xo_magazine_t *magazine_alloc(void) {
+  spin_lock(&magazine_lock);
+
+  if (!free_magazines) {
+    uint64_t phys = pmm_alloc_page();
+    if (!phys) {
+      spin_unlock(&magazine_lock);
+      return NULL;
+    }
+
+    xo_magazine_t *page = (xo_magazine_t*)phys_to_virt(phys);
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(xo_magazine_t); i++) {
+      page[i].next = free_magazines;
+      free_magazines = &page[i];
+    }
+  }
+
+  xo_magazine_t *magazine = free_magazines;
+  free_magazines = magazine->next;
+  spin_unlock(&magazine_lock);
+
+  magazine->next = NULL;
+  magazine->rounds = 0;
+  return magazine;
+}
+
+// Slab layer (caller holds cache->lock)
+static void slab_link(xo_kmem_cache_t *cache, xo_slab_t *slab) {
+  slab->prev = NULL;
+  slab->next = cache->partial;
+  if (cache->partial) {
+    cache->partial->prev = slab;
+  }
+  cache->partial = slab;
+}
+
+static void slab_unlink(xo_kmem_cache_t *cache, xo_slab_t *slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    cache->partial = slab->next;
+  }
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+  slab->next = NULL;
+  slab->prev = NULL;
+}
+
+static xo_slab_t *slab_create(xo_kmem_cache_t *cache) {
+  uint64_t phys = pmm_alloc_page();
+  if (!phys) {
+    return NULL;
+  }
+
+  xo_slab_t *slab = (xo_slab_t*)phys_to_virt(phys);
+  slab->magic = SLAB_MAGIC;
+  slab->cache_index = cache->index;
+  slab->in_use = 0;
+  slab->free_list = NULL;
+
+  // Thread the free list so that objects are handed out in address order
+  uint8_t *objects = (uint8_t*)slab + SLAB_HEADER_SIZE;
+  for (uint32_t i = cache->objects_per_slab; i-- > 0;) {
+    void **object = (void**)(objects + i * cache->object_size);
+    *object = slab->free_list;
+    slab->free_list = object;
+  }
+
+  slab_link(cache, slab);
+  return slab;
+}
+
+static void *slab_alloc_object(xo_kmem_cache_t *cache) {
+  xo_slab_t *slab = cache->partial;
+  if (!slab) {
+    slab = slab_create(cache);
+    if (!slab) {
+      return NULL;
+    }
+  }
+
+  void **object = (void**)slab->free_list;
+  slab->free_list = *object;
+  slab->in_use++;
+  if (!slab->free_list) {
+    slab_unlink(cache, slab);
+  }
+  return object;
+}
+
+static void slab_free_object(xo_kmem_cache_t *cache, void *ptr) {
+  xo_slab_t *slab = (xo_slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+
+  if (!slab->free_list) {
+    slab_link(cache, slab);
+  }
+  *(void**)ptr = slab->free_list;
+  slab->free_list = ptr;
+  slab->in_use--;
+
+  // Give empty slabs back to the page allocator, keeping one around
+  if (slab->in_use == 0 && (cache->partial != slab || slab->next)) {
+    slab_unlink(cache, slab);
+    slab->magic = 0;
+    pmm_free_page(virt_to_phys(slab));
+  }
+}
+
+// Depot (caller holds cache->lock)
+static void depot_push_full(xo_kmem_cache_t *cache, xo_magazine_t *magazine) {
+  magazine->next = cache->full_magazines;
+  cache->full_magazines = magazine;
+  cache->full_count++;
+
+  // Bound the memory parked in magazines by draining the oldest one, at the
+  // tail: its objects are the coldest. The walk is at most DEPOT_MAX_FULL.
+  if (cache->full_count > DEPOT_MAX_FULL) {
+    xo_magazine_t **link = &cache->full_magazines;
+    while ((*link)->next) {
+      link = &(*link)->next;
+    }
+    xo_magazine_t *drain = *link;
+    *link = NULL;
+    cache->full_count--;
+
+    while (drain->rounds) {
+      slab_free_object(cache, drain->objects[--drain->rounds]);
+    }
+    drain->next = cache->empty_magazines;
+    cache->empty_magazines = drain;
+  }
+}
+
+static void depot_push_empty(xo_kmem_cache_t *cache, xo_magazine_t *magazine) {
+  magazine->next = cache->empty_magazines;
+  cache->empty_magazines = magazine;
+}
+
+static xo_magazine_t *depot_pop_empty(xo_kmem_cache_t *cache) {
+  xo_magazine_t *magazine = cache->empty_magazines;
+  if (magazine) {
+    cache->empty_magazines = magazine->next;
+    magazine->next = NULL;
+    return magazine;
+  }
+  return magazine_alloc();
+}
+
+static void *cache_alloc_slow(xo_kmem_cache_t *cache, xo_cpu_cache_t *cc) {
+  // A full previous magazine can simply be swapped in
+  if (cc->previous && cc->previous->rounds) {
+    xo_magazine_t *tmp = cc->loaded;
+    cc->loaded = cc->previous;
+    cc->previous = tmp;
+    return cc->loaded->objects[--cc->loaded->rounds];
+  }
+
+  spin_lock(&cache->lock);
+
+  if (cache->full_magazines) {
+    xo_magazine_t *full = cache->full_magazines;
+    cache->full_magazines = full->next;
+    cache->full_count--;
+
+    if (cc->previous) {
+      depot_push_empty(cache, cc->previous);
+    }
+    cc->previous = cc->loaded;
+    cc->loaded = full;
+  } else {
+    // Depot is dry: refill the loaded magazine from the slab layer in one batch
+    if (!cc->loaded) {
+      cc->loaded = depot_pop_empty(cache);
+    }
+    if (!cc->loaded) {
+      void *object = slab_alloc_object(cache);
+      spin_unlock(&cache->lock);
+      return object;
+    }
+
+    while (cc->loaded->rounds < MAGAZINE_SIZE / 2) {
+      void *object = slab_alloc_object(cache);
+      if (!object) {
+        break;
+      }
+      cc->loaded->objects[cc->loaded->rounds++] = object;
+    }
+  }
+
+  spin_unlock(&cache->lock);
+
+  if (!cc->loaded->rounds) {
+    return NULL;
+  }
+  return cc->loaded->objects[--cc->loaded->rounds];
+}
+
+static void cache_free_slow(xo_kmem_cache_t *cache, xo_cpu_cache_t *cc, void *ptr) {
+  // An empty previous magazine can simply be swapped in
+  if (cc->previous && cc->previous->rounds == 0) {
+    xo_magazine_t *tmp = cc->loaded;
+    cc->loaded = cc->previous;
+    cc->previous = tmp;
+    cc->loaded->objects[cc->loaded->rounds++] = ptr;
+    return;
+  }
+
+  spin_lock(&cache->lock);
+
+  xo_magazine_t *empty = depot_pop_empty(cache);
+  if (!empty) {
+    slab_free_object(cache, ptr);
+    spin_unlock(&cache->lock);
+    return;
+  }
+
+  if (cc->previous) {
+    depot_push_full(cache, cc->previous);
+  }
+  cc->previous = cc->loaded;
+  cc->loaded = empty;
+  cc->loaded->objects[cc->loaded->rounds++] = ptr;
+
+  spin_unlock(&cache->lock);
+}
+
+static void *large_alloc(size_t size) {
+  uint32_t order = 0;
+  while ((PAGE_SIZE << order) < size + LARGE_HEADER_SIZE) {
+    if (++order > PMM_MAX_ORDER) {
+      return NULL;
+    }
+  }
+
+  uint64_t phys = pmm_alloc_pages(order);
+  if (!phys) {
+    return NULL;
+  }
+
+  xo_large_header_t *header = (xo_large_header_t*)phys_to_virt(phys);
+  header->magic = LARGE_MAGIC;
+  header->order = order;
+  return (uint8_t*)header + LARGE_HEADER_SIZE;
+}
+
+void kmalloc_init(void) {
+  for (uint32_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+    caches[i].index = i;
+    caches[i].object_size = size_classes[i];
+    caches[i].objects_per_slab = (PAGE_SIZE - SLAB_HEADER_SIZE) / size_classes[i];
+  }
+
+  uint32_t class_index = 0;
+  for (uint32_t i = 1; i <= KMALLOC_MAX_SMALL / 8; i++) {
+    while (size_classes[class_index] < i * 8) {
+      class_index++;
+    }
+    size_index[i] = (uint8_t)class_index;
+  }
+}
+
+void *kmalloc(size_t size) {
+  if (size == 0) {
+    return NULL;
+  }
+  if (size > KMALLOC_MAX_SMALL) {
+    return large_alloc(size);
+  }
+
+  xo_kmem_cache_t *cache = &caches[size_index[(size + 7) >> 3]];
+  void *object;
+
+  uint64_t flags = irq_save();
+  xo_cpu_cache_t *cc = &cache->cpu[this_cpu_id()];
+  if (cc->loaded && cc->loaded->rounds) {
+    object = cc->loaded->objects[--cc->loaded->rounds];
+  } else {
+    object = cache_alloc_slow(cache, cc);
+  }
+  irq_restore(flags);
+
+  return object;
+}
+
+void kfree(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+
+  xo_slab_t *slab = (xo_slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+  if (slab->magic == LARGE_MAGIC) {
+    xo_large_header_t *header = (xo_large_header_t*)slab;
+    pmm_free_pages(virt_to_phys(header), header->order);
+    return;
+  }
+
+  xo_kmem_cache_t *cache = &caches[slab->cache_index];
+
+  uint64_t flags = irq_save();
+  xo_cpu_cache_t *cc = &cache->cpu[this_cpu_id()];
+  if (cc->loaded && cc->loaded->rounds < MAGAZINE_SIZE) {
+    cc->loaded->objects[cc->loaded->rounds++] = ptr;
+  } else {
+    cache_free_slow(cache, cc, ptr);
+  }
+  irq_restore(flags);
+}
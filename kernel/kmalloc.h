@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+// Set up the size-class caches; requires pmm_init
+void kmalloc_init(void);
+
+// Allocate at least size bytes. Objects up to KMALLOC_MAX_SMALL come from
+// per-CPU cached slabs; larger requests are served in whole pages.
+// Returns NULL on failure or when size is 0.
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+
+#define KMALLOC_MAX_SMALL 1024
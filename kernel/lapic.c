@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lapic.h"
+#include "cpu.h"
+#include "delay.h"
+#include "paging.h"
+
+// xAPIC register offsets; in x2APIC mode register reg is MSR
+// MSR_X2APIC_BASE + reg / 16
+#define LAPIC_REG_ID       0x020
+#define LAPIC_REG_EOI      0x0B0
+#define LAPIC_REG_SVR      0x0F0
+#define LAPIC_REG_ICR_LOW  0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_SVR_ENABLE      0x100
+#define LAPIC_ICR_PENDING     (1u << 12)
+#define LAPIC_ICR_INIT        0x00000500
+#define LAPIC_ICR_STARTUP     0x00000600
+#define LAPIC_ICR_FIXED       0x00000000
+#define LAPIC_ICR_ASSERT      0x00004000
+
+#define LAPIC_LVT_MASKED      (1u << 16)
+#define LAPIC_TIMER_ONESHOT      (0u << 17)
+#define LAPIC_TIMER_TSC_DEADLINE (2u << 17)
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+#define LAPIC_CALIBRATION_US 10000
+
+#define APIC_BASE_X2APIC   (1ULL << 10)
+#define APIC_BASE_ENABLE   (1ULL << 11)
+#define APIC_BASE_MASK     0x000FFFFFFFFFF000ULL
+
+#define MSR_X2APIC_BASE    0x800
+#define CPUID_1_ECX_X2APIC (1u << 21)
+
+static volatile uint32_t *lapic_registers = NULL;
+static int x2apic_mode = 0;
+static uint64_t timer_ticks_per_ms = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+  if (x2apic_mode) {
+    return (uint32_t)rdmsr(MSR_X2APIC_BASE + reg / 16);
+  }
+  return lapic_registers[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+  if (x2apic_mode) {
+    wrmsr(MSR_X2APIC_BASE + reg / 16, value);
+  } else {
+    lapic_registers[reg / 4] = value;
+  }
+}
+
+// Send an IPI. The x2APIC ICR is a single 64-bit MSR with no delivery
+// status to wait on; the xAPIC one is written in two halves, so keep an
+// interrupt handler from sending its own IPI in between.
+static void lapic_write_icr(uint32_t apic_id, uint32_t command) {
+  if (x2apic_mode) {
+    // x2APIC MSR writes are not serializing: make earlier stores visible to
+    // the target before the IPI can reach it
+    __asm__ volatile ("mfence; lfence" : : : "memory");
+    wrmsr(MSR_X2APIC_BASE + LAPIC_REG_ICR_LOW / 16, ((uint64_t)apic_id << 32) | command);
+    return;
+  }
+
+  uint64_t flags = irq_save();
+  lapic_registers[LAPIC_REG_ICR_HIGH / 4] = apic_id << 24;
+  lapic_registers[LAPIC_REG_ICR_LOW / 4] = command;
+  while (lapic_registers[LAPIC_REG_ICR_LOW / 4] & LAPIC_ICR_PENDING) {
+    cpu_relax();
+  }
+  irq_restore(flags);
+}
+
+// Count LAPIC timer ticks (bus clock / 16) across a known delay
+static void lapic_timer_calibrate(void) {
+  lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+  lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+
+  udelay(LAPIC_CALIBRATION_US);
+
+  uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CURRENT);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+  timer_ticks_per_ms = (uint64_t)elapsed * 1000 / LAPIC_CALIBRATION_US;
+}
+
+int lapic_x2apic_supported(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  return (ecx & CPUID_1_ECX_X2APIC) != 0;
+}
+
+int lapic_init(uint64_t base_address) {
+  // x2APIC registers are MSRs: cheaper to reach than uncached MMIO, and
+  // IPIs take one write
+  x2apic_mode = lapic_x2apic_supported();
+
+  if (!x2apic_mode) {
+    if (!base_address) {
+      base_address = rdmsr(MSR_APIC_BASE) & APIC_BASE_MASK;
+    }
+    lapic_registers = (volatile uint32_t*)paging_map_mmio(base_address, 0x1000);
+    if (!lapic_registers) {
+      return -1;
+    }
+  }
+
+  lapic_enable();
+  lapic_timer_calibrate();
+  return 0;
+}
+
+void lapic_enable(void) {
+  // Going from disabled straight to x2APIC mode is not a valid transition,
+  // so enable the xAPIC first
+  uint64_t base = rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE;
+  wrmsr(MSR_APIC_BASE, base);
+  if (x2apic_mode) {
+    wrmsr(MSR_APIC_BASE, base | APIC_BASE_X2APIC);
+  }
+  lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+uint32_t lapic_id(void) {
+  uint32_t id = lapic_read(LAPIC_REG_ID);
+  return x2apic_mode ? id : id >> 24;
+}
+
+void lapic_eoi(void) {
+  lapic_write(LAPIC_REG_EOI, 0);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+  lapic_write_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint8_t vector_page) {
+  lapic_write_icr(apic_id, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | vector_page);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+  lapic_write_icr(apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_timer_set_oneshot(uint8_t vector) {
+  lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+  lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_ONESHOT | vector);
+  lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+}
+
+void lapic_timer_set_tsc_deadline(uint8_t vector) {
+  lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | vector);
+  // The SDM requires the LVT write to be ordered before the first write to
+  // IA32_TSC_DEADLINE
+  __asm__ volatile ("mfence" : : : "memory");
+}
+
+void lapic_timer_arm(uint32_t ticks) {
+  lapic_write(LAPIC_REG_TIMER_INITIAL, ticks);
+}
+
+uint64_t lapic_timer_ticks_per_ms(void) {
+  return timer_ticks_per_ms;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+// Pick x2APIC mode if the CPU has it, otherwise map the xAPIC registers
+// (BSP, once); then enable the calling CPU's APIC and calibrate the timer
+int lapic_init(uint64_t base_address);
+
+// Enable the calling CPU's local APIC in the mode lapic_init chose
+void lapic_enable(void);
+
+// Non-zero if the CPU supports x2APIC mode (32-bit APIC IDs)
+int lapic_x2apic_supported(void);
+
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint8_t vector_page);
+
+// Send a fixed interrupt to another CPU
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+// Put the calling CPU's timer in one-shot or TSC-deadline mode on the given
+// vector; it stays quiet until armed
+void lapic_timer_set_oneshot(uint8_t vector);
+void lapic_timer_set_tsc_deadline(uint8_t vector);
+
+// Start a one-shot count-down of the given number of timer ticks (0 stops it)
+void lapic_timer_arm(uint32_t ticks);
+
+uint64_t lapic_timer_ticks_per_ms(void);
@@ -1,175 +1,125 @@
 #include <stdint.h>
 #include <stddef.h>
 
-// Boot info structure definition (must match bootloader's)
-#define XO_BOOT_INFO_MAGIC 0x584F424F4F54  // "XOBOOT"
-#define XO_MAX_MEMORY_ENTRIES 256
-#define XO_MAX_CMDLINE_LENGTH 1024
-
-typedef enum {
-  XO_MEMORY_AVAILABLE = 1,
-  XO_MEMORY_RESERVED = 2,
-  XO_MEMORY_ACPI_RECLAIMABLE = 3,
-  XO_MEMORY_ACPI_NVS = 4,
-  XO_MEMORY_BAD = 5,
-  XO_MEMORY_BOOTLOADER_CODE = 6,
-  XO_MEMORY_BOOTLOADER_DATA = 7,
-  XO_MEMORY_RUNTIME_CODE = 8,
-  XO_MEMORY_RUNTIME_DATA = 9,
-  XO_MEMORY_CONVENTIONAL = 10,
-  XO_MEMORY_UNUSABLE = 11,
-  XO_MEMORY_PERSISTENT = 12
-} xo_memory_type_t;
-
-typedef struct {
-  uint64_t base_address;
-  uint64_t length;
-  xo_memory_type_t type;
-  uint32_t attributes;
-} xo_memory_entry_t;
-
-typedef struct {
-  uint64_t framebuffer_address;
-  uint32_t framebuffer_width;
-  uint32_t framebuffer_height;
-  uint32_t framebuffer_pitch;
-  uint32_t framebuffer_bpp;
-  uint32_t red_mask_size;
-  uint32_t red_field_position;
-  uint32_t green_mask_size;
-  uint32_t green_field_position;
-  uint32_t blue_mask_size;
-  uint32_t blue_field_position;
-  uint32_t reserved_mask_size;
-  uint32_t reserved_field_position;
-} xo_graphics_info_t;
-
-typedef struct {
-  uint64_t acpi_rsdp_address;
-  uint64_t smbios_address;
-  uint64_t device_tree_address;
-  uint32_t device_tree_size;
-  uint32_t cpu_count;
-  uint64_t cpu_features;
-} xo_hardware_info_t;
-
-typedef struct {
-  uint64_t kernel_physical_address;
-  uint64_t kernel_virtual_address;
-  uint64_t kernel_size;
-  uint64_t kernel_entry_point;
-  uint64_t initrd_address;
-  uint64_t initrd_size;
-  char cmdline[XO_MAX_CMDLINE_LENGTH];
-} xo_kernel_info_t;
-
-typedef struct {
-  uint64_t efi_system_table;
-  uint64_t efi_runtime_services;
-  uint8_t runtime_services_supported;
-  uint32_t efi_version;
-  uint64_t loader_signature;
-} xo_uefi_info_t;
-
-typedef struct {
-  uint64_t magic;
-  uint32_t version;
-  uint32_t size;
-
-  xo_memory_entry_t memory_map[XO_MAX_MEMORY_ENTRIES];
-  uint32_t memory_map_entries;
-  uint64_t total_memory;
-  uint64_t available_memory;
-
-  xo_graphics_info_t graphics;
-  xo_hardware_info_t hardware;
-  xo_kernel_info_t kernel;
-  xo_uefi_info_t uefi;
-
-  uint64_t bootloader_timestamp;
-  uint32_t checksum;
-} xo_boot_info_t;
-
-// Simple framebuffer operations
-static void plot_pixel(xo_graphics_info_t *gfx, uint32_t x, uint32_t y, uint32_t color) {
-  if (!gfx->framebuffer_address || x >= gfx->framebuffer_width || y >= gfx->framebuffer_height) {
-    return;
+#include "boot_info.h"
+#include "acpi.h"
+#include "boot_profile.h"
+#include "clock.h"
+#include "console.h"
+#include "cpu.h"
+#include "fb.h"
+#include "gfx.h"
+#include "gdt.h"
+#include "idt.h"
+#include "initrd.h"
+#include "ioapic.h"
+#include "irq.h"
+#include "klog.h"
+#include "kmalloc.h"
+#include "paging.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "sched.h"
+#include "serial.h"
+#include "simd.h"
+#include "smp.h"
+#include "trace.h"
+#include "../helpers/crc32c.h"
+#include "../helpers/mem.h"
+
+// Parsed from the loader's boot block, which stays reserved
+static xo_boot_info_t boot_info_data;
+
+// QEMU's isa-debug-exit device (iobase 0xf4) exits with status
+// (value << 1) | 1; on anything else the write goes nowhere
+#define DEBUG_EXIT_PORT    0xF4
+#define DEBUG_EXIT_SUCCESS 0x10 // Status 33
+
+static void halt_forever(void) {
+  while (1) {
+    __asm__ volatile ("hlt");
   }
-
-  uint32_t *framebuffer = (uint32_t*)gfx->framebuffer_address;
-  uint32_t offset = y * (gfx->framebuffer_pitch / 4) + x;
-  framebuffer[offset] = color;
 }
 
-static void clear_screen(xo_graphics_info_t *gfx, uint32_t color) {
-  if (!gfx->framebuffer_address) {
-    return;
+// Kernel entry point
+// Called from the entry stub in entry.S once the boot page tables are live.
+// The loader hands us the physical address of its boot block.
+void kernel_main(const xo_boot_header_t *boot_block) {
+  uint64_t entry_tsc = rdtsc();
+  xo_boot_info_t *boot_info = &boot_info_data;
+
+  mem_init();
+  crc32c_init();
+  if (!boot_block || boot_info_parse((uint64_t)(uintptr_t)boot_block, boot_info) != 0) {
+    // Invalid boot info - halt
+    halt_forever();
   }
 
-  uint32_t *framebuffer = (uint32_t*)gfx->framebuffer_address;
-  uint32_t pixels_per_line = gfx->framebuffer_pitch / 4;
+  boot_profile_init(boot_info, entry_tsc);
 
-  for (uint32_t y = 0; y < gfx->framebuffer_height; y++) {
-    for (uint32_t x = 0; x < gfx->framebuffer_width; x++) {
-      framebuffer[y * pixels_per_line + x] = color;
-    }
-  }
-}
+  gdt_init();
+  percpu_setup(0, cpu_initial_apic_id());
+  serial_init();
 
-static void draw_test_pattern(xo_graphics_info_t *gfx) {
-  if (!gfx->framebuffer_address) {
-    return;
+  // Hand the usable physical memory to the page allocator, then move onto
+  // our own page tables and release the memory they made reachable
+  if (pmm_init(boot_info) != 0 || paging_init(boot_info) != 0) {
+    halt_forever();
   }
+  pmm_add_high_memory(boot_info);
 
-  // Clear to black
-  clear_screen(gfx, 0x00000000);
-
-  // Draw some colorful rectangles
-  for (uint32_t y = 50; y < 150; y++) {
-    for (uint32_t x = 50; x < 150; x++) {
-      plot_pixel(gfx, x, y, 0x00FF0000); // Red
-    }
+  // Nothing the loader or boot services allocated is needed any more
+  pmm_reclaim_bootloader(boot_info);
+  kmalloc_init();
+  if (gdt_init_cpu() != 0) {
+    halt_forever();
   }
-
-  for (uint32_t y = 200; y < 300; y++) {
-    for (uint32_t x = 200; x < 300; x++) {
-      plot_pixel(gfx, x, y, 0x0000FF00); // Green
-    }
+  idt_init();
+  if (irq_init_cpu() != 0 || simd_init_cpu() != 0) {
+    halt_forever();
   }
-
-  for (uint32_t y = 350; y < 450; y++) {
-    for (uint32_t x = 350; x < 450; x++) {
-      plot_pixel(gfx, x, y, 0x000000FF); // Blue
-    }
+  sched_init();
+  if (trace_init(boot_info_option(boot_info, "trace")) == 0) {
+    klog("trace: recording");
+  }
+  gfx_init();
+
+  if ((boot_info->initrd.flags & XO_INITRD_CRC32C) &&
+      crc32c(0, phys_to_virt(boot_info->initrd.address), boot_info->initrd.size) !=
+      boot_info->initrd.crc32c) {
+    klog("initrd: checksum mismatch, ignoring it");
+  } else if (initrd_init(boot_info->initrd.address, boot_info->initrd.size) == 0) {
+    klog("initrd: %u file(s), %lu bytes", initrd_file_count(), boot_info->initrd.size);
   }
-}
 
-// Kernel entry point
-// This function is called by the bootloader after loading the kernel
-void kernel_main(xo_boot_info_t *boot_info) {
-  // Verify boot info magic
-  if (!boot_info || boot_info->magic != XO_BOOT_INFO_MAGIC) {
-    // Invalid boot info - halt
-    while (1) {
-      __asm__ volatile ("hlt");
-    }
+  // Firmware tables are optional: without them we calibrate on the PIT and
+  // stay on one CPU
+  acpi_init(boot_info->acpi.rsdp_address);
+  uint32_t ioapic_pins = ioapic_init();
+  clock_init();
+  uint32_t cpus = smp_init(boot_info);
+  klog("smp: %u cpu(s) online, tsc %lu kHz", cpus, clock_tsc_hz() / 1000);
+  klog("irq: %u ioapic pin(s)", ioapic_pins);
+  if (serial_enable_irq(this_cpu()->apic_id) == 0) {
+    klog("serial: interrupt driven");
   }
+  klog("gfx: %s primitives", gfx_backend());
 
-  // If we have a framebuffer, draw a test pattern
-  if (boot_info->graphics.framebuffer_address) {
-    draw_test_pattern(&boot_info->graphics);
+  // If we have a framebuffer, put the back buffer behind it and show the
+  // kernel log on it
+  if (fb_init(&boot_info->graphics) == 0) {
+    console_init();
   }
 
-  // Simple infinite loop - kernel is running!
-  // In a real kernel, this is where you'd:
-  // - Set up memory management
-  // - Initialize interrupt handlers
-  // - Start the scheduler
-  // - Launch init process
-  // etc.
-  
-  while (1) {
-    // Halt until next interrupt
-    __asm__ volatile ("hlt");
+  boot_profile_report();
+
+  // "exit": power off QEMU once booted, for tools/bootbench.py
+  const char *exit_option = boot_info_option(boot_info, "exit");
+  if (exit_option && (!*exit_option || *exit_option == ' ')) {
+    serial_flush();
+    outb(DEBUG_EXIT_PORT, DEBUG_EXIT_SUCCESS);
   }
-}
\ No newline at end of file
+
+  // Hand this CPU to the scheduler; the boot context becomes its idle thread
+  sched_start();
+}
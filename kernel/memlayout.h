@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+// Kernel virtual address space layout
+//
+//   0xFFFF800000000000  direct map of all physical RAM
+//   0xFFFFC00000000000  MMIO window (device and framebuffer mappings)
+//   0xFFFFFFFF80000000  kernel image (-mcmodel=kernel)
+//
+// The boot stub in entry.S additionally identity maps and direct maps the
+// first 4 GiB until paging_init switches to the kernel's own tables.
+
+#define DIRECT_MAP_BASE  0xFFFF800000000000ULL
+#define MMIO_MAP_BASE    0xFFFFC00000000000ULL
+#define MMIO_MAP_END     0xFFFFE00000000000ULL
+#define KERNEL_VIRT_BASE 0xFFFFFFFF80000000ULL
+
+// Physical memory reachable before paging_init runs
+#define EARLY_MAP_LIMIT  0x100000000ULL
+
+static inline void *phys_to_virt(uint64_t phys) {
+  return (void*)(uintptr_t)(phys + DIRECT_MAP_BASE);
+}
+
+static inline uint64_t virt_to_phys(const void *virt) {
+  uint64_t address = (uint64_t)(uintptr_t)virt;
+  if (address >= KERNEL_VIRT_BASE) {
+    return address - KERNEL_VIRT_BASE;
+  }
+  return address - DIRECT_MAP_BASE;
+}
@@ -0,0 +1,283 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "paging.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "../helpers/mem.h"
+
+// Kernel page tables.
+//
+// The direct map covers every RAM range of the boot memory map at
+// DIRECT_MAP_BASE + phys. Adjacent ranges are merged first and then mapped
+// with 1 GiB pages where the CPU supports them, 2 MiB pages otherwise, and
+// 4 KiB pages only at unaligned edges. The kernel image is mapped with 4 KiB
+// pages so each section gets its own permissions.
+//
+// The PAT keeps its power-on entries 0-3 (WB, WT, UC-, UC), so PWT/PCD mean
+// what the firmware and the boot stub expect, and entries 4 and 5 become WC
+// and WP. Every CPU must load the same PAT before using those entries.
+
+#define CPUID_EXT_FEATURES   0x80000001
+#define CPUID_EXT_EDX_NX     (1u << 20)
+#define CPUID_EXT_EDX_1GB    (1u << 26)
+#define CPUID_1_EDX_PAT      (1u << 16)
+
+// PA0..PA7 = WB, WT, UC-, UC, WC, WP, UC-, UC
+#define PAT_VALUE 0x0007050100070406ULL
+
+#define MMIO_ALIGN PAGE_SIZE_2M
+
+extern char _text_start[];
+extern char _text_end[];
+extern char _rodata_start[];
+extern char _rodata_end[];
+extern char _data_start[];
+extern char _kernel_end[];
+
+static spinlock_t paging_lock = SPINLOCK_INIT;
+static uint64_t *kernel_pml4 = NULL;
+static uint64_t kernel_pml4_phys = 0;
+static uint64_t nx_flag = 0; // PTE_NX when EFER.NXE could be enabled
+static int gib_pages = 0;
+static int pat_supported = 0;
+static uint64_t mmio_next = MMIO_MAP_BASE;
+
+static uint64_t *alloc_table(void) {
+  uint64_t phys = pmm_alloc_page();
+  if (!phys) {
+    return NULL;
+  }
+
+  uint64_t *table = (uint64_t*)phys_to_virt(phys);
+  memset(table, 0, PAGE_SIZE);
+  return table;
+}
+
+// Return the next-level table behind table[index], creating it if needed
+static uint64_t *next_table(uint64_t *table, uint32_t index) {
+  uint64_t entry = table[index];
+  if (entry & PTE_PRESENT) {
+    if (entry & PTE_HUGE) {
+      return NULL; // Already covered by a large page
+    }
+    return (uint64_t*)phys_to_virt(entry & PTE_ADDRESS_MASK);
+  }
+
+  uint64_t *next = alloc_table();
+  if (!next) {
+    return NULL;
+  }
+  table[index] = virt_to_phys(next) | PTE_PRESENT | PTE_WRITABLE;
+  return next;
+}
+
+// Map a page-aligned range. Caller holds paging_lock (or runs before other
+// CPUs exist).
+static int map_range(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags) {
+  flags |= PTE_PRESENT;
+  if (!(flags & PTE_NX) || !nx_flag) {
+    flags &= ~PTE_NX;
+  }
+
+  // Bit 7 is the page-size bit in large entries; their PAT bit is bit 12
+  uint64_t huge_flags = (flags & ~PTE_PAT) | PTE_HUGE | ((flags & PTE_PAT) ? PTE_PAT_HUGE : 0);
+
+  while (size) {
+    uint64_t *pdpt = next_table(kernel_pml4, (virt >> 39) & 0x1FF);
+    if (!pdpt) {
+      return -1;
+    }
+
+    uint64_t alignment = virt | phys;
+    if (gib_pages && (alignment & (PAGE_SIZE_1G - 1)) == 0 && size >= PAGE_SIZE_1G) {
+      pdpt[(virt >> 30) & 0x1FF] = phys | huge_flags;
+      virt += PAGE_SIZE_1G;
+      phys += PAGE_SIZE_1G;
+      size -= PAGE_SIZE_1G;
+      continue;
+    }
+
+    uint64_t *pd = next_table(pdpt, (virt >> 30) & 0x1FF);
+    if (!pd) {
+      return -1;
+    }
+
+    if ((alignment & (PAGE_SIZE_2M - 1)) == 0 && size >= PAGE_SIZE_2M) {
+      pd[(virt >> 21) & 0x1FF] = phys | huge_flags;
+      virt += PAGE_SIZE_2M;
+      phys += PAGE_SIZE_2M;
+      size -= PAGE_SIZE_2M;
+      continue;
+    }
+
+    uint64_t *pt = next_table(pd, (virt >> 21) & 0x1FF);
+    if (!pt) {
+      return -1;
+    }
+
+    pt[(virt >> 12) & 0x1FF] = phys | flags;
+    virt += PAGE_SIZE;
+    phys += PAGE_SIZE;
+    size -= PAGE_SIZE;
+  }
+
+  return 0;
+}
+
+static int is_ram_type(xo_memory_type_t type) {
+  switch (type) {
+    case XO_MEMORY_AVAILABLE:
+    case XO_MEMORY_CONVENTIONAL:
+    case XO_MEMORY_ACPI_RECLAIMABLE:
+    case XO_MEMORY_ACPI_NVS:
+    case XO_MEMORY_BOOTLOADER_CODE:
+    case XO_MEMORY_BOOTLOADER_DATA:
+    case XO_MEMORY_RUNTIME_CODE:
+    case XO_MEMORY_RUNTIME_DATA:
+    case XO_MEMORY_PERSISTENT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int map_direct(const xo_boot_info_t *boot_info) {
+  uint64_t run_base = 0;
+  uint64_t run_end = 0;
+  uint64_t flags = PTE_WRITABLE | PTE_GLOBAL | PTE_NX;
+
+  // Merge adjacent RAM entries so that huge pages can span firmware fragments
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (!is_ram_type(entry->type) || entry->length == 0) {
+      continue;
+    }
+
+    if (entry->base_address == run_end && run_end != run_base) {
+      run_end += entry->length;
+      continue;
+    }
+
+    if (run_end != run_base &&
+        map_range(DIRECT_MAP_BASE + run_base, run_base, run_end - run_base, flags) != 0) {
+      return -1;
+    }
+    run_base = entry->base_address;
+    run_end = entry->base_address + entry->length;
+  }
+
+  if (run_end != run_base &&
+      map_range(DIRECT_MAP_BASE + run_base, run_base, run_end - run_base, flags) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int map_kernel_section(const char *start, const char *end, uint64_t flags) {
+  uint64_t virt = (uint64_t)(uintptr_t)start & ~(PAGE_SIZE - 1);
+  uint64_t size = (((uint64_t)(uintptr_t)end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) - virt;
+  if (size == 0) {
+    return 0;
+  }
+  return map_range(virt, virt - KERNEL_VIRT_BASE, size, flags | PTE_GLOBAL);
+}
+
+void paging_init_cpu(void) {
+  if (pat_supported) {
+    wrmsr(MSR_PAT, PAT_VALUE);
+  }
+}
+
+uint64_t paging_mem_type_flags(xo_mem_type_t type) {
+  switch (type) {
+    case MEM_TYPE_WB:
+      return 0;
+    case MEM_TYPE_WT:
+      return PTE_PWT;
+    case MEM_TYPE_UC_MINUS:
+      return PTE_PCD;
+    case MEM_TYPE_WC:
+      return pat_supported ? PTE_PAT : PTE_PCD | PTE_PWT;
+    case MEM_TYPE_WP:
+      return pat_supported ? PTE_PAT | PTE_PWT : PTE_PCD | PTE_PWT;
+    case MEM_TYPE_UC:
+    default:
+      return PTE_PCD | PTE_PWT;
+  }
+}
+
+int paging_init(const xo_boot_info_t *boot_info) {
+  uint32_t eax, ebx, ecx, edx;
+
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  pat_supported = (edx & CPUID_1_EDX_PAT) != 0;
+  paging_init_cpu();
+
+  cpuid(CPUID_EXT_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+  gib_pages = (edx & CPUID_EXT_EDX_1GB) != 0;
+  if (edx & CPUID_EXT_EDX_NX) {
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    nx_flag = PTE_NX;
+  }
+
+  kernel_pml4 = alloc_table();
+  if (!kernel_pml4) {
+    return -1;
+  }
+  kernel_pml4_phys = virt_to_phys(kernel_pml4);
+
+  if (map_direct(boot_info) != 0) {
+    return -1;
+  }
+
+  if (map_kernel_section(_text_start, _text_end, 0) != 0 ||
+      map_kernel_section(_rodata_start, _rodata_end, PTE_NX) != 0 ||
+      map_kernel_section(_data_start, _kernel_end, PTE_WRITABLE | PTE_NX) != 0) {
+    return -1;
+  }
+
+  write_cr0(read_cr0() | CR0_WP);
+  write_cr4(read_cr4() | CR4_PGE);
+  write_cr3(kernel_pml4_phys);
+  return 0;
+}
+
+int paging_map(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags) {
+  uint64_t irq_flags = spin_lock_irqsave(&paging_lock);
+  int result = map_range(virt, phys, size, flags);
+  spin_unlock_irqrestore(&paging_lock, irq_flags);
+  return result;
+}
+
+void *paging_map_mmio_type(uint64_t phys, uint64_t size, xo_mem_type_t type) {
+  uint64_t base = phys & ~(PAGE_SIZE - 1);
+  uint64_t length = ((phys + size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) - base;
+
+  uint64_t flags = spin_lock_irqsave(&paging_lock);
+
+  // Keep virt congruent to phys modulo 2 MiB so large devices get huge pages
+  uint64_t virt = ((mmio_next + MMIO_ALIGN - 1) & ~(MMIO_ALIGN - 1)) + (base & (MMIO_ALIGN - 1));
+  if (virt + length > MMIO_MAP_END ||
+      map_range(virt, base, length, PTE_WRITABLE | PTE_NX | PTE_GLOBAL | paging_mem_type_flags(type)) != 0) {
+    spin_unlock_irqrestore(&paging_lock, flags);
+    return NULL;
+  }
+  mmio_next = virt + length;
+
+  spin_unlock_irqrestore(&paging_lock, flags);
+  return (void*)(uintptr_t)(virt + (phys - base));
+}
+
+void *paging_map_mmio(uint64_t phys, uint64_t size) {
+  return paging_map_mmio_type(phys, size, MEM_TYPE_UC);
+}
+
+uint64_t paging_kernel_cr3(void) {
+  return kernel_pml4_phys;
+}
+
+int paging_has_gib_pages(void) {
+  return gib_pages;
+}
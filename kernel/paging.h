@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "boot_info.h"
+#include "memlayout.h"
+
+// Page table entry bits
+#define PTE_PRESENT  (1ULL << 0)
+#define PTE_WRITABLE (1ULL << 1)
+#define PTE_USER     (1ULL << 2)
+#define PTE_PWT      (1ULL << 3)
+#define PTE_PCD      (1ULL << 4)
+#define PTE_HUGE     (1ULL << 7)
+#define PTE_PAT      (1ULL << 7)  // 4 KiB entries only
+#define PTE_GLOBAL   (1ULL << 8)
+#define PTE_PAT_HUGE (1ULL << 12) // 2 MiB and 1 GiB entries
+#define PTE_NX       (1ULL << 63)
+
+#define PTE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+
+#define PAGE_SIZE_2M (1ULL << 21)
+#define PAGE_SIZE_1G (1ULL << 30)
+
+// Memory types selectable per mapping through the PAT
+typedef enum {
+  MEM_TYPE_WB,       // Write-back (normal RAM)
+  MEM_TYPE_WT,       // Write-through
+  MEM_TYPE_UC_MINUS, // Uncached, MTRR may upgrade to WC
+  MEM_TYPE_UC,       // Strongly uncached (device registers)
+  MEM_TYPE_WC,       // Write-combining (framebuffers, streaming buffers)
+  MEM_TYPE_WP        // Write-protect
+} xo_mem_type_t;
+
+// Build the kernel page tables (higher-half image plus a huge-page direct map
+// of all RAM) and switch to them. Requires pmm_init. Returns 0 on success.
+int paging_init(const xo_boot_info_t *boot_info);
+
+// Program this CPU's PAT. paging_init does it for the boot CPU; every AP
+// must call it before touching a WC or WP mapping.
+void paging_init_cpu(void);
+
+// PTE flag bits for a memory type on a 4 KiB entry (map_range moves the PAT
+// bit for large pages). Types needing the PAT fall back to UC without it.
+uint64_t paging_mem_type_flags(xo_mem_type_t type);
+
+// Map page-aligned [phys, phys + size) at virt in the kernel address space,
+// using the largest page size alignment allows. flags use the 4 KiB layout,
+// so PTE_PAT means the PAT bit. Returns 0 on success.
+int paging_map(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags);
+
+// Map a device range into the MMIO window with the given memory type.
+// Returns the virtual address, or NULL on failure.
+void *paging_map_mmio_type(uint64_t phys, uint64_t size, xo_mem_type_t type);
+
+// Same, strongly uncached
+void *paging_map_mmio(uint64_t phys, uint64_t size);
+
+// Physical address of the kernel PML4, for loading into CR3 on other CPUs
+uint64_t paging_kernel_cr3(void);
+
+// True when the direct map uses 1 GiB pages
+int paging_has_gib_pages(void);
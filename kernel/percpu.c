@@ -0,0 +1,15 @@
+#include <stdint.h>
+
+#include "percpu.h"
+#include "cpu.h"
+
+xo_percpu_t percpu_areas[MAX_CPUS];
+
+void percpu_setup(uint32_t cpu_id, uint32_t apic_id) {
+  xo_percpu_t *cpu = &percpu_areas[cpu_id];
+
+  cpu->self = cpu;
+  cpu->cpu_id = cpu_id;
+  cpu->apic_id = apic_id;
+  wrmsr(MSR_GS_BASE, (uint64_t)(uintptr_t)cpu);
+}
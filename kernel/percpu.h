@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAX_CPUS 64
+
+struct thread;
+struct xo_irq_stats;
+struct xo_trace_record;
+
+// Per-CPU data block, reached through the GS base of each CPU
+typedef struct xo_percpu {
+  struct xo_percpu *self; // Must stay first: this_cpu() loads %gs:0
+  uint32_t cpu_id;
+  uint32_t apic_id;
+  volatile uint32_t online;
+
+  // Scheduler state
+  uint32_t preempt_count;
+  volatile uint32_t need_resched;
+  uint64_t slice_end;      // clock_now_ns deadline of the running slice, 0 if none
+  uint64_t event_deadline; // Deadline the clockevent is armed for, 0 if none
+  struct thread *current;
+  struct thread *idle;
+  struct thread *sleepers; // Sorted by wake time
+
+  // SIMD sections (simd.c)
+  void *simd_state;    // Page-aligned XSAVE/FXSAVE area
+  uint32_t simd_depth; // Nesting of simd_begin
+
+  // Interrupt statistics (irq.c), one record per vector
+  struct xo_irq_stats *irq_stats;
+
+  // Trace ring (trace.c)
+  struct xo_trace_record *trace_ring;
+  uint64_t trace_head; // Records ever written
+} __attribute__((aligned(64))) xo_percpu_t;
+
+extern xo_percpu_t percpu_areas[MAX_CPUS];
+
+// Point the calling CPU's GS base at its per-CPU block
+void percpu_setup(uint32_t cpu_id, uint32_t apic_id);
+
+static inline xo_percpu_t *this_cpu(void) {
+  xo_percpu_t *cpu;
+  __asm__ volatile ("movq %%gs:0, %0" : "=r"(cpu));
+  return cpu;
+}
+
+static inline uint32_t this_cpu_id(void) {
+  uint32_t id;
+  __asm__ volatile ("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(xo_percpu_t, cpu_id)));
+  return id;
+}
+
+static inline xo_percpu_t *cpu_area(uint32_t cpu_id) {
+  return &percpu_areas[cpu_id];
+}
+
+// Preemption is disabled while the count is non-zero (e.g. under a spinlock)
+static inline void preempt_disable(void) {
+  __asm__ volatile ("incl %%gs:%c0" : : "i"(offsetof(xo_percpu_t, preempt_count)) : "memory");
+}
+
+static inline void preempt_enable(void) {
+  __asm__ volatile ("decl %%gs:%c0" : : "i"(offsetof(xo_percpu_t, preempt_count)) : "memory");
+}
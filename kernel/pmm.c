@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pmm.h"
+#include "spinlock.h"
+
+// Buddy-system physical page allocator.
+//
+// Every page frame between the lowest and highest usable address has a small
+// descriptor in page_array. Free blocks are linked through their descriptors
+// (never through the free memory itself), one doubly linked list per order,
+// and a bitmap of non-empty orders lets allocation find a block without
+// scanning. Allocation and free are both O(PMM_MAX_ORDER).
+
+#define PMM_NONE 0xFFFFFFFFu
+#define PMM_MAX_RESERVED 16
+
+// Leave real-mode memory alone (AP trampolines, BIOS data)
+#define PMM_LOW_MEMORY_LIMIT 0x100000ULL
+
+#define PAGE_FLAG_FREE 0x01 // Descriptor heads a free block of page->order
+
+typedef struct {
+  uint32_t next;
+  uint32_t prev;
+  uint8_t order;
+  uint8_t flags;
+  uint16_t reserved;
+} xo_page_t;
+
+typedef struct {
+  uint32_t head;
+  uint32_t reserved;
+  uint64_t count;
+} xo_free_area_t;
+
+typedef struct {
+  uint64_t base;
+  uint64_t end;
+} xo_phys_range_t;
+
+// Linker-provided physical bounds of the kernel image
+extern char _kernel_phys_start[];
+extern char _kernel_phys_end[];
+
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+static xo_page_t *page_array = NULL;
+static uint64_t base_pfn = 0;
+static uint64_t page_count = 0;
+static xo_free_area_t free_areas[PMM_MAX_ORDER + 1];
+static uint32_t nonempty_orders = 0; // Bit n set when free_areas[n] has blocks
+static uint64_t free_pages = 0;
+static uint64_t total_pages = 0;
+static uint64_t memory_limit = EARLY_MAP_LIMIT; // Ranges above are held back
+
+static xo_phys_range_t reserved_ranges[PMM_MAX_RESERVED];
+static uint32_t reserved_count = 0;
+
+static inline uint64_t align_up(uint64_t value, uint64_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+static inline uint64_t align_down(uint64_t value, uint64_t align) {
+  return value & ~(align - 1);
+}
+
+static int is_usable_type(xo_memory_type_t type) {
+  return type == XO_MEMORY_AVAILABLE || type == XO_MEMORY_CONVENTIONAL;
+}
+
+static int is_reclaimable_type(xo_memory_type_t type) {
+  return type == XO_MEMORY_BOOTLOADER_CODE || type == XO_MEMORY_BOOTLOADER_DATA;
+}
+
+// Free list helpers (caller holds pmm_lock)
+static void list_push(uint32_t index, uint32_t order) {
+  xo_free_area_t *area = &free_areas[order];
+  xo_page_t *page = &page_array[index];
+
+  page->order = (uint8_t)order;
+  page->flags = PAGE_FLAG_FREE;
+  page->prev = PMM_NONE;
+  page->next = area->head;
+  if (area->head != PMM_NONE) {
+    page_array[area->head].prev = index;
+  }
+  area->head = index;
+  area->count++;
+  nonempty_orders |= 1u << order;
+}
+
+static void list_remove(uint32_t index, uint32_t order) {
+  xo_free_area_t *area = &free_areas[order];
+  xo_page_t *page = &page_array[index];
+
+  if (page->prev != PMM_NONE) {
+    page_array[page->prev].next = page->next;
+  } else {
+    area->head = page->next;
+  }
+  if (page->next != PMM_NONE) {
+    page_array[page->next].prev = page->prev;
+  }
+
+  page->flags = 0;
+  page->next = PMM_NONE;
+  page->prev = PMM_NONE;
+
+  if (--area->count == 0) {
+    nonempty_orders &= ~(1u << order);
+  }
+}
+
+// Return a block to the free lists, merging with its buddy as far as possible
+static void free_block(uint64_t index, uint32_t order) {
+  free_pages += 1ULL << order;
+
+  while (order < PMM_MAX_ORDER) {
+    uint64_t buddy = index ^ (1ULL << order);
+    if (buddy >= page_count) {
+      break;
+    }
+
+    xo_page_t *buddy_page = &page_array[buddy];
+    if (!(buddy_page->flags & PAGE_FLAG_FREE) || buddy_page->order != order) {
+      break;
+    }
+
+    list_remove((uint32_t)buddy, order);
+    index &= ~(1ULL << order);
+    order++;
+  }
+
+  list_push((uint32_t)index, order);
+}
+
+// Feed a page-aligned physical range to the allocator as maximal aligned blocks
+static void add_pages(uint64_t base, uint64_t end) {
+  uint64_t pfn = base >> PAGE_SHIFT;
+  uint64_t last = end >> PAGE_SHIFT;
+  if (last > base_pfn + page_count) {
+    last = base_pfn + page_count;
+  }
+
+  while (pfn < last) {
+    uint32_t order = 0;
+    while (order < PMM_MAX_ORDER &&
+           (pfn & ((2ULL << order) - 1)) == 0 &&
+           pfn + (2ULL << order) <= last) {
+      order++;
+    }
+
+    free_block(pfn - base_pfn, order);
+    total_pages += 1ULL << order;
+    pfn += 1ULL << order;
+  }
+}
+
+// Add [base, end) minus any reserved ranges, low memory and held-back memory
+static void add_free_range(uint64_t base, uint64_t end) {
+  if (base < PMM_LOW_MEMORY_LIMIT) {
+    base = PMM_LOW_MEMORY_LIMIT;
+  }
+  if (end > memory_limit) {
+    end = memory_limit;
+  }
+
+  for (uint32_t i = 0; i < reserved_count && base < end; i++) {
+    const xo_phys_range_t *r = &reserved_ranges[i];
+    if (r->end <= base || r->base >= end) {
+      continue;
+    }
+
+    if (r->base > base) {
+      add_free_range(base, r->base);
+    }
+    base = r->end;
+  }
+
+  base = align_up(base, PAGE_SIZE);
+  end = align_down(end, PAGE_SIZE);
+  if (base < end) {
+    add_pages(base, end);
+  }
+}
+
+static int overlaps_reserved(uint64_t base, uint64_t end, uint64_t *next_base) {
+  for (uint32_t i = 0; i < reserved_count; i++) {
+    const xo_phys_range_t *r = &reserved_ranges[i];
+    if (r->base < end && r->end > base) {
+      *next_base = r->end;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Find room for the page descriptor array inside a usable, early-mapped range
+static uint64_t find_array_space(const xo_boot_info_t *boot_info, uint64_t size) {
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (!is_usable_type(entry->type)) {
+      continue;
+    }
+
+    uint64_t end = entry->base_address + entry->length;
+    uint64_t base = entry->base_address;
+    if (end > EARLY_MAP_LIMIT) {
+      end = EARLY_MAP_LIMIT;
+    }
+    if (base < PMM_LOW_MEMORY_LIMIT) {
+      base = PMM_LOW_MEMORY_LIMIT;
+    }
+    base = align_up(base, PAGE_SIZE);
+
+    uint64_t next_base;
+    while (base + size <= end) {
+      if (!overlaps_reserved(base, base + size, &next_base)) {
+        return base;
+      }
+      base = align_up(next_base, PAGE_SIZE);
+    }
+  }
+  return 0;
+}
+
+void pmm_reserve(uint64_t base, uint64_t length) {
+  if (length == 0 || reserved_count >= PMM_MAX_RESERVED) {
+    return;
+  }
+
+  reserved_ranges[reserved_count].base = align_down(base, PAGE_SIZE);
+  reserved_ranges[reserved_count].end = align_up(base + length, PAGE_SIZE);
+  reserved_count++;
+}
+
+int pmm_init(const xo_boot_info_t *boot_info) {
+  uint64_t min_address = ~0ULL;
+  uint64_t max_address = 0;
+
+  // The kernel image lives in loader data; it must survive reclaim
+  pmm_reserve((uint64_t)(uintptr_t)_kernel_phys_start,
+              (uint64_t)(uintptr_t)(_kernel_phys_end - _kernel_phys_start));
+
+  // So is the initrd, which the kernel reads in place
+  pmm_reserve(boot_info->initrd.address, boot_info->initrd.size);
+
+  // And the boot block, which holds the memory map and command line
+  pmm_reserve(boot_info->block_address, boot_info->block_size);
+
+  // Size the descriptor array to cover everything we may ever manage
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (!is_usable_type(entry->type) && !is_reclaimable_type(entry->type)) {
+      continue;
+    }
+    if (entry->base_address < min_address) {
+      min_address = entry->base_address;
+    }
+    if (entry->base_address + entry->length > max_address) {
+      max_address = entry->base_address + entry->length;
+    }
+  }
+
+  if (max_address <= min_address) {
+    return -1;
+  }
+
+  // Align the base so that buddy arithmetic on indices matches physical alignment
+  base_pfn = align_down(min_address >> PAGE_SHIFT, 1ULL << PMM_MAX_ORDER);
+  page_count = align_up(max_address, PAGE_SIZE) / PAGE_SIZE - base_pfn;
+  if (page_count >= PMM_NONE) {
+    page_count = PMM_NONE - 1;
+  }
+
+  uint64_t array_size = align_up(page_count * sizeof(xo_page_t), PAGE_SIZE);
+  uint64_t array_phys = find_array_space(boot_info, array_size);
+  if (!array_phys) {
+    return -1;
+  }
+  pmm_reserve(array_phys, array_size);
+  page_array = (xo_page_t*)phys_to_virt(array_phys);
+
+  for (uint64_t i = 0; i < page_count; i++) {
+    page_array[i].next = PMM_NONE;
+    page_array[i].prev = PMM_NONE;
+    page_array[i].order = 0;
+    page_array[i].flags = 0;
+    page_array[i].reserved = 0;
+  }
+
+  for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+    free_areas[order].head = PMM_NONE;
+    free_areas[order].count = 0;
+  }
+
+  uint64_t flags = spin_lock_irqsave(&pmm_lock);
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (is_usable_type(entry->type)) {
+      add_free_range(entry->base_address, entry->base_address + entry->length);
+    }
+  }
+  spin_unlock_irqrestore(&pmm_lock, flags);
+
+  return 0;
+}
+
+void pmm_add_high_memory(const xo_boot_info_t *boot_info) {
+  uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+  uint64_t old_limit = memory_limit;
+  memory_limit = ~0ULL;
+
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    uint64_t end = entry->base_address + entry->length;
+    if (is_usable_type(entry->type) && end > old_limit) {
+      uint64_t base = entry->base_address > old_limit ? entry->base_address : old_limit;
+      add_free_range(base, end);
+    }
+  }
+
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_reclaim_bootloader(const xo_boot_info_t *boot_info) {
+  uint64_t flags = spin_lock_irqsave(&pmm_lock);
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (is_reclaimable_type(entry->type)) {
+      add_free_range(entry->base_address, entry->base_address + entry->length);
+    }
+  }
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+uint64_t pmm_alloc_pages(uint32_t order) {
+  if (order > PMM_MAX_ORDER) {
+    return 0;
+  }
+
+  uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+  uint32_t candidates = nonempty_orders >> order;
+  if (!candidates) {
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return 0;
+  }
+
+  uint32_t current = order + (uint32_t)__builtin_ctz(candidates);
+  uint32_t index = free_areas[current].head;
+  list_remove(index, current);
+
+  // Split the block down, returning the upper halves to the free lists
+  while (current > order) {
+    current--;
+    list_push(index + (1u << current), current);
+  }
+
+  page_array[index].order = (uint8_t)order;
+  free_pages -= 1ULL << order;
+
+  spin_unlock_irqrestore(&pmm_lock, flags);
+  return (base_pfn + index) << PAGE_SHIFT;
+}
+
+void pmm_free_pages(uint64_t phys, uint32_t order) {
+  uint64_t pfn = phys >> PAGE_SHIFT;
+  if (!phys || order > PMM_MAX_ORDER || pfn < base_pfn || pfn - base_pfn >= page_count) {
+    return;
+  }
+
+  uint64_t flags = spin_lock_irqsave(&pmm_lock);
+  free_block(pfn - base_pfn, order);
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+uint64_t pmm_free_page_count(void) {
+  return __atomic_load_n(&free_pages, __ATOMIC_RELAXED);
+}
+
+uint64_t pmm_total_page_count(void) {
+  return __atomic_load_n(&total_pages, __ATOMIC_RELAXED);
+}
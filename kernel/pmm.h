@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "boot_info.h"
+#include "memlayout.h"
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE  (1ULL << PAGE_SHIFT)
+
+// Largest buddy block is 2^PMM_MAX_ORDER pages (4 MiB)
+#define PMM_MAX_ORDER 10
+
+// Build the buddy allocator from the usable ranges of the boot memory map.
+// Only memory below EARLY_MAP_LIMIT is handed out until pmm_add_high_memory.
+// Returns 0 on success, -1 if no room could be found for the page array.
+int pmm_init(const xo_boot_info_t *boot_info);
+
+// Release usable memory above EARLY_MAP_LIMIT once the direct map covers it
+void pmm_add_high_memory(const xo_boot_info_t *boot_info);
+
+// Keep a physical range out of the allocator (call before pmm_init, or before
+// pmm_reclaim_bootloader for ranges inside loader memory)
+void pmm_reserve(uint64_t base, uint64_t length);
+
+// Hand loader code/data ranges to the allocator once the kernel no longer
+// depends on anything the bootloader left behind
+void pmm_reclaim_bootloader(const xo_boot_info_t *boot_info);
+
+// Allocate 2^order contiguous, naturally aligned pages.
+// Returns the physical address, or 0 if no block is available.
+uint64_t pmm_alloc_pages(uint32_t order);
+void pmm_free_pages(uint64_t phys, uint32_t order);
+
+static inline uint64_t pmm_alloc_page(void) {
+  return pmm_alloc_pages(0);
+}
+
+static inline void pmm_free_page(uint64_t phys) {
+  pmm_free_pages(phys, 0);
+}
+
+uint64_t pmm_free_page_count(void);
+uint64_t pmm_total_page_count(void);
@@ -0,0 +1,516 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sched.h"
+#include "clock.h"
+#include "cpu.h"
+#include "idt.h"
+#include "irq.h"
+#include "kmalloc.h"
+#include "lapic.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "trace.h"
+
+// Preemptive scheduler with per-CPU run queues and work stealing.
+//
+// Each CPU owns a bounded ring of ready threads. Only the owner pushes (new
+// and woken threads go to the waker's CPU), while the owner and thieves both
+// take from the head with a single compare-and-swap, so the switch path never
+// takes a lock. A CPU whose queue runs dry steals from the other CPUs before
+// going idle. Threads that do not fit in a full ring spill onto a locked
+// overflow list.
+//
+// A thread pushed back onto a queue may be stolen before its old CPU has
+// finished saving its registers; thread->on_cpu stays set until the switch
+// completes and the new CPU waits for it to clear.
+//
+// There is no periodic tick. Each CPU arms its one-shot clockevent for the
+// earlier of the running slice's end and its first sleeper's wake time, and
+// a thread that has a CPU to itself runs without a slice until enqueue()
+// brings it competition. An idle CPU with no sleepers takes no timer
+// interrupts at all; it advertises itself in idle_cpus and a CPU that queues
+// extra work sends one of them a reschedule IPI so it can come and steal.
+
+#define RUNQUEUE_SIZE      256 // Power of two
+#define RUNQUEUE_MASK      (RUNQUEUE_SIZE - 1)
+#define THREAD_STACK_ORDER 2   // 16 KiB
+
+// Deadlines this close are treated as expired rather than re-armed, so a
+// timer that fires marginally early does not cost a second interrupt
+#define TIMER_SLACK_NS 50000
+
+typedef struct {
+  volatile uint64_t head; // Next slot to take (owner and thieves)
+  uint8_t head_padding[56];
+  volatile uint64_t tail; // Next slot to fill (owner only)
+  uint8_t tail_padding[56];
+  thread_t *volatile slots[RUNQUEUE_SIZE];
+} __attribute__((aligned(64))) xo_runqueue_t;
+
+// switch.S
+extern thread_t *context_switch(uint64_t *save_rsp, uint64_t load_rsp, thread_t *prev);
+extern void thread_trampoline(void);
+
+static xo_runqueue_t runqueues[MAX_CPUS];
+static thread_t idle_threads[MAX_CPUS];
+
+static spinlock_t overflow_lock = SPINLOCK_INIT;
+static thread_t *overflow_head = NULL;
+static volatile uint32_t overflow_count = 0;
+
+static volatile uint64_t idle_cpus = 0; // Bit per CPU halted in idle_loop
+
+static volatile uint64_t timeslice_ns = SCHED_DEFAULT_SLICE_MS * 1000000ULL;
+static volatile uint64_t next_thread_id = 1;
+
+// Run queue operations (interrupts disabled)
+static int runqueue_push(xo_runqueue_t *rq, thread_t *thread) {
+  uint64_t tail = rq->tail;
+  uint64_t head = __atomic_load_n(&rq->head, __ATOMIC_ACQUIRE);
+  if (tail - head >= RUNQUEUE_SIZE) {
+    return -1;
+  }
+
+  rq->slots[tail & RUNQUEUE_MASK] = thread;
+  __atomic_store_n(&rq->tail, tail + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static thread_t *runqueue_take(xo_runqueue_t *rq) {
+  uint64_t head = __atomic_load_n(&rq->head, __ATOMIC_ACQUIRE);
+
+  while (1) {
+    uint64_t tail = __atomic_load_n(&rq->tail, __ATOMIC_ACQUIRE);
+    if (head >= tail) {
+      return NULL;
+    }
+
+    // The slot cannot be reused before head moves past it, so a successful
+    // CAS proves the thread we read is the one we claimed
+    thread_t *thread = rq->slots[head & RUNQUEUE_MASK];
+    if (__atomic_compare_exchange_n(&rq->head, &head, head + 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return thread;
+    }
+  }
+}
+
+static int runqueue_empty(const xo_runqueue_t *rq) {
+  return __atomic_load_n(&rq->head, __ATOMIC_ACQUIRE) >= __atomic_load_n(&rq->tail, __ATOMIC_ACQUIRE);
+}
+
+static void enqueue(thread_t *thread) {
+  if (runqueue_push(&runqueues[this_cpu_id()], thread) == 0) {
+    return;
+  }
+
+  spin_lock(&overflow_lock);
+  thread->next = overflow_head;
+  overflow_head = thread;
+  overflow_count++;
+  spin_unlock(&overflow_lock);
+}
+
+// Arm the clockevent for the calling CPU's next deadline, if it changed
+static void program_next_event(xo_percpu_t *cpu) {
+  uint64_t deadline = cpu->slice_end;
+  thread_t *sleeper = cpu->sleepers;
+  if (sleeper && (!deadline || sleeper->wake_time < deadline)) {
+    deadline = sleeper->wake_time;
+  }
+
+  if (deadline == cpu->event_deadline) {
+    return;
+  }
+  cpu->event_deadline = deadline;
+
+  if (deadline) {
+    clockevent_program(deadline);
+  } else {
+    clockevent_cancel();
+  }
+}
+
+// Wake one halted CPU so it can steal the work we just queued
+static void kick_idle_cpu(uint32_t self) {
+  // Pairs with the locked OR in idle_loop: either the idle CPU sees our
+  // queued thread or we see its bit
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  uint64_t idle = __atomic_load_n(&idle_cpus, __ATOMIC_RELAXED) & ~(1ULL << self);
+  if (!idle) {
+    return;
+  }
+
+  // Claim the bit so concurrent wakers interrupt different CPUs
+  uint32_t target = (uint32_t)__builtin_ctzll(idle);
+  uint64_t bit = 1ULL << target;
+  if (__atomic_fetch_and(&idle_cpus, ~bit, __ATOMIC_ACQ_REL) & bit) {
+    lapic_send_ipi(cpu_area(target)->apic_id, VECTOR_RESCHEDULE);
+  }
+}
+
+// Queue a thread that just became runnable (interrupts disabled)
+static void make_ready(thread_t *thread) {
+  xo_percpu_t *cpu = this_cpu();
+
+  thread->state = THREAD_READY;
+  enqueue(thread);
+  trace(TRACE_SCHED_WAKE, thread->id, cpu->cpu_id);
+
+  // An idle CPU picks the thread up from idle_loop by itself
+  if (cpu->current == cpu->idle) {
+    return;
+  }
+
+  // The running thread had the CPU to itself; it now gets a slice
+  if (!cpu->slice_end) {
+    cpu->slice_end = clock_now_ns() + timeslice_ns;
+    program_next_event(cpu);
+  }
+  kick_idle_cpu(cpu->cpu_id);
+}
+
+static void wake_sleepers(xo_percpu_t *cpu, uint64_t now) {
+  while (cpu->sleepers && cpu->sleepers->wake_time <= now + TIMER_SLACK_NS) {
+    thread_t *thread = cpu->sleepers;
+    cpu->sleepers = thread->next;
+    thread->next = NULL;
+    make_ready(thread);
+  }
+}
+
+static thread_t *overflow_take(void) {
+  if (!__atomic_load_n(&overflow_count, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+
+  spin_lock(&overflow_lock);
+  thread_t *thread = overflow_head;
+  if (thread) {
+    overflow_head = thread->next;
+    overflow_count--;
+  }
+  spin_unlock(&overflow_lock);
+  return thread;
+}
+
+static thread_t *steal(uint32_t self) {
+  uint32_t count = smp_cpu_count();
+
+  for (uint32_t i = 1; i < count; i++) {
+    xo_runqueue_t *victim = &runqueues[(self + i) % count];
+    if (runqueue_empty(victim)) {
+      continue;
+    }
+
+    thread_t *thread = runqueue_take(victim);
+    if (thread) {
+      trace(TRACE_SCHED_STEAL, thread->id, (self + i) % count);
+      return thread;
+    }
+  }
+  return NULL;
+}
+
+static thread_t *pick_next(uint32_t cpu_id) {
+  thread_t *thread = runqueue_take(&runqueues[cpu_id]);
+  if (!thread) {
+    thread = overflow_take();
+  }
+  if (!thread) {
+    thread = steal(cpu_id);
+  }
+  return thread;
+}
+
+static int work_available(uint32_t cpu_id) {
+  if (!runqueue_empty(&runqueues[cpu_id]) || __atomic_load_n(&overflow_count, __ATOMIC_ACQUIRE)) {
+    return 1;
+  }
+
+  uint32_t count = smp_cpu_count();
+  for (uint32_t i = 1; i < count; i++) {
+    if (!runqueue_empty(&runqueues[(cpu_id + i) % count])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void free_thread(thread_t *thread) {
+  pmm_free_pages(virt_to_phys((void*)(uintptr_t)thread->stack_base), THREAD_STACK_ORDER);
+  kfree(thread);
+}
+
+// Runs on the new thread's stack right after every switch
+static void finish_switch(thread_t *prev) {
+  __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+  if (prev->state == THREAD_DEAD) {
+    free_thread(prev);
+  }
+}
+
+// Pick the next thread and switch to it (interrupts disabled)
+static void schedule(void) {
+  xo_percpu_t *cpu = this_cpu();
+  thread_t *prev = cpu->current;
+
+  cpu->need_resched = 0;
+
+  thread_t *next = pick_next(cpu->cpu_id);
+  if (!next) {
+    if (prev->state == THREAD_RUNNING) {
+      // Nothing else wants this CPU: keep running with no slice timer
+      cpu->slice_end = 0;
+      program_next_event(cpu);
+      return;
+    }
+    next = cpu->idle;
+  }
+
+  if (next == prev) {
+    // prev blocked, was woken by another CPU before it switched away and
+    // came straight back off the queue: keep running it
+    prev->state = THREAD_RUNNING;
+    cpu->slice_end = clock_now_ns() + timeslice_ns;
+    program_next_event(cpu);
+    return;
+  }
+
+  if (prev->state == THREAD_RUNNING && prev != cpu->idle) {
+    prev->state = THREAD_READY;
+    enqueue(prev);
+    kick_idle_cpu(cpu->cpu_id);
+  }
+
+  while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE)) {
+    cpu_relax();
+  }
+  trace(TRACE_SCHED_SWITCH, prev->id | (uint64_t)prev->state << 32, next->id);
+  next->on_cpu = 1;
+  next->state = THREAD_RUNNING;
+  next->cpu = cpu->cpu_id;
+  cpu->current = next;
+  cpu->slice_end = next == cpu->idle ? 0 : clock_now_ns() + timeslice_ns;
+  program_next_event(cpu);
+
+  thread_t *last = context_switch(&prev->rsp, next->rsp, prev);
+  finish_switch(last);
+}
+
+// Called from thread_trampoline the first time a thread runs
+void sched_thread_start(thread_t *prev) {
+  finish_switch(prev);
+  __asm__ volatile ("sti");
+
+  thread_t *self = thread_current();
+  self->entry(self->arg);
+  thread_exit();
+}
+
+static void timer_interrupt(xo_irq_frame_t *frame) {
+  (void)frame;
+  xo_percpu_t *cpu = this_cpu();
+
+  lapic_eoi();
+
+  // The one-shot event has fired, so nothing is armed any more
+  cpu->event_deadline = 0;
+
+  uint64_t now = clock_now_ns();
+  wake_sleepers(cpu, now);
+
+  if (cpu->slice_end && now + TIMER_SLACK_NS >= cpu->slice_end) {
+    cpu->need_resched = 1;
+    // Try again a slice from now if preemption is currently disabled
+    cpu->slice_end = now + timeslice_ns;
+  }
+
+  // sched_irq_exit rearms the timer when it switches
+  if (!cpu->need_resched || cpu->preempt_count != 0) {
+    program_next_event(cpu);
+  }
+}
+
+// Waking from HLT is all the idle loop needs
+static void reschedule_interrupt(xo_irq_frame_t *frame) {
+  (void)frame;
+  lapic_eoi();
+}
+
+void sched_init(void) {
+  irq_register(VECTOR_TIMER, timer_interrupt);
+  irq_register(VECTOR_RESCHEDULE, reschedule_interrupt);
+}
+
+void sched_irq_exit(void) {
+  xo_percpu_t *cpu = this_cpu();
+  if (cpu->current && cpu->need_resched && cpu->preempt_count == 0) {
+    schedule();
+  }
+}
+
+static __attribute__((noreturn)) void idle_loop(void) {
+  uint32_t cpu_id = this_cpu_id();
+  uint64_t bit = 1ULL << cpu_id;
+
+  while (1) {
+    __asm__ volatile ("cli");
+    if (work_available(cpu_id)) {
+      schedule();
+      continue;
+    }
+
+    // Advertise before the final check so a waker either sees the bit or
+    // we see its work
+    __atomic_fetch_or(&idle_cpus, bit, __ATOMIC_SEQ_CST);
+    if (!work_available(cpu_id)) {
+      // STI only takes effect after HLT, so no wakeup can slip in between
+      trace(TRACE_IDLE_ENTER, 0, 0);
+      __asm__ volatile ("sti; hlt");
+      trace(TRACE_IDLE_EXIT, 0, 0);
+    }
+    __atomic_fetch_and(&idle_cpus, ~bit, __ATOMIC_RELAXED);
+  }
+}
+
+void sched_start(void) {
+  xo_percpu_t *cpu = this_cpu();
+  thread_t *idle = &idle_threads[cpu->cpu_id];
+
+  __asm__ volatile ("cli");
+
+  idle->id = 0;
+  idle->state = THREAD_RUNNING;
+  idle->on_cpu = 1;
+  idle->cpu = cpu->cpu_id;
+  idle->name[0] = 'i';
+  idle->name[1] = 'd';
+  idle->name[2] = 'l';
+  idle->name[3] = 'e';
+  idle->name[4] = 0;
+  cpu->idle = idle;
+  cpu->current = idle;
+
+  idt_load();
+  clockevent_init_cpu(VECTOR_TIMER);
+  idle_loop();
+}
+
+thread_t *thread_create(const char *name, thread_entry_t entry, void *arg) {
+  thread_t *thread = (thread_t*)kmalloc(sizeof(thread_t));
+  if (!thread) {
+    return NULL;
+  }
+
+  uint64_t stack = pmm_alloc_pages(THREAD_STACK_ORDER);
+  if (!stack) {
+    kfree(thread);
+    return NULL;
+  }
+
+  thread->stack_base = (uint64_t)(uintptr_t)phys_to_virt(stack);
+  thread->id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+  thread->on_cpu = 0;
+  thread->cpu = 0;
+  thread->next = NULL;
+  thread->wake_time = 0;
+  thread->entry = entry;
+  thread->arg = arg;
+
+  uint32_t i = 0;
+  for (; name && name[i] && i < sizeof(thread->name) - 1; i++) {
+    thread->name[i] = name[i];
+  }
+  thread->name[i] = 0;
+
+  // Initial frame for context_switch: six zeroed callee-saved registers and
+  // a return into thread_trampoline
+  uint64_t *sp = (uint64_t*)(uintptr_t)(thread->stack_base + (PAGE_SIZE << THREAD_STACK_ORDER));
+  *--sp = (uint64_t)(uintptr_t)thread_trampoline;
+  for (int reg = 0; reg < 6; reg++) {
+    *--sp = 0;
+  }
+  thread->rsp = (uint64_t)(uintptr_t)sp;
+
+  thread->state = THREAD_BLOCKED;
+  thread_wake(thread);
+  return thread;
+}
+
+void thread_wake(thread_t *thread) {
+  uint64_t flags = irq_save();
+  // Only the waker that moves the thread out of BLOCKED may enqueue it
+  uint32_t expected = THREAD_BLOCKED;
+  if (__atomic_compare_exchange_n(&thread->state, &expected, THREAD_READY, 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    make_ready(thread);
+  }
+  irq_restore(flags);
+}
+
+thread_t *thread_current(void) {
+  return this_cpu()->current;
+}
+
+void thread_block(void) {
+  uint64_t flags = irq_save();
+  this_cpu()->current->state = THREAD_BLOCKED;
+  schedule();
+  irq_restore(flags);
+}
+
+void thread_wait(volatile uint32_t *flag) {
+  uint64_t flags = irq_save();
+  thread_t *self = this_cpu()->current;
+  __atomic_store_n(&self->state, THREAD_BLOCKED, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(flag, __ATOMIC_SEQ_CST)) {
+    // Already signalled: requeue ourselves, unless the waker got there first
+    thread_wake(self);
+  }
+  schedule();
+  irq_restore(flags);
+}
+
+void thread_sleep(uint64_t nanoseconds) {
+  uint64_t flags = irq_save();
+  xo_percpu_t *cpu = this_cpu();
+  thread_t *self = cpu->current;
+
+  self->wake_time = clock_now_ns() + nanoseconds;
+
+  thread_t **link = &cpu->sleepers;
+  while (*link && (*link)->wake_time <= self->wake_time) {
+    link = &(*link)->next;
+  }
+  self->next = *link;
+  *link = self;
+
+  self->state = THREAD_SLEEPING;
+  schedule();
+  irq_restore(flags);
+}
+
+void thread_yield(void) {
+  uint64_t flags = irq_save();
+  if (this_cpu()->current) {
+    schedule();
+  }
+  irq_restore(flags);
+}
+
+void thread_exit(void) {
+  __asm__ volatile ("cli");
+  this_cpu()->current->state = THREAD_DEAD;
+  schedule();
+  __builtin_unreachable();
+}
+
+void sched_set_timeslice(uint32_t milliseconds) {
+  uint64_t nanoseconds = (uint64_t)(milliseconds ? milliseconds : 1) * 1000000ULL;
+  __atomic_store_n(&timeslice_ns, nanoseconds, __ATOMIC_RELAXED);
+}
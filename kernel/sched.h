@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+// Default time slice
+#define SCHED_DEFAULT_SLICE_MS 10
+
+typedef enum {
+  THREAD_READY = 0,
+  THREAD_RUNNING,
+  THREAD_BLOCKED,
+  THREAD_SLEEPING,
+  THREAD_DEAD
+} thread_state_t;
+
+typedef void (*thread_entry_t)(void *arg);
+
+typedef struct thread {
+  uint64_t rsp; // Saved stack pointer while switched out
+  uint64_t stack_base;
+  uint64_t id;
+  volatile uint32_t state;
+  volatile uint32_t on_cpu; // Set while a CPU is running on this thread's stack
+  uint32_t cpu;
+  uint32_t reserved;
+  struct thread *next; // Overflow or sleep list link
+  uint64_t wake_time;  // clock_now_ns deadline while sleeping
+  thread_entry_t entry;
+  void *arg;
+  char name[32];
+} thread_t;
+
+// Attach the timer and reschedule interrupt handlers (once, after idt_init)
+void sched_init(void);
+
+// Called on the way out of every interrupt: switch threads if the handler
+// asked for it and preemption is enabled
+void sched_irq_exit(void);
+
+// Turn the calling CPU's current context into its idle thread, set up its
+// one-shot timer and run threads forever. Called by every CPU.
+__attribute__((noreturn)) void sched_start(void);
+
+// Create a ready thread on the calling CPU's run queue; NULL on failure
+thread_t *thread_create(const char *name, thread_entry_t entry, void *arg);
+
+// Block the calling thread until another thread passes it to thread_wake
+void thread_block(void);
+
+// Block the calling thread unless *flag is already non-zero. A waker sets
+// *flag before calling thread_wake, so a wakeup that lands between the
+// caller's last check and blocking is not lost. The caller clears *flag.
+void thread_wait(volatile uint32_t *flag);
+
+// Make a blocked thread runnable again (on the calling CPU's queue)
+void thread_wake(thread_t *thread);
+
+// Block the calling thread for at least the given number of nanoseconds
+void thread_sleep(uint64_t nanoseconds);
+
+thread_t *thread_current(void);
+void thread_yield(void);
+__attribute__((noreturn)) void thread_exit(void);
+
+// Change the preemption time slice for all CPUs
+void sched_set_timeslice(uint32_t milliseconds);
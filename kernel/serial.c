@@ -0,0 +1,269 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "serial.h"
+#include "cpu.h"
+#include "idt.h"
+#include "ioapic.h"
+#include "irq.h"
+#include "klog.h"
+#include "lapic.h"
+#include "spinlock.h"
+
+#define COM1_PORT 0x3F8
+#define COM1_IRQ  4
+
+// Register offsets (DLL/DLM while LCR.DLAB is set)
+#define UART_DATA 0
+#define UART_IER  1
+#define UART_DLL  0
+#define UART_DLM  1
+#define UART_IIR  2
+#define UART_FCR  2
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+#define UART_SCR  7
+
+#define UART_IER_THRE     0x02
+#define UART_LCR_8N1      0x03
+#define UART_LCR_DLAB     0x80
+#define UART_FCR_ENABLE   0xC7 // Enable and clear FIFOs, 14-byte RX trigger
+#define UART_MCR_DTR_RTS  0x03
+#define UART_MCR_OUT2     0x08 // Gates the IRQ line on PC-compatible boards
+#define UART_LSR_THRE     0x20
+#define UART_LSR_TEMT     0x40 // Transmit FIFO and shift register empty
+
+#define UART_FIFO_SIZE 16
+#define UART_DIVISOR   1 // 115200 baud
+
+#define SERIAL_LOG_CHUNK 256
+
+typedef enum {
+  SERIAL_ABSENT = 0,
+  SERIAL_POLLED,
+  SERIAL_BUFFERED
+} xo_serial_mode_t;
+
+static volatile uint32_t serial_mode = SERIAL_ABSENT;
+static volatile uint32_t panicked = 0;
+
+// Transmit ring; the positions only grow
+static uint8_t tx_ring[SERIAL_TX_RING_SIZE];
+static size_t tx_head = 0;
+static size_t tx_tail = 0;
+static uint8_t ier = 0;
+static spinlock_t tx_lock = SPINLOCK_INIT;
+
+// Kernel log mirror
+static size_t log_position = 0;
+static volatile uint32_t log_paused = 0;
+static spinlock_t log_lock = SPINLOCK_INIT;
+
+static void poll_write(const uint8_t *bytes, size_t size) {
+  // THRE means the whole transmit FIFO is empty: refill it in one go
+  while (size) {
+    while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) {
+      cpu_relax();
+    }
+    size_t burst = size < UART_FIFO_SIZE ? size : UART_FIFO_SIZE;
+    for (size_t i = 0; i < burst; i++) {
+      outb(COM1_PORT + UART_DATA, bytes[i]);
+    }
+    bytes += burst;
+    size -= burst;
+  }
+}
+
+// Move up to a FIFO's worth of queued bytes to the UART if it can take them
+// (tx_lock held)
+static void fill_fifo(void) {
+  if (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) {
+    return;
+  }
+  for (uint32_t i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; i++) {
+    outb(COM1_PORT + UART_DATA, tx_ring[tx_tail++ & (SERIAL_TX_RING_SIZE - 1)]);
+  }
+}
+
+static void set_ier(uint8_t value) {
+  if (ier != value) {
+    ier = value;
+    outb(COM1_PORT + UART_IER, value);
+  }
+}
+
+static void serial_interrupt(xo_irq_frame_t *frame) {
+  (void)frame;
+  spin_lock(&tx_lock);
+  inb(COM1_PORT + UART_IIR); // Acknowledge
+  fill_fifo();
+  if (tx_tail == tx_head) {
+    set_ier(0);
+  }
+  spin_unlock(&tx_lock);
+  lapic_eoi();
+}
+
+static void queue_write(const uint8_t *bytes, size_t size) {
+  uint64_t flags = spin_lock_irqsave(&tx_lock);
+  while (size) {
+    size_t space = SERIAL_TX_RING_SIZE - (tx_head - tx_tail);
+    if (!space) {
+      // Producing faster than the line drains: do the handler's job
+      while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) {
+        cpu_relax();
+      }
+      fill_fifo();
+      continue;
+    }
+    size_t count = size < space ? size : space;
+    for (size_t i = 0; i < count; i++) {
+      tx_ring[(tx_head + i) & (SERIAL_TX_RING_SIZE - 1)] = bytes[i];
+    }
+    tx_head += count;
+    bytes += count;
+    size -= count;
+  }
+
+  // A 16550 raises THRE as soon as the interrupt is enabled with an empty
+  // transmitter, which starts the drain
+  if (tx_tail != tx_head) {
+    set_ier(UART_IER_THRE);
+  }
+  spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_write(const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t*)data;
+  uint32_t mode = serial_mode;
+
+  if (mode == SERIAL_BUFFERED) {
+    queue_write(bytes, size);
+  } else if (mode == SERIAL_POLLED) {
+    poll_write(bytes, size);
+  }
+}
+
+// Send log text with "\r\n" line ends
+static void write_log_text(const char *text, size_t length) {
+  static const char crlf[2] = { '\r', '\n' };
+  size_t start = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '\n') {
+      serial_write(text + start, i - start);
+      serial_write(crlf, sizeof(crlf));
+      start = i + 1;
+    }
+  }
+  serial_write(text + start, length - start);
+}
+
+static void drain_log(void) {
+  char buffer[SERIAL_LOG_CHUNK];
+  size_t count;
+  while ((count = klog_read(&log_position, buffer, sizeof(buffer))) != 0) {
+    write_log_text(buffer, count);
+  }
+}
+
+// klog listener: runs after every line
+static void log_listener(void) {
+  if (log_paused) {
+    return;
+  }
+  if (panicked) {
+    // Whatever held the lock may never release it
+    drain_log();
+    return;
+  }
+
+  // One CPU at a time, so chunks go out in log order
+  uint64_t flags = spin_lock_irqsave(&log_lock);
+  drain_log();
+  spin_unlock_irqrestore(&log_lock, flags);
+}
+
+int serial_init(void) {
+  // A missing UART reads back 0xFF
+  outb(COM1_PORT + UART_SCR, 0x5A);
+  if (inb(COM1_PORT + UART_SCR) != 0x5A) {
+    return -1;
+  }
+
+  outb(COM1_PORT + UART_IER, 0);
+  outb(COM1_PORT + UART_LCR, UART_LCR_DLAB);
+  outb(COM1_PORT + UART_DLL, UART_DIVISOR & 0xFF);
+  outb(COM1_PORT + UART_DLM, UART_DIVISOR >> 8);
+  outb(COM1_PORT + UART_LCR, UART_LCR_8N1);
+  outb(COM1_PORT + UART_FCR, UART_FCR_ENABLE);
+  outb(COM1_PORT + UART_MCR, UART_MCR_DTR_RTS);
+  serial_mode = SERIAL_POLLED;
+
+  klog_add_listener(log_listener);
+  log_listener();
+  return 0;
+}
+
+int serial_enable_irq(uint32_t apic_id) {
+  if (serial_mode != SERIAL_POLLED) {
+    return -1;
+  }
+
+  irq_register(VECTOR_IRQ_BASE + COM1_IRQ, serial_interrupt);
+  if (ioapic_route_isa(COM1_IRQ, VECTOR_IRQ_BASE + COM1_IRQ, apic_id) != 0) {
+    return -1;
+  }
+  outb(COM1_PORT + UART_MCR, UART_MCR_DTR_RTS | UART_MCR_OUT2);
+  serial_mode = SERIAL_BUFFERED;
+  return 0;
+}
+
+void serial_flush(void) {
+  if (serial_mode == SERIAL_ABSENT) {
+    return;
+  }
+
+  // Do the handler's job rather than rely on interrupts being enabled
+  uint64_t flags = spin_lock_irqsave(&tx_lock);
+  while (tx_tail != tx_head) {
+    while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) {
+      cpu_relax();
+    }
+    fill_fifo();
+  }
+  while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_TEMT)) {
+    cpu_relax();
+  }
+  spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_set_polled(void) {
+  panicked = 1;
+  if (serial_mode != SERIAL_BUFFERED) {
+    return;
+  }
+  serial_mode = SERIAL_POLLED;
+  outb(COM1_PORT + UART_IER, 0);
+
+  while (tx_tail != tx_head) {
+    size_t start = tx_tail & (SERIAL_TX_RING_SIZE - 1);
+    size_t count = tx_head - tx_tail;
+    if (count > SERIAL_TX_RING_SIZE - start) {
+      count = SERIAL_TX_RING_SIZE - start;
+    }
+    poll_write(&tx_ring[start], count);
+    tx_tail += count;
+  }
+}
+
+void serial_log_pause(void) {
+  uint64_t flags = spin_lock_irqsave(&log_lock);
+  log_paused = 1;
+  spin_unlock_irqrestore(&log_lock, flags);
+}
+
+void serial_log_resume(void) {
+  log_paused = 0;
+  log_listener();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// COM1 16550 UART, 115200 8N1 with FIFOs enabled. Output starts out polled;
+// once serial_enable_irq has routed IRQ 4, writes only copy into a transmit
+// ring and the THRE interrupt refills the FIFO 16 bytes at a time, so a
+// writer never waits ~87 us per character for the line. A writer only
+// spins if the ring is full.
+//
+// The kernel log is mirrored to the port as it is written, with "\r\n" line
+// ends for terminals.
+
+#define SERIAL_TX_RING_SIZE 16384 // Power of two
+
+// Program the UART and start mirroring the kernel log, polled. Returns -1
+// if there is no UART.
+int serial_init(void);
+
+// Switch to interrupt-driven output, with IRQ 4 delivered to the given CPU.
+// Returns 0 on success; output stays polled otherwise.
+int serial_enable_irq(uint32_t apic_id);
+
+// Queue bytes for output (spin-writes them while still polled)
+void serial_write(const void *data, size_t size);
+
+// Wait until everything queued so far has gone out of the UART
+void serial_flush(void);
+
+// Go back to polled output for good and push out everything queued,
+// without taking any lock. For fatal paths, where interrupts may never be
+// taken again.
+void serial_set_polled(void);
+
+// Stop mirroring the kernel log while the port carries binary data; resume
+// catches up on what was logged in between (up to the klog ring's size)
+void serial_log_pause(void);
+void serial_log_resume(void);
@@ -0,0 +1,96 @@
+#include <stdint.h>
+
+#include "simd.h"
+#include "cpu.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "../helpers/mem.h"
+
+// The save area is one page per CPU: XCR0 never enables more than x87, SSE
+// and AVX, whose XSAVE image is 832 bytes, and a page satisfies both the
+// 64-byte XSAVE and 16-byte FXSAVE alignment rules.
+
+#define CPUID_1_ECX_XSAVE (1u << 26)
+#define CPUID_1_ECX_AVX   (1u << 28)
+#define CPUID_7_EBX_AVX2  (1u << 5)
+
+#define MXCSR_DEFAULT 0x1F80 // All exceptions masked, round to nearest
+
+static int features_known = 0;
+static int use_xsave = 0;
+static int has_avx2 = 0;
+static volatile int disabled = 0;
+
+static void detect_features(void) {
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+  use_xsave = (ecx & CPUID_1_ECX_XSAVE) && (ecx & CPUID_1_ECX_AVX);
+
+  cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+  if (use_xsave && eax >= 7) {
+    cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+    has_avx2 = (ebx & CPUID_7_EBX_AVX2) != 0;
+  }
+  features_known = 1;
+}
+
+int simd_init_cpu(void) {
+  if (!features_known) {
+    detect_features();
+  }
+
+  uint64_t state = pmm_alloc_page();
+  if (!state) {
+    return -1;
+  }
+
+  write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP);
+  write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT | (use_xsave ? CR4_OSXSAVE : 0));
+  if (use_xsave) {
+    xsetbv(0, XCR0_X87 | XCR0_SSE | XCR0_AVX);
+  }
+
+  uint32_t mxcsr = MXCSR_DEFAULT;
+  __asm__ volatile ("fninit; ldmxcsr %0" : : "m"(mxcsr));
+
+  // XRSTOR faults on non-zero reserved bytes or XCOMP_BV in the XSAVE
+  // header, and XSAVE only ever writes XSTATE_BV there
+  memset(phys_to_virt(state), 0, PAGE_SIZE);
+
+  xo_percpu_t *cpu = this_cpu();
+  cpu->simd_state = phys_to_virt(state);
+  cpu->simd_depth = 0;
+  return 0;
+}
+
+int simd_has_avx2(void) {
+  return has_avx2;
+}
+
+void simd_begin(void) {
+  preempt_disable();
+  xo_percpu_t *cpu = this_cpu();
+  if (cpu->simd_depth++ == 0 && !disabled) {
+    if (use_xsave) {
+      __asm__ volatile ("xsave64 (%0)" : : "r"(cpu->simd_state), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else {
+      __asm__ volatile ("fxsave64 (%0)" : : "r"(cpu->simd_state) : "memory");
+    }
+  }
+}
+
+void simd_end(void) {
+  xo_percpu_t *cpu = this_cpu();
+  if (--cpu->simd_depth == 0 && !disabled) {
+    if (use_xsave) {
+      __asm__ volatile ("xrstor64 (%0)" : : "r"(cpu->simd_state), "a"(0xFFFFFFFFu), "d"(0xFFFFFFFFu) : "memory");
+    } else {
+      __asm__ volatile ("fxrstor64 (%0)" : : "r"(cpu->simd_state) : "memory");
+    }
+  }
+  preempt_enable();
+}
+
+void simd_disable(void) {
+  disabled = 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// SIMD in the kernel. Everything is built without SSE except the vector
+// translation units (*_sse2.c, *_avx2.c), and their code may only run
+// between simd_begin and simd_end, which save and restore the register
+// state of the interrupted context around it.
+
+// Enable SSE on this CPU, plus AVX through XSAVE where the CPU has both, and
+// give it a save area. Requires pmm_init and percpu_setup. The boot CPU's
+// call decides the feature set; every CPU must call it before simd_begin.
+// Returns 0 on success, -1 if no save area could be allocated.
+int simd_init_cpu(void);
+
+int simd_has_avx2(void);
+
+// Enter and leave a SIMD section. Sections nest; only the outermost one
+// saves and restores state. Preemption is disabled in between. Not for use
+// from interrupt handlers.
+void simd_begin(void);
+void simd_end(void);
+
+// Stop saving and restoring register state for good: simd_begin and
+// simd_end only toggle preemption from then on. For fatal paths, which run
+// in exception context and must not run vector code (see
+// gfx_force_scalar). Code outside SIMD sections never touches the vector
+// registers, so sections in flight on other CPUs lose nothing.
+void simd_disable(void);
@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "smp.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "delay.h"
+#include "gdt.h"
+#include "irq.h"
+#include "lapic.h"
+#include "memlayout.h"
+#include "paging.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "sched.h"
+#include "simd.h"
+#include "trace.h"
+#include "../helpers/mem.h"
+
+// AP startup follows the INIT-SIPI-SIPI sequence, but each step is broadcast
+// to all APs before waiting, so bring-up costs one INIT delay in total rather
+// than one per CPU. APs take stacks by ticket in the trampoline and then find
+// their per-CPU block by APIC ID.
+
+#define AP_TRAMPOLINE_BASE 0x8000
+#define AP_STACK_ORDER     2 // 16 KiB
+#define AP_START_TIMEOUT_US 200000
+
+typedef struct {
+  uint64_t boot_cr3;
+  uint64_t kernel_cr3;
+  uint64_t entry;
+  uint64_t efer_bits;
+  uint64_t ticket;
+  uint64_t stacks[MAX_CPUS];
+} xo_ap_params_t;
+
+extern char ap_trampoline_start[];
+extern char ap_trampoline_end[];
+extern char ap_trampoline_params[];
+extern char ap_high_entry[];
+extern char boot_pml4[];
+
+static uint32_t cpu_count = 1;
+static volatile uint32_t cpus_online = 1;
+
+static uint32_t find_cpu_by_apic_id(uint32_t apic_id) {
+  for (uint32_t i = 0; i < cpu_count; i++) {
+    if (percpu_areas[i].apic_id == apic_id) {
+      return i;
+    }
+  }
+  return MAX_CPUS;
+}
+
+// Called from ap_high_entry on the AP's own stack and the kernel page tables
+void ap_main(void) {
+  paging_init_cpu();
+  gdt_init();
+  lapic_enable();
+
+  uint32_t cpu_id = find_cpu_by_apic_id(lapic_id());
+  if (cpu_id == MAX_CPUS) {
+    return;
+  }
+  percpu_setup(cpu_id, percpu_areas[cpu_id].apic_id);
+  if (gdt_init_cpu() != 0 || irq_init_cpu() != 0 || trace_init_cpu() != 0 || simd_init_cpu() != 0) {
+    return;
+  }
+
+  __atomic_store_n(&this_cpu()->online, 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&cpus_online, 1, __ATOMIC_RELEASE);
+
+  sched_start();
+}
+
+static void add_cpu(uint32_t apic_id, uint32_t flags, uint32_t bsp_apic_id) {
+  // Online-capable entries without Enabled describe CPUs that are not present
+  if (!(flags & ACPI_MADT_CPU_ENABLED)) {
+    return;
+  }
+  if (apic_id == bsp_apic_id || cpu_count >= MAX_CPUS) {
+    return;
+  }
+  percpu_areas[cpu_count].apic_id = apic_id;
+  percpu_areas[cpu_count].cpu_id = cpu_count;
+  cpu_count++;
+}
+
+static uint64_t parse_madt(const acpi_madt_t *madt, uint32_t bsp_apic_id) {
+  uint64_t lapic_address = madt->local_apic_address;
+  const uint8_t *cursor = (const uint8_t*)madt + sizeof(acpi_madt_t);
+  const uint8_t *end = (const uint8_t*)madt + madt->header.length;
+
+  while (cursor + sizeof(acpi_madt_entry_t) <= end) {
+    const acpi_madt_entry_t *entry = (const acpi_madt_entry_t*)cursor;
+    if (entry->length < sizeof(acpi_madt_entry_t)) {
+      break;
+    }
+
+    switch (entry->type) {
+      case ACPI_MADT_LOCAL_APIC: {
+        const acpi_madt_local_apic_t *lapic = (const acpi_madt_local_apic_t*)entry;
+        add_cpu(lapic->apic_id, lapic->flags, bsp_apic_id);
+        break;
+      }
+      case ACPI_MADT_LOCAL_X2APIC: {
+        const acpi_madt_local_x2apic_t *x2apic = (const acpi_madt_local_x2apic_t*)entry;
+        // xAPIC mode can only address 8-bit APIC IDs
+        if (x2apic->x2apic_id < 0xFF || lapic_x2apic_supported()) {
+          add_cpu(x2apic->x2apic_id, x2apic->flags, bsp_apic_id);
+        }
+        break;
+      }
+      case ACPI_MADT_LOCAL_APIC_OVERRIDE: {
+        const acpi_madt_local_apic_override_t *override = (const acpi_madt_local_apic_override_t*)entry;
+        lapic_address = override->local_apic_address;
+        break;
+      }
+      default:
+        break;
+    }
+
+    cursor += entry->length;
+  }
+
+  return lapic_address;
+}
+
+// Does [base, base + size) lie in RAM the firmware no longer uses?
+static int trampoline_page_usable(const xo_boot_info_t *boot_info, uint64_t base, uint64_t size) {
+  for (uint32_t i = 0; i < boot_info->memory_map_entries; i++) {
+    const xo_memory_entry_t *entry = &boot_info->memory_map[i];
+    if (entry->base_address <= base && entry->base_address + entry->length >= base + size) {
+      return entry->type == XO_MEMORY_AVAILABLE ||
+             entry->type == XO_MEMORY_CONVENTIONAL ||
+             entry->type == XO_MEMORY_BOOTLOADER_CODE ||
+             entry->type == XO_MEMORY_BOOTLOADER_DATA;
+    }
+  }
+  return 0;
+}
+
+static void start_aps(const xo_boot_info_t *boot_info) {
+  uint64_t size = (uint64_t)(ap_trampoline_end - ap_trampoline_start);
+  if (size > PAGE_SIZE || !trampoline_page_usable(boot_info, AP_TRAMPOLINE_BASE, PAGE_SIZE)) {
+    return;
+  }
+
+  // Copy the trampoline below 1 MiB
+  uint8_t *trampoline = (uint8_t*)phys_to_virt(AP_TRAMPOLINE_BASE);
+  memcpy(trampoline, ap_trampoline_start, size);
+
+  xo_ap_params_t *params = (xo_ap_params_t*)(trampoline + (ap_trampoline_params - ap_trampoline_start));
+  params->boot_cr3 = (uint64_t)(uintptr_t)boot_pml4;
+  params->kernel_cr3 = paging_kernel_cr3();
+  params->entry = (uint64_t)(uintptr_t)ap_high_entry;
+  params->efer_bits = EFER_LME | (rdmsr(MSR_EFER) & EFER_NXE);
+  params->ticket = 0;
+
+  uint32_t stacks = 0;
+  for (uint32_t i = 1; i < cpu_count; i++) {
+    uint64_t stack = pmm_alloc_pages(AP_STACK_ORDER);
+    if (!stack) {
+      break;
+    }
+    params->stacks[stacks++] = (uint64_t)(uintptr_t)phys_to_virt(stack) + (PAGE_SIZE << AP_STACK_ORDER);
+  }
+  cpu_count = stacks + 1;
+
+  for (uint32_t i = 1; i < cpu_count; i++) {
+    lapic_send_init(percpu_areas[i].apic_id);
+  }
+  udelay(10000);
+
+  for (uint32_t i = 1; i < cpu_count; i++) {
+    lapic_send_startup(percpu_areas[i].apic_id, AP_TRAMPOLINE_BASE >> 12);
+  }
+  udelay(200);
+
+  // Second SIPI only for CPUs that missed the first one
+  if (__atomic_load_n(&params->ticket, __ATOMIC_ACQUIRE) < cpu_count - 1) {
+    for (uint32_t i = 1; i < cpu_count; i++) {
+      if (!__atomic_load_n(&percpu_areas[i].online, __ATOMIC_ACQUIRE)) {
+        lapic_send_startup(percpu_areas[i].apic_id, AP_TRAMPOLINE_BASE >> 12);
+      }
+    }
+  }
+
+  for (uint32_t waited = 0; waited < AP_START_TIMEOUT_US; waited += 100) {
+    if (__atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE) == cpu_count) {
+      break;
+    }
+    udelay(100);
+  }
+}
+
+uint32_t smp_init(const xo_boot_info_t *boot_info) {
+  uint32_t bsp_apic_id = cpu_initial_apic_id();
+  uint64_t lapic_address = 0;
+
+  percpu_areas[0].apic_id = bsp_apic_id;
+  percpu_areas[0].online = 1;
+
+  const acpi_madt_t *madt = (const acpi_madt_t*)acpi_find_table("APIC");
+  if (madt) {
+    lapic_address = parse_madt(madt, bsp_apic_id);
+  }
+
+  if (lapic_init(lapic_address) != 0) {
+    cpu_count = 1;
+    return 1;
+  }
+
+  if (cpu_count > 1) {
+    start_aps(boot_info);
+  }
+
+  return __atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE);
+}
+
+uint32_t smp_cpu_count(void) {
+  return cpu_count;
+}
+
+uint32_t smp_online_count(void) {
+  return __atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE);
+}
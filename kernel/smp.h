@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "boot_info.h"
+
+// Parse the MADT (acpi_init must have run), bring up the local APIC and start every enabled
+// application processor. Returns the number of CPUs online (at least 1).
+uint32_t smp_init(const xo_boot_info_t *boot_info);
+
+// Number of CPU ids handed out; ids whose per-CPU block is not online
+// failed to start
+uint32_t smp_cpu_count(void);
+uint32_t smp_online_count(void);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "cpu.h"
+#include "percpu.h"
+
+// Simple test-and-test-and-set spinlock. Holding one disables preemption;
+// use the _irqsave variants for locks also taken from interrupt handlers.
+typedef struct {
+  volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(spinlock_t *lock) {
+  preempt_disable();
+  while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+      __asm__ volatile ("pause");
+    }
+  }
+}
+
+// Bounded wait for fatal paths that cannot tell whether a lock is held by
+// another CPU (and will come free) or by their own, now dead, context
+#define SPIN_PROBE_TRIES (1u << 20)
+
+// Take the lock only if it is free; returns non-zero on success
+static inline int spin_trylock(spinlock_t *lock) {
+  preempt_disable();
+  if (!__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+    return 1;
+  }
+  preempt_enable();
+  return 0;
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+  __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+  preempt_enable();
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock) {
+  uint64_t flags = irq_save();
+  spin_lock(lock);
+  return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+  spin_unlock(lock);
+  irq_restore(flags);
+}
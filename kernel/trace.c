@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "trace.h"
+#include "clock.h"
+#include "cpu.h"
+#include "klog.h"
+#include "memlayout.h"
+#include "percpu.h"
+#include "pmm.h"
+#include "sched.h"
+#include "serial.h"
+#include "smp.h"
+#include "../helpers/crc32c.h"
+#include "../helpers/mem.h"
+
+#define TRACE_RING_RECORDS ((PAGE_SIZE << TRACE_RING_ORDER) / sizeof(xo_trace_record_t))
+
+// Dump format, all little-endian: a header, then for each CPU a ring header
+// followed by its records oldest first, then a footer. Records whose
+// sequence does not match their position were torn or overwritten while
+// being read and are sent with sequence 0.
+#define TRACE_DUMP_MAGIC   0x0045434152544F58ULL // "XOTRACE"
+#define TRACE_DUMP_VERSION 1
+#define TRACE_DUMP_END     0x45544F58 // "XOTE"
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t cpu_count;
+  uint32_t reserved;
+  uint64_t tsc_hz;
+} xo_trace_dump_header_t;
+
+typedef struct {
+  uint32_t cpu_id;
+  uint32_t apic_id;
+  uint64_t first;  // Position of the first record sent
+  uint64_t count;
+} xo_trace_dump_ring_t;
+
+typedef struct {
+  uint32_t crc32c; // Of everything from the header to the last record
+  uint32_t end;
+} xo_trace_dump_footer_t;
+
+volatile uint32_t trace_enabled = 0;
+
+static int trace_requested = 0;
+static uint64_t dump_delay_ms = 0;
+static uint32_t dump_crc;
+
+void trace_record(uint16_t event, uint64_t arg0, uint64_t arg1) {
+  // Stay on this CPU between reserving the slot and filling it
+  preempt_disable();
+  xo_trace_record_t *ring = this_cpu()->trace_ring;
+  if (ring) {
+    // Not LOCKed: only this CPU moves its head, and an interrupt cannot
+    // split a single instruction
+    uint64_t position = 1;
+    __asm__ volatile ("xaddq %0, %%gs:%c1"
+                      : "+r"(position) : "i"(offsetof(xo_percpu_t, trace_head)) : "memory");
+
+    xo_trace_record_t *record = &ring[position & (TRACE_RING_RECORDS - 1)];
+    record->sequence = 0;
+    __asm__ volatile ("" : : : "memory");
+    record->tsc = rdtsc();
+    record->event = event;
+    record->reserved = 0;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    __atomic_store_n(&record->sequence, (uint32_t)position + 1, __ATOMIC_RELEASE);
+  }
+  preempt_enable();
+}
+
+int trace_init_cpu(void) {
+  if (!trace_requested) {
+    return 0;
+  }
+  uint64_t phys = pmm_alloc_pages(TRACE_RING_ORDER);
+  if (!phys) {
+    return -1;
+  }
+  xo_trace_record_t *ring = (xo_trace_record_t*)phys_to_virt(phys);
+  memset(ring, 0, PAGE_SIZE << TRACE_RING_ORDER);
+
+  xo_percpu_t *cpu = this_cpu();
+  cpu->trace_head = 0;
+  __atomic_store_n(&cpu->trace_ring, ring, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void dump_thread(void *arg) {
+  (void)arg;
+  thread_sleep(dump_delay_ms * 1000000);
+  trace_dump();
+}
+
+int trace_init(const char *option) {
+  // "trace" alone, or "trace=<ms>"
+  if (!option || (*option && *option != ' ' && *option != '=')) {
+    return -1;
+  }
+  if (*option == '=') {
+    for (const char *p = option + 1; *p >= '0' && *p <= '9'; p++) {
+      dump_delay_ms = dump_delay_ms * 10 + (uint64_t)(*p - '0');
+    }
+  }
+
+  trace_requested = 1;
+  if (trace_init_cpu() != 0) {
+    trace_requested = 0;
+    return -1;
+  }
+  if (dump_delay_ms && !thread_create("trace", dump_thread, NULL)) {
+    klog("trace: no dump thread");
+  }
+  trace_enabled = 1;
+  return 0;
+}
+
+static void dump_write(const void *data, size_t size) {
+  dump_crc = crc32c(dump_crc, data, size);
+  serial_write(data, size);
+}
+
+// Copy a record the way a seqlock reader would; 0 if it changed under us
+static int read_record(const xo_trace_record_t *slot, uint64_t position, xo_trace_record_t *out) {
+  uint32_t expected = (uint32_t)position + 1;
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != expected) {
+    return 0;
+  }
+  out->tsc = slot->tsc;
+  out->event = slot->event;
+  out->reserved = 0;
+  out->arg0 = slot->arg0;
+  out->arg1 = slot->arg1;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  out->sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+  return out->sequence == expected;
+}
+
+void trace_dump(void) {
+  uint32_t was_enabled = trace_enabled;
+  trace_enabled = 0;
+  serial_log_pause();
+
+  uint32_t cpus = 0;
+  for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+    if (__atomic_load_n(&cpu_area(i)->trace_ring, __ATOMIC_ACQUIRE)) {
+      cpus++;
+    }
+  }
+
+  xo_trace_dump_header_t header = {
+    .magic = TRACE_DUMP_MAGIC,
+    .version = TRACE_DUMP_VERSION,
+    .record_size = sizeof(xo_trace_record_t),
+    .cpu_count = cpus,
+    .reserved = 0,
+    .tsc_hz = clock_tsc_hz(),
+  };
+  dump_crc = 0;
+  dump_write(&header, sizeof(header));
+
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+    xo_percpu_t *cpu = cpu_area(i);
+    const xo_trace_record_t *ring = __atomic_load_n(&cpu->trace_ring, __ATOMIC_ACQUIRE);
+    if (!ring) {
+      continue;
+    }
+
+    uint64_t head = __atomic_load_n(&cpu->trace_head, __ATOMIC_ACQUIRE);
+    uint64_t count = head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS;
+    xo_trace_dump_ring_t ring_header = {
+      .cpu_id = cpu->cpu_id,
+      .apic_id = cpu->apic_id,
+      .first = head - count,
+      .count = count,
+    };
+    dump_write(&ring_header, sizeof(ring_header));
+
+    for (uint64_t position = head - count; position < head; position++) {
+      xo_trace_record_t record;
+      if (!read_record(&ring[position & (TRACE_RING_RECORDS - 1)], position, &record)) {
+        memset(&record, 0, sizeof(record));
+      }
+      dump_write(&record, sizeof(record));
+    }
+    total += count;
+  }
+
+  xo_trace_dump_footer_t footer = { .crc32c = dump_crc, .end = TRACE_DUMP_END };
+  serial_write(&footer, sizeof(footer));
+  serial_log_resume();
+  klog("trace: dumped %lu record(s) from %u cpu(s)", total, cpus);
+
+  trace_enabled = was_enabled;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+// Static tracepoints. Each CPU appends fixed-size binary records to its own
+// ring; a writer reserves its slot with one unlocked instruction on its
+// per-CPU head, so there are no locks, no shared cache lines and nothing to
+// format on the hot path. Old records are overwritten. With tracing off a
+// tracepoint costs one predicted branch.
+//
+// trace_dump streams every ring over the serial port; tools/tracedump.py
+// decodes the capture. Event numbers are part of that format: append new
+// ones, never renumber.
+
+#define TRACE_RING_ORDER 5 // 128 KiB (4096 records) per CPU
+
+typedef enum {
+  TRACE_MARK = 0,         // Caller-defined arguments
+  TRACE_IRQ = 1,          // Vector, handler cycles
+  TRACE_SCHED_SWITCH = 2, // Previous thread id and state << 32, next thread id
+  TRACE_SCHED_WAKE = 3,   // Thread id, CPU whose queue it went on
+  TRACE_SCHED_STEAL = 4,  // Thread id, CPU it was taken from
+  TRACE_IDLE_ENTER = 5,
+  TRACE_IDLE_EXIT = 6,
+  TRACE_EVENT_COUNT
+} xo_trace_event_t;
+
+typedef struct xo_trace_record {
+  uint64_t tsc;
+  uint32_t sequence; // Low bits of the record's position plus one, stored last
+  uint16_t event;
+  uint16_t reserved;
+  uint64_t arg0;
+  uint64_t arg1;
+} xo_trace_record_t;
+
+extern volatile uint32_t trace_enabled;
+
+void trace_record(uint16_t event, uint64_t arg0, uint64_t arg1);
+
+static inline void trace(uint16_t event, uint64_t arg0, uint64_t arg1) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record(event, arg0, arg1);
+  }
+}
+
+// Give the calling CPU a ring if tracing was requested. Returns 0 on
+// success (including when tracing is off).
+int trace_init_cpu(void);
+
+// Turn tracing on from the command line: "trace" records from boot,
+// "trace=<ms>" also dumps the rings that long after boot. Call on the BSP
+// before the APs start; returns 0 if tracing is now on.
+int trace_init(const char *option);
+
+// Pause tracing and write every ring to the serial port
+void trace_dump(void);
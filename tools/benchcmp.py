@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Compare two `make bench` result files (see bench/bench.c).
+
+Prints the change in median time per operation for every benchmark present
+in both. A change counts as a regression or an improvement when it exceeds
+the threshold and the two runs' sample ranges do not overlap, so noisy
+benchmarks are not flagged on one unlucky run.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as handle:
+        data = json.load(handle)
+    if data.get("version") != 1:
+        raise ValueError("%s: unsupported result version" % path)
+    return data, {result["name"]: result for result in data["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("-t", "--threshold", type=float, default=5.0,
+                        help="percent change to report (default 5)")
+    parser.add_argument("--fail", action="store_true",
+                        help="exit with status 1 if anything regressed")
+    args = parser.parse_args()
+
+    try:
+        old_data, old = load(args.old)
+        new_data, new = load(args.new)
+    except (OSError, ValueError) as error:
+        sys.stderr.write("benchcmp: %s\n" % error)
+        return 2
+
+    if old_data.get("cpu") != new_data.get("cpu"):
+        sys.stderr.write("benchcmp: warning: runs are from different CPUs\n")
+
+    print("%-26s %14s %14s %9s" % ("benchmark", old_data.get("label") or "old",
+                                   new_data.get("label") or "new", "change"))
+    regressions = 0
+    for name, before in old.items():
+        after = new.get(name)
+        if after is None:
+            continue
+        a = before["ns_per_op"]
+        b = after["ns_per_op"]
+        change = (b["median"] - a["median"]) * 100.0 / a["median"]
+        verdict = ""
+        if abs(change) >= args.threshold:
+            if change > 0 and b["min"] > a["max"]:
+                verdict = "regressed"
+                regressions += 1
+            elif change < 0 and b["max"] < a["min"]:
+                verdict = "improved"
+            else:
+                verdict = "noise"
+        print("%-26s %11.2f ns %11.2f ns %+8.1f%% %s" % (name, a["median"], b["median"],
+                                                        change, verdict))
+
+    for name in sorted(set(new) - set(old)):
+        print("%-26s %14s %11.2f ns" % (name, "-", new[name]["ns_per_op"]["median"]))
+
+    return 1 if args.fail and regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Measure boot time by booting the ESP headlessly in QEMU several times.
+
+Each run boots a private copy of the ESP whose cmdline.txt adds "exit", so
+the kernel logs its boot profile (kernel/boot_profile.c) to the serial port
+and then stops QEMU through the isa-debug-exit device. Reported per run:
+wall-clock time from launching QEMU to its exit, and the in-guest phases
+parsed from the serial log. Uses KVM when /dev/kvm is usable and TCG
+otherwise; needs no root.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# kernel/main.c writes DEBUG_EXIT_SUCCESS (0x10); QEMU exits with (v << 1) | 1
+EXIT_SUCCESS_STATUS = 33
+
+# boot_profile.c: "boot: %18s %6lu.%03lu ms"
+PHASE_LINE = re.compile(rb"^boot: +(.+?) +(\d+)\.(\d{3}) ms\r?$", re.MULTILINE)
+
+# (code, vars) pairs; vars None means a combined image for -bios
+FIRMWARE = [
+    ("/usr/share/OVMF/OVMF_CODE.fd", "/usr/share/OVMF/OVMF_VARS.fd"),
+    ("/usr/share/OVMF/OVMF_CODE_4M.fd", "/usr/share/OVMF/OVMF_VARS_4M.fd"),
+    ("/usr/share/edk2/ovmf/OVMF_CODE.fd", "/usr/share/edk2/ovmf/OVMF_VARS.fd"),
+    ("/usr/share/edk2/x64/OVMF_CODE.fd", "/usr/share/edk2/x64/OVMF_VARS.fd"),
+    ("/usr/share/edk2-ovmf/x64/OVMF_CODE.fd", "/usr/share/edk2-ovmf/x64/OVMF_VARS.fd"),
+    ("/usr/share/qemu/OVMF.fd", None),
+    ("/usr/share/ovmf/OVMF.fd", None),
+]
+
+
+def find_firmware(code, variables):
+    if code:
+        return code, variables
+    for candidate, candidate_vars in FIRMWARE:
+        if os.path.exists(candidate) and (candidate_vars is None or os.path.exists(candidate_vars)):
+            return candidate, candidate_vars
+    return None, None
+
+
+def kvm_usable():
+    return os.access("/dev/kvm", os.R_OK | os.W_OK)
+
+
+def prepare_esp(esp, work):
+    """Copy the ESP and add "exit" to its command line."""
+    target = os.path.join(work, "esp")
+    shutil.copytree(esp, target)
+    path = os.path.join(target, "cmdline.txt")
+    cmdline = ""
+    if os.path.exists(path):
+        with open(path) as handle:
+            cmdline = " ".join(handle.read().split())
+    with open(path, "w") as handle:
+        handle.write((cmdline + " exit").strip() + "\n")
+    return target
+
+
+def qemu_command(args, esp, variables, serial_log):
+    command = [args.qemu, "-machine", "q35", "-m", args.memory, "-smp", str(args.smp),
+               "-display", "none", "-no-reboot", "-monitor", "none",
+               "-serial", "file:" + serial_log,
+               "-device", "isa-debug-exit,iobase=0xf4,iosize=0x04",
+               "-drive", "format=raw,file=fat:" + esp]
+    if args.accel == "kvm":
+        command += ["-accel", "kvm", "-cpu", "host"]
+    else:
+        command += ["-accel", "tcg", "-cpu", "max"]
+    if variables:
+        command += ["-drive", "if=pflash,format=raw,readonly=on,file=" + args.code,
+                    "-drive", "if=pflash,format=raw,file=" + variables]
+    else:
+        command += ["-bios", args.code]
+    return command
+
+
+def boot_once(args, esp, work, index):
+    """Boot once; return (wall-clock ms, {phase: ms}) or raise RuntimeError."""
+    serial_log = os.path.join(work, "serial-%d.log" % index)
+    variables = None
+    if args.vars:
+        # Firmware may write its variable store; never touch the system copy
+        variables = os.path.join(work, "vars.fd")
+        shutil.copyfile(args.vars, variables)
+
+    command = qemu_command(args, esp, variables, serial_log)
+    start = time.monotonic()
+    try:
+        result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        raise RuntimeError("run %d: no exit within %d s (serial log: %s)"
+                           % (index, args.timeout, serial_log))
+    wall_ms = (time.monotonic() - start) * 1000.0
+
+    if result.returncode != EXIT_SUCCESS_STATUS:
+        raise RuntimeError("run %d: qemu exited with %d: %s (serial log: %s)"
+                           % (index, result.returncode,
+                              result.stderr.decode(errors="replace").strip(), serial_log))
+
+    with open(serial_log, "rb") as handle:
+        output = handle.read()
+    phases = {}
+    for match in PHASE_LINE.finditer(output):
+        name = match.group(1).decode()
+        phases[name] = int(match.group(2)) + int(match.group(3)) / 1000.0
+    if not phases:
+        raise RuntimeError("run %d: no boot profile in the serial log (%s)" % (index, serial_log))
+    return wall_ms, phases
+
+
+def summarize(values):
+    return {
+        "median": statistics.median(values),
+        "mean": statistics.mean(values),
+        "stddev": statistics.stdev(values) if len(values) > 1 else 0.0,
+        "min": min(values),
+        "max": max(values),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--esp", default="build/esp", help="ESP directory (default build/esp)")
+    parser.add_argument("-n", "--runs", type=int, default=5)
+    parser.add_argument("--accel", choices=["kvm", "tcg"],
+                        help="default: kvm if /dev/kvm is usable, else tcg")
+    parser.add_argument("--qemu", default="qemu-system-x86_64")
+    parser.add_argument("--code", help="OVMF code image (default: search common paths)")
+    parser.add_argument("--vars", help="OVMF variable store template to go with --code")
+    parser.add_argument("--memory", default="512M")
+    parser.add_argument("--smp", type=int, default=2)
+    parser.add_argument("--timeout", type=int, help="seconds per run (default 30, 120 on tcg)")
+    parser.add_argument("-o", "--output", help="also write the results as JSON")
+    args = parser.parse_args()
+
+    if not os.path.isfile(os.path.join(args.esp, "EFI", "BOOT", "BOOTX64.EFI")):
+        sys.stderr.write("bootbench: %s has no EFI/BOOT/BOOTX64.EFI; run make esp\n" % args.esp)
+        return 2
+    if shutil.which(args.qemu) is None:
+        sys.stderr.write("bootbench: %s not found\n" % args.qemu)
+        return 2
+    args.code, args.vars = find_firmware(args.code, args.vars)
+    if not args.code:
+        sys.stderr.write("bootbench: no OVMF firmware found; pass --code (and --vars)\n")
+        return 2
+    if args.accel is None:
+        args.accel = "kvm" if kvm_usable() else "tcg"
+    if args.timeout is None:
+        args.timeout = 30 if args.accel == "kvm" else 120
+
+    walls = []
+    phases = {}
+    order = []
+    with tempfile.TemporaryDirectory(prefix="bootbench-") as work:
+        esp = prepare_esp(args.esp, work)
+        for index in range(args.runs):
+            try:
+                wall_ms, run_phases = boot_once(args, esp, work, index)
+            except RuntimeError as error:
+                # Keep the evidence: the work directory is about to go away
+                kept = tempfile.mkdtemp(prefix="bootbench-failed-")
+                for name in os.listdir(work):
+                    if name.endswith(".log"):
+                        shutil.copy(os.path.join(work, name), kept)
+                sys.stderr.write("bootbench: %s\n" % str(error).replace(work, kept))
+                return 1
+            walls.append(wall_ms)
+            for name, value in run_phases.items():
+                if name not in phases:
+                    phases[name] = []
+                    order.append(name)
+                phases[name].append(value)
+            sys.stderr.write("run %d: %.1f ms wall, %.3f ms in guest\n"
+                             % (index + 1, wall_ms, run_phases.get("total", 0.0)))
+
+    results = {
+        "version": 1,
+        "accel": args.accel,
+        "runs": args.runs,
+        "smp": args.smp,
+        "wall_ms": summarize(walls),
+        "phases_ms": {name: summarize(phases[name]) for name in order},
+    }
+
+    print("%-20s %10s %10s %10s %10s" % ("phase (%s, %d runs)" % (args.accel, args.runs),
+                                         "median", "mean", "min", "max"))
+    rows = [(name, results["phases_ms"][name]) for name in order]
+    rows.append(("wall clock", results["wall_ms"]))
+    for name, stats in rows:
+        print("%-20s %10.3f %10.3f %10.3f %10.3f" % (name, stats["median"], stats["mean"],
+                                                     stats["min"], stats["max"]))
+
+    if args.output:
+        with open(args.output, "w") as handle:
+            json.dump(results, handle, indent=2)
+            handle.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
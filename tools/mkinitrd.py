@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Pack a directory tree into an XO initrd archive (see kernel/initrd.h)."""
+
+import os
+import struct
+import sys
+
+MAGIC = 0x445254494E494F58  # "XOINITRD"
+VERSION = 1
+DATA_ALIGN = 16
+PAGE_SIZE = 4096
+
+HEADER = struct.Struct("<QIIQQ")
+ENTRY = struct.Struct("<IIIIQQ")
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def align(value, alignment):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+
+def collect(root):
+    files = []
+    for directory, subdirs, names in os.walk(root):
+        subdirs.sort()
+        for name in sorted(names):
+            path = os.path.join(directory, name)
+            relative = os.path.relpath(path, root).replace(os.sep, "/")
+            files.append((relative.encode("utf-8"), path))
+    return files
+
+
+def build(root):
+    files = collect(root)
+    # Search order used by the kernel: hash, then name bytes
+    files.sort(key=lambda item: (fnv1a(item[0]), item[0]))
+
+    strings = bytearray()
+    name_offsets = []
+    for name, _ in files:
+        name_offsets.append(len(strings))
+        strings += name + b"\0"
+
+    strings_offset = HEADER.size + ENTRY.size * len(files)
+    offset = strings_offset + len(strings)
+
+    # Files of a page or more start on a page boundary so they can later be
+    # mapped rather than copied
+    data = []
+    for _, path in files:
+        with open(path, "rb") as handle:
+            contents = handle.read()
+        offset = align(offset, PAGE_SIZE if len(contents) >= PAGE_SIZE else DATA_ALIGN)
+        data.append((offset, contents))
+        offset += len(contents)
+    total_size = offset
+
+    image = bytearray(total_size)
+    HEADER.pack_into(image, 0, MAGIC, VERSION, len(files), strings_offset, total_size)
+    for i, (name, _) in enumerate(files):
+        data_offset, contents = data[i]
+        ENTRY.pack_into(image, HEADER.size + i * ENTRY.size, fnv1a(name), name_offsets[i],
+                        len(name), 0, data_offset, len(contents))
+        image[data_offset:data_offset + len(contents)] = contents
+    image[strings_offset:strings_offset + len(strings)] = strings
+    return bytes(image), len(files)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: mkinitrd.py <root directory> <output image>\n")
+        return 1
+
+    image, count = build(sys.argv[1])
+    with open(sys.argv[2], "wb") as handle:
+        handle.write(image)
+    print("initrd: %d files, %d bytes" % (count, len(image)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Decode kernel trace dumps from a serial capture (see kernel/trace.c).
+
+The capture may contain other output around the binary dumps, e.g. from
+QEMU's -serial file:<path>. Every dump found is decoded, records from all
+CPUs merged in TSC order.
+"""
+
+import struct
+import sys
+
+MAGIC = b"XOTRACE\0"
+VERSION = 1
+END = 0x45544F58  # "XOTE"
+
+HEADER = struct.Struct("<QIIIIQ")
+RING = struct.Struct("<IIQQ")
+RECORD = struct.Struct("<QIHHQQ")
+FOOTER = struct.Struct("<II")
+
+# Must match xo_trace_event_t in kernel/trace.h
+EVENTS = ["mark", "irq", "sched_switch", "sched_wake", "sched_steal", "idle_enter", "idle_exit"]
+
+# thread_state_t in kernel/sched.h
+THREAD_STATES = ["ready", "running", "blocked", "sleeping", "dead"]
+
+
+def crc32c_table():
+    table = []
+    for i in range(256):
+        value = i
+        for _ in range(8):
+            value = (value >> 1) ^ (0x82F63B78 if value & 1 else 0)
+        table.append(value)
+    return table
+
+
+CRC32C_TABLE = crc32c_table()
+
+
+def crc32c(data):
+    value = 0xFFFFFFFF
+    for byte in data:
+        value = CRC32C_TABLE[(value ^ byte) & 0xFF] ^ (value >> 8)
+    return value ^ 0xFFFFFFFF
+
+
+def format_args(event, arg0, arg1):
+    if event == 1:
+        return "vector=0x%02x cycles=%d" % (arg0, arg1)
+    if event == 2:
+        state = arg0 >> 32
+        name = THREAD_STATES[state] if state < len(THREAD_STATES) else str(state)
+        return "prev=%d (%s) next=%d" % (arg0 & 0xFFFFFFFF, name, arg1)
+    if event == 3:
+        return "thread=%d cpu=%d" % (arg0, arg1)
+    if event == 4:
+        return "thread=%d from=%d" % (arg0, arg1)
+    if event in (5, 6):
+        return ""
+    return "0x%x 0x%x" % (arg0, arg1)
+
+
+def decode(capture, offset):
+    """Decode the dump at offset; return (records, torn, tsc_hz, end offset)."""
+    magic, version, record_size, cpu_count, _, tsc_hz = HEADER.unpack_from(capture, offset)
+    if version != VERSION or record_size != RECORD.size:
+        raise ValueError("unsupported dump version %d" % version)
+
+    start = offset
+    offset += HEADER.size
+    records = []
+    torn = 0
+    for _ in range(cpu_count):
+        cpu_id, _, first, count = RING.unpack_from(capture, offset)
+        offset += RING.size
+        for position in range(first, first + count):
+            tsc, sequence, event, _, arg0, arg1 = RECORD.unpack_from(capture, offset)
+            offset += RECORD.size
+            if sequence != (position + 1) & 0xFFFFFFFF:
+                torn += 1
+                continue
+            records.append((tsc, cpu_id, event, arg0, arg1))
+
+    checksum, end = FOOTER.unpack_from(capture, offset)
+    if end != END or checksum != crc32c(capture[start:offset]):
+        raise ValueError("dump at offset %d is corrupt" % start)
+    records.sort()
+    return records, torn, tsc_hz, offset + FOOTER.size
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: tracedump.py <serial capture>\n")
+        return 1
+
+    with open(sys.argv[1], "rb") as handle:
+        capture = handle.read()
+
+    dumps = 0
+    offset = capture.find(MAGIC)
+    while offset >= 0:
+        try:
+            records, torn, tsc_hz, end = decode(capture, offset)
+        except (ValueError, struct.error) as error:
+            sys.stderr.write("tracedump: %s\n" % error)
+            offset = capture.find(MAGIC, offset + 1)
+            continue
+
+        dumps += 1
+        print("# dump %d: %d records, %d torn, tsc %d Hz" % (dumps, len(records), torn, tsc_hz))
+        base = records[0][0] if records else 0
+        for tsc, cpu, event, arg0, arg1 in records:
+            microseconds = (tsc - base) * 1e6 / tsc_hz if tsc_hz else float(tsc - base)
+            name = EVENTS[event] if event < len(EVENTS) else "event%d" % event
+            print("%14.3f cpu%-3d %-13s %s" % (microseconds, cpu, name,
+                                                format_args(event, arg0, arg1)))
+        offset = capture.find(MAGIC, end)
+
+    if not dumps:
+        sys.stderr.write("tracedump: no trace dump found\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())